@@ -26,7 +26,10 @@ SOFTWARE. */
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <wctype.h>
 #include <errno.h>
+#include <time.h>
+#include <limits.h>
 #include <linux/limits.h>
 
 #include "cli.h"
@@ -42,6 +45,7 @@ SOFTWARE. */
 #define FWDECL // Indicator for forward declarative statements.
 
 #define BUFLEN_ID 17
+#define BUFLEN_IDS BUFLEN_CLI
 #define BUFLEN_CLI 8193
 #define BUFLEN_TITLE 65
 #define BUFLEN_DETAIL 513
@@ -49,6 +53,8 @@ SOFTWARE. */
 #define BUFLEN_YES_NO 3
 #define BUFLEN_SEARCH_STR 129
 #define BUFLEN_HISTORY_INDEX 5
+#define BUFLEN_PROFILE 17
+#define BUFLEN_LIMIT 11
 
 #define EDIT_TEMP_FILE_NAME "toodles.details.edit"
 #define DEFAULT_EDITOR "vim"
@@ -110,6 +116,13 @@ typedef struct inner_command_t
      */
     const byte_t* description;
 
+    /**
+     * @brief True if the command only queues writes when write-behind is enabled. All other commands wait for
+     * pending writes first.
+     *
+     */
+    const bool deferred;
+
     /**
      * @brief The function that is executed when the command is issued.
      *
@@ -122,6 +135,7 @@ FWDECL static void cli_print_help();
 FWDECL static void cli_exit();
 FWDECL static void cli_add();
 FWDECL static void cli_list();
+FWDECL static void cli_next();
 FWDECL static void cli_erase();
 FWDECL static void cli_search();
 FWDECL static void cli_clear();
@@ -138,6 +152,12 @@ FWDECL static void cli_delete_attachment();
 FWDECL static void cli_show_attachments();
 FWDECL static void cli_print_attachment();
 FWDECL static void cli_save_attachment_to_disk();
+FWDECL static void cli_sweep();
+FWDECL static void cli_compact();
+FWDECL static void cli_backup();
+FWDECL static void cli_restore();
+FWDECL static void cli_sync();
+FWDECL static void cli_archive();
 FWDECL static void cli_execute_cmdstr();
 FWDECL static void cli_env();
 
@@ -151,15 +171,17 @@ static command_t COMMANDS[] = {
         .short_command = L"a",
         .description = "Adds a new todo entry.",
         .func = cli_add,
+        .deferred = true,
         .synopsis = "[TITLE](opt)",
         .category = TODOS,
     },
     {
         .command = L"remove",
         .short_command = L"r",
-        .description = "Removes a todo entry.",
+        .description = "Removes todo entries. Takes ids and ranges like 4,7,10-250.",
         .func = cli_remove,
-        .synopsis = "[ID]",
+        .deferred = true,
+        .synopsis = "[IDS]",
         .category = TODOS,
     },
     {
@@ -173,17 +195,24 @@ static command_t COMMANDS[] = {
     {
         .command = L"detail",
         .short_command = L"d",
-        .description = "Displays the details of an entry.",
+        .description = "Displays the details of one or more entries.",
         .func = cli_detail,
-        .synopsis = "[ID]",
+        .synopsis = "[IDS]",
         .category = TODOS,
     },
     {
         .command = L"list",
         .short_command = L"l",
-        .description = "Lists all current entries.",
+        .description = "Lists all current entries. Shows pages of [LIMIT] entries if given, archived entries too with --all.",
         .func = cli_list,
-        .synopsis = "[LIST OPTION](opt)",
+        .synopsis = "[LIST OPTION](opt) [LIMIT](opt) [--all](opt)",
+        .category = TODOS,
+    },
+    {
+        .command = L"next",
+        .short_command = L"n",
+        .description = "Shows the next page of the last paged list.",
+        .func = cli_next,
         .category = TODOS,
     },
     {
@@ -196,16 +225,18 @@ static command_t COMMANDS[] = {
     },
     {
         .command = L"done",
-        .description = "Marks the given todo as done.",
+        .description = "Marks the given todos as done.",
         .func = cli_done,
-        .synopsis = "[ID]",
+        .deferred = true,
+        .synopsis = "[IDS]",
         .category = TODOS,
     },
     {
         .command = L"open",
-        .description = "Marks the given todo as open.",
+        .description = "Marks the given todos as open.",
         .func = cli_open,
-        .synopsis = "[ID]",
+        .deferred = true,
+        .synopsis = "[IDS]",
         .category = TODOS,
     },
     {
@@ -214,6 +245,40 @@ static command_t COMMANDS[] = {
         .func = cli_erase,
         .category = MISC,
     },
+    {
+        .command = L"compact",
+        .description = "Gives free space of the database back to the file system.",
+        .func = cli_compact,
+        .category = MISC,
+    },
+    {
+        .command = L"backup",
+        .description = "Backs up all data to [PATH], writing only what changed since the last backup there.",
+        .func = cli_backup,
+        .synopsis = "[PATH]",
+        .category = MISC,
+    },
+    {
+        .command = L"restore",
+        .description = "Replaces all data with the verified backup at [PATH].",
+        .func = cli_restore,
+        .synopsis = "[PATH]",
+        .category = MISC,
+    },
+    {
+        .command = L"sync",
+        .description = "Writes the todo changes since the last export to [PATH] or applies the changes of another storage from [PATH].",
+        .func = cli_sync,
+        .synopsis = "[export-changes|apply] [PATH]",
+        .category = MISC,
+    },
+    {
+        .command = L"archive",
+        .description = "Moves done entries unchanged for [DAYS] days and their attachments into the archive.",
+        .func = cli_archive,
+        .synopsis = "[DAYS]",
+        .category = MISC,
+    },
     {
         .command = L"help",
         .short_command = L"h",
@@ -285,6 +350,12 @@ static command_t COMMANDS[] = {
         .synopsis = "[ID]",
         .category = ATTACHMENTS
     },
+    {
+        .command = L"sweep",
+        .description = "Deletes attachments of removed todos and blobs nothing refers to.",
+        .func = cli_sweep,
+        .category = ATTACHMENTS
+    },
     {
         .command = L"!",
         .description = "Executes a command that is stored in the history.",
@@ -294,12 +365,26 @@ static command_t COMMANDS[] = {
     },
     {
         .command = L"env",
-        .description = "Displays environment data for toodles.",
+        .description = "Displays environment data. Switches the storage profile (safe, fast, bulk) if given.",
         .func = cli_env,
+        .synopsis = "[PROFILE](opt)",
         .category = MISC,
     }
 };
 
+/**
+ * @brief State of the last paged list, continued by the next command.
+ *
+ */
+static struct
+{
+    STORAGE_PRINT_OPTIONS option;
+    int limit;
+    long long cursor;
+    bool all;
+
+} list_page = { 0 };
+
 /**
  * @brief Self tailored getline. Discards all that is left in stdin after reading into the buffer and replaces newline in buffer with 0.
  *
@@ -550,27 +635,127 @@ static void cli_add(command_t* cmd, const wchar_t* cmdstr)
 static void cli_list(command_t* cmd, const wchar_t* cmdstr)
 {
     wchar_t opt_str[BUFLEN_LIST_OPTION] = { 0 };
+    wchar_t limit_str[BUFLEN_LIST_OPTION] = { 0 };
+    wchar_t flag_str[BUFLEN_LIST_OPTION] = { 0 };
 
     wchar_t* args[] = {
-        opt_str
+        opt_str,
+        limit_str,
+        flag_str
     };
 
     size_t lens[] = {
+        BUFLEN_LIST_OPTION,
+        BUFLEN_LIST_OPTION,
         BUFLEN_LIST_OPTION
     };
 
-    cli_parse_cmd(cmd, cmdstr, 1, args, lens);
+    cli_parse_cmd(cmd, cmdstr, 3, args, lens);
+
+    // --all may be given anywhere, the remaining arguments close up behind it.
+    bool all = false;
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (wcscmp(args[i], L"--all") != 0)
+        {
+            continue;
+        }
+
+        all = true;
+
+        for (size_t j = i; j < 2; j++)
+        {
+            wcscpy(args[j], args[j + 1]);
+        }
+
+        flag_str[0] = 0;
+        break;
+    }
+
+    if (flag_str[0] != 0)
+    {
+        printf(RED("ERR: ") "%s\n", "Please use list [LIST OPTION] [LIMIT] [--all].");
+        return;
+    }
+
+    // A signed number is a limit as well, so that 'list -5' is rejected instead of listing everything.
+    bool signed_number = (opt_str[0] == L'-' || opt_str[0] == L'+') && iswdigit(opt_str[1]);
+
+    if (iswdigit(opt_str[0]) || signed_number)
+    {
+        wcscpy(limit_str, opt_str);
+        opt_str[0] = 0;
+    }
 
     STORAGE_PRINT_OPTIONS option = storage_str_to_option(opt_str);
+    int limit = -1;
+
+    if (!CHAR_ARR_EMPTY(limit_str))
+    {
+        wchar_t* end = NULL;
+        long parsed = wcstol(limit_str, &end, 10);
+
+        if (*end != 0 || parsed <= 0 || parsed > INT_MAX)
+        {
+            printf(RED("ERR: ") "%s\n", "Please provide a limit bigger than 0.");
+            return;
+        }
+
+        limit = (int)parsed;
+    }
+
+    list_page.option = option;
+    list_page.limit = limit;
+    list_page.cursor = 0;
+    list_page.all = all;
 
     const byte_t* err = NULL;
-    STORAGE_ERR_CODE error = storage_print_todos(option, &err);
+    STORAGE_ERR_CODE error = all
+        ? storage_print_all_todos_page(option, 0, limit, &list_page.cursor, &err)
+        : storage_print_todos_page(option, 0, limit, &list_page.cursor, &err);
 
     if (error != STORAGE_NO_ERROR)
     {
         printf(RED("ERR: ") "%s\n", err);
         return;
     }
+
+    if (list_page.cursor != 0)
+    {
+        printf(YELLOW("More entries available, type 'next'.\n"));
+    }
+}
+
+/**
+ * @brief Prints the next page of the last paged list.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_next(command_t* cmd, const wchar_t* cmdstr)
+{
+    if (list_page.cursor == 0)
+    {
+        printf("No more entries.\n");
+        return;
+    }
+
+    const byte_t* err = NULL;
+    STORAGE_ERR_CODE error = list_page.all
+        ? storage_print_all_todos_page(list_page.option, list_page.cursor, list_page.limit, &list_page.cursor, &err)
+        : storage_print_todos_page(list_page.option, list_page.cursor, list_page.limit, &list_page.cursor, &err);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    if (list_page.cursor != 0)
+    {
+        printf(YELLOW("More entries available, type 'next'.\n"));
+    }
 }
 
 /**
@@ -651,21 +836,21 @@ static void cli_clear()
 }
 
 /**
- * @brief Remove an entry from the database.
+ * @brief Removes entries from the database.
  *
  * @param cmd The issued command.
  * @param cmdstr The issued command as a string.
  */
 static void cli_remove(command_t* cmd, const wchar_t* cmdstr)
 {
-    wchar_t id[BUFLEN_ID] = { 0 };
+    wchar_t ids[BUFLEN_IDS] = { 0 };
 
     wchar_t* args[] = {
-        id
+        ids
     };
 
     size_t lens[] = {
-        BUFLEN_ID
+        BUFLEN_IDS
     };
 
     int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
@@ -675,34 +860,42 @@ static void cli_remove(command_t* cmd, const wchar_t* cmdstr)
 
     const byte_t* err = NULL;
 
-    byte_t bs_id[BUFLEN_ID * sizeof(wchar_t)] = { 0 };
-    wstobs(id, bs_id, BUFLEN_ID * sizeof(wchar_t));
+    byte_t bs_ids[BUFLEN_IDS * sizeof(wchar_t)] = { 0 };
+    wstobs(ids, bs_ids, BUFLEN_IDS * sizeof(wchar_t));
 
-    STORAGE_ERR_CODE error = storage_remove_todo(bs_id, &err);
+    size_t affected = 0;
+    STORAGE_ERR_CODE error = storage_remove_todo(bs_ids, &affected, &err);
 
     if (error != STORAGE_NO_ERROR)
     {
         printf(RED("ERR: ") "%s\n", err);
         return;
     }
+
+    if (storage_write_behind())
+    {
+        return;
+    }
+
+    printf("Removed %zu todos.\n", affected);
 }
 
 /**
- * @brief Display the details of an entry.
+ * @brief Displays the details of entries.
  *
  * @param cmd The issued command.
  * @param cmdstr The issued command as a string.
  */
 static void cli_detail(command_t* cmd, const wchar_t* cmdstr)
 {
-    wchar_t id[BUFLEN_ID] = { 0 };
+    wchar_t ids[BUFLEN_IDS] = { 0 };
 
     wchar_t* args[] = {
-        id
+        ids
     };
 
     size_t lens[] = {
-        BUFLEN_ID
+        BUFLEN_IDS
     };
 
     int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
@@ -712,10 +905,10 @@ static void cli_detail(command_t* cmd, const wchar_t* cmdstr)
 
     const byte_t* err = NULL;
 
-    byte_t bs_id[BUFLEN_ID * sizeof(wchar_t)] = { 0 };
-    wstobs(id, bs_id, BUFLEN_ID * sizeof(wchar_t));
+    byte_t bs_ids[BUFLEN_IDS * sizeof(wchar_t)] = { 0 };
+    wstobs(ids, bs_ids, BUFLEN_IDS * sizeof(wchar_t));
 
-    STORAGE_ERR_CODE error = storage_print_details(bs_id, &err);
+    STORAGE_ERR_CODE error = storage_print_details(bs_ids, &err);
 
     if (error != STORAGE_NO_ERROR)
     {
@@ -725,21 +918,21 @@ static void cli_detail(command_t* cmd, const wchar_t* cmdstr)
 }
 
 /**
- * @brief Marks an entry as done.
+ * @brief Marks entries as done.
  *
  * @param cmd The issued command.
  * @param cmdstr The issued command as a string.
  */
 static void cli_done(command_t* cmd, const wchar_t* cmdstr)
 {
-    wchar_t id[BUFLEN_ID] = { 0 };
+    wchar_t ids[BUFLEN_IDS] = { 0 };
 
     wchar_t* args[] = {
-        id
+        ids
     };
 
     size_t lens[] = {
-        BUFLEN_ID
+        BUFLEN_IDS
     };
 
     int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
@@ -749,34 +942,42 @@ static void cli_done(command_t* cmd, const wchar_t* cmdstr)
 
     const byte_t* err = NULL;
 
-    byte_t bs_id[BUFLEN_ID * sizeof(wchar_t)] = { 0 };
-    wstobs(id, bs_id, BUFLEN_ID * sizeof(wchar_t));
+    byte_t bs_ids[BUFLEN_IDS * sizeof(wchar_t)] = { 0 };
+    wstobs(ids, bs_ids, BUFLEN_IDS * sizeof(wchar_t));
 
-    STORAGE_ERR_CODE error = storage_set_done(bs_id, STORAGE_DONE, &err);
+    size_t affected = 0;
+    STORAGE_ERR_CODE error = storage_set_done(bs_ids, STORAGE_DONE, &affected, &err);
 
     if (error != STORAGE_NO_ERROR)
     {
         printf(RED("ERR: ") "%s\n", err);
         return;
     }
+
+    if (storage_write_behind())
+    {
+        return;
+    }
+
+    printf("Marked %zu todos as done.\n", affected);
 }
 
 /**
- * @brief Marks an entry as open.
+ * @brief Marks entries as open.
  *
  * @param cmd The issued command.
  * @param cmdstr The issued command as a string.
  */
 static void cli_open(command_t* cmd, const wchar_t* cmdstr)
 {
-    wchar_t id[BUFLEN_ID] = { 0 };
+    wchar_t ids[BUFLEN_IDS] = { 0 };
 
     wchar_t* args[] = {
-        id
+        ids
     };
 
     size_t lens[] = {
-        BUFLEN_ID
+        BUFLEN_IDS
     };
 
     int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
@@ -786,16 +987,24 @@ static void cli_open(command_t* cmd, const wchar_t* cmdstr)
 
     const byte_t* err = NULL;
 
-    byte_t bs_id[BUFLEN_ID * sizeof(wchar_t)] = { 0 };
-    wstobs(id, bs_id, BUFLEN_ID * sizeof(wchar_t));
+    byte_t bs_ids[BUFLEN_IDS * sizeof(wchar_t)] = { 0 };
+    wstobs(ids, bs_ids, BUFLEN_IDS * sizeof(wchar_t));
 
-    STORAGE_ERR_CODE error = storage_set_done(bs_id, STORAGE_OPEN, &err);
+    size_t affected = 0;
+    STORAGE_ERR_CODE error = storage_set_done(bs_ids, STORAGE_OPEN, &affected, &err);
 
     if (error != STORAGE_NO_ERROR)
     {
         printf(RED("ERR: ") "%s\n", err);
         return;
     }
+
+    if (storage_write_behind())
+    {
+        return;
+    }
+
+    printf("Marked %zu todos as open.\n", affected);
 }
 
 /**
@@ -1076,7 +1285,7 @@ static void cli_attach(command_t* cmd, const wchar_t* cmdstr)
     byte_t bs_path[PATH_MAX * sizeof(wchar_t)] = { 0 };
     wstobs(path, bs_path, PATH_MAX * sizeof(wchar_t));
 
-    STORAGE_ERR_CODE error = storage_attach_file(bs_id, bs_path, &err);
+    STORAGE_ERR_CODE error = storage_attach_file(bs_id, bs_path, NULL, &err);
 
     if (error != STORAGE_NO_ERROR)
     {
@@ -1122,6 +1331,307 @@ static void cli_delete_attachment(command_t* cmd, const wchar_t* cmdstr)
     }
 }
 
+/**
+ * @brief Deletes orphaned attachments and blobs and prints how much space was freed.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_sweep(command_t* cmd, const wchar_t* cmdstr)
+{
+    const byte_t* err = NULL;
+    size_t attachments = 0;
+    long long reclaimed = 0;
+
+    STORAGE_ERR_CODE error = storage_sweep_orphans(&attachments, &reclaimed, &err);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    printf("Removed %zu orphaned attachments and reclaimed %lld bytes.\n", attachments, reclaimed);
+}
+
+/**
+ * @brief Compacts the storage file and prints its size afterwards.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_compact(command_t* cmd, const wchar_t* cmdstr)
+{
+    const byte_t* err = NULL;
+    long long pages = 0;
+    long long free_pages = 0;
+    long long reclaimed = 0;
+
+    STORAGE_ERR_CODE error = storage_compact(&pages, &free_pages, &reclaimed, &err);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    printf("Reclaimed %lld bytes, %lld pages left, %lld of them free.\n", reclaimed, pages, free_pages);
+}
+
+/**
+ * @brief Shows how far a backup or restore got.
+ *
+ * @param copied Number of copied pages.
+ * @param total Number of pages.
+ */
+static void cli_print_progress(long long copied, long long total)
+{
+    printf("\rCopied %lld of %lld pages", copied, total);
+    fflush(stdout);
+}
+
+/**
+ * @brief Reads the path argument of backup and restore.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ * @param path Buffer of PATH_MAX * sizeof(wchar_t) bytes that receives the path.
+ * @return bool True if a path was given.
+ */
+static bool cli_parse_path(command_t* cmd, const wchar_t* cmdstr, byte_t* path)
+{
+    wchar_t wpath[PATH_MAX] = { 0 };
+
+    wchar_t* args[] = {
+        wpath
+    };
+
+    size_t lens[] = {
+        PATH_MAX
+    };
+
+    int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
+
+    if (read == -1 || CHAR_ARR_EMPTY(wpath))
+    {
+        printf(RED("ERR: ") "%s\n", "Please provide a file path.");
+        return false;
+    }
+
+    wstobs(wpath, path, PATH_MAX * sizeof(wchar_t));
+
+    return true;
+}
+
+/**
+ * @brief Backs up the storage to the given path and prints the throughput.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_backup(command_t* cmd, const wchar_t* cmdstr)
+{
+    byte_t path[PATH_MAX * sizeof(wchar_t)] = { 0 };
+
+    if (!cli_parse_path(cmd, cmdstr, path))
+    {
+        return;
+    }
+
+    const byte_t* err = NULL;
+    storage_copy_stats_t stats = { 0 };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    STORAGE_ERR_CODE error = storage_backup(path, cli_print_progress, &stats, &err);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("\r\033[2K");
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    long long bytes = stats.pages * stats.page_size;
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double rate = seconds > 0 ? bytes / seconds / (1024 * 1024) : 0;
+
+    printf("Backed up %lld bytes in %.3f s (%.1f MB/s), wrote %lld of %lld pages and %lld attachment files (%lld bytes).\n",
+        bytes, seconds, rate, stats.written, stats.pages, stats.files, stats.file_bytes);
+}
+
+/**
+ * @brief Replaces all data with a backup after asking for confirmation.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_restore(command_t* cmd, const wchar_t* cmdstr)
+{
+    byte_t path[PATH_MAX * sizeof(wchar_t)] = { 0 };
+
+    if (!cli_parse_path(cmd, cmdstr, path))
+    {
+        return;
+    }
+
+    printf(YELLOW("Do you really want to replace all data with the backup? [y,n]: "));
+
+    wchar_t yes_no[BUFLEN_YES_NO] = { 0 };
+    cli_getline_discard(yes_no, BUFLEN_YES_NO);
+
+    if (wcscmp(yes_no, L"y") != 0)
+    {
+        printf("Cancel\n");
+        return;
+    }
+
+    const byte_t* err = NULL;
+    storage_copy_stats_t stats = { 0 };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    STORAGE_ERR_CODE error = storage_restore(path, cli_print_progress, &stats, &err);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("\r\033[2K");
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    long long bytes = stats.pages * stats.page_size;
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double rate = seconds > 0 ? bytes / seconds / (1024 * 1024) : 0;
+
+    printf("Restored %lld bytes in %.3f s (%.1f MB/s) and %lld attachment files (%lld bytes).\n",
+        bytes, seconds, rate, stats.files, stats.file_bytes);
+}
+
+/**
+ * @brief Exchanges todo changes with another storage through a change file.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_sync(command_t* cmd, const wchar_t* cmdstr)
+{
+    byte_t action[PATH_MAX * sizeof(wchar_t)] = { 0 };
+
+    if (!cli_parse_path(cmd, cmdstr, action))
+    {
+        return;
+    }
+
+    // The path is the rest of the line, so it may contain spaces.
+    byte_t* path = strchr(action, ' ');
+
+    if (path != NULL)
+    {
+        *path++ = 0;
+        path += strspn(path, " ");
+    }
+
+    bool export = strcmp(action, "export-changes") == 0;
+
+    if (!export && strcmp(action, "apply") != 0)
+    {
+        printf(RED("ERR: ") "%s\n", "Please use sync export-changes [PATH] or sync apply [PATH].");
+        return;
+    }
+
+    if (path == NULL || *path == 0)
+    {
+        printf(RED("ERR: ") "%s\n", "Please provide a file path.");
+        return;
+    }
+
+    const byte_t* err = NULL;
+    storage_sync_stats_t stats = { 0 };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    STORAGE_ERR_CODE error = export ? storage_sync_export(path, &stats, &err) : storage_sync_apply(path, &stats, &err);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    double millis = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    if (export)
+    {
+        printf("Exported %lld changes (%lld bytes) in %.1f ms.\n", stats.changes, stats.bytes, millis);
+        return;
+    }
+
+    printf("Applied %lld changes (%lld bytes) in %.1f ms: %lld added, %lld changed, %lld removed, "
+        "%lld conflicts, %lld newer local todos kept.\n",
+        stats.changes, stats.bytes, millis, stats.added, stats.changed, stats.removed, stats.conflicts, stats.kept);
+}
+
+/**
+ * @brief Moves old done todos and their attachments into the archive.
+ *
+ * @param cmd The issued command.
+ * @param cmdstr The issued command as a string.
+ */
+static void cli_archive(command_t* cmd, const wchar_t* cmdstr)
+{
+    wchar_t days_str[BUFLEN_LIMIT] = { 0 };
+
+    wchar_t* args[] = {
+        days_str
+    };
+
+    size_t lens[] = {
+        BUFLEN_LIMIT
+    };
+
+    cli_parse_cmd(cmd, cmdstr, 1, args, lens);
+
+    wchar_t* end = NULL;
+    long days = wcstol(days_str, &end, 10);
+
+    if (CHAR_ARR_EMPTY(days_str) || *end != 0 || days < 0 || days > INT_MAX)
+    {
+        printf(RED("ERR: ") "%s\n", "Please provide the number of days.");
+        return;
+    }
+
+    const byte_t* err = NULL;
+    long long todos = 0;
+    long long attachments = 0;
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    STORAGE_ERR_CODE error = storage_archive((int)days, &todos, &attachments, &err);
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
+
+    double millis = (stop.tv_sec - start.tv_sec) * 1e3 + (stop.tv_nsec - start.tv_nsec) / 1e6;
+
+    printf("Archived %lld todos and %lld attachments in %.1f ms.\n", todos, attachments, millis);
+}
+
 /**
  * @brief Shows all attachments for given todo id.
  *
@@ -1215,7 +1725,7 @@ static void cli_save_attachment_to_disk(command_t* cmd, const wchar_t* cmdstr)
         BUFLEN_ID
     };
 
-    int read = cli_parse_cmd(cmd, cmdstr, 2, args, lens);
+    int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
 
     if (read == -1)
         return;
@@ -1228,8 +1738,8 @@ static void cli_save_attachment_to_disk(command_t* cmd, const wchar_t* cmdstr)
     printf("Save path: ");
     cli_getline_discard(save_path, PATH_MAX);
 
-    byte_t bs_save_path[BUFLEN_ID * sizeof(wchar_t)] = { 0 };
-    wstobs(save_path, bs_save_path, BUFLEN_ID * sizeof(wchar_t));
+    byte_t bs_save_path[PATH_MAX * sizeof(wchar_t)] = { 0 };
+    wstobs(save_path, bs_save_path, PATH_MAX * sizeof(wchar_t));
 
     STORAGE_ERR_CODE error = storage_save_attachment_to_disk(bs_id, bs_save_path, &err);
 
@@ -1248,8 +1758,44 @@ static void cli_save_attachment_to_disk(command_t* cmd, const wchar_t* cmdstr)
  */
 static void cli_env(command_t* cmd, const wchar_t* cmdstr)
 {
+    wchar_t profile[BUFLEN_PROFILE] = { 0 };
+
+    wchar_t* args[] = {
+        profile
+    };
+
+    size_t lens[] = {
+        BUFLEN_PROFILE
+    };
+
+    int read = cli_parse_cmd(cmd, cmdstr, 1, args, lens);
+
+    const byte_t* err = NULL;
+
+    if (read != -1)
+    {
+        byte_t bs_profile[BUFLEN_PROFILE * sizeof(wchar_t)] = { 0 };
+        wstobs(profile, bs_profile, BUFLEN_PROFILE * sizeof(wchar_t));
+
+        STORAGE_ERR_CODE error = storage_set_profile(bs_profile, &err);
+
+        if (error != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", err);
+            return;
+        }
+    }
+
     printf(CYAN("%-20s") GREEN("%-128s\n"), "App directory", env_app_dir());
     printf(CYAN("%-20s") GREEN("%-128s\n"), "Storage", storage_file());
+
+    STORAGE_ERR_CODE error = storage_print_environment(&err);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+        return;
+    }
 }
 
 /**
@@ -1335,8 +1881,27 @@ static void cli_execute_cmdstr(const wchar_t* cmdstr)
         return;
     }
 
+    // Without write-behind, deferred commands write directly and must not run beside the background purge either.
+    bool direct = !issued->deferred || !storage_write_behind();
+
+    if (direct)
+    {
+        const byte_t* err = NULL;
+        STORAGE_ERR_CODE flushed = storage_flush(&err);
+
+        if (flushed != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", err);
+        }
+    }
+
     issued->func(issued, cmdstr);
 
+    if (direct)
+    {
+        storage_resume_purge();
+    }
+
     int inserted = history_insert(cmdstr);
 
     if (inserted == 0)
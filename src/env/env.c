@@ -28,6 +28,11 @@ SOFTWARE. */
 #include "env.h"
 
 #define APP_DIR_NAME ".toodles"
+#define STORAGE_PROFILE_VAR "TOODLES_STORAGE_PROFILE"
+#define COMPRESSION_VAR "TOODLES_COMPRESSION"
+#define BLOB_THRESHOLD_VAR "TOODLES_BLOB_THRESHOLD"
+#define STORAGE_BACKEND_VAR "TOODLES_STORAGE_BACKEND"
+#define WRITE_BEHIND_VAR "TOODLES_WRITE_BEHIND"
 
 #define ERR_HOME_NOT_FOUND "HOME environment variable not set."
 
@@ -82,4 +87,29 @@ int env_init(const byte_t** err)
 const byte_t* env_app_dir()
 {
     return application_dir;
+}
+
+const byte_t* env_storage_profile()
+{
+    return getenv(STORAGE_PROFILE_VAR);
+}
+
+const byte_t* env_compression()
+{
+    return getenv(COMPRESSION_VAR);
+}
+
+const byte_t* env_blob_threshold()
+{
+    return getenv(BLOB_THRESHOLD_VAR);
+}
+
+const byte_t* env_storage_backend()
+{
+    return getenv(STORAGE_BACKEND_VAR);
+}
+
+const byte_t* env_write_behind()
+{
+    return getenv(WRITE_BEHIND_VAR);
 }
\ No newline at end of file
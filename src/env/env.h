@@ -38,4 +38,40 @@ int env_init(const byte_t** err);
  *
  * @return const byte_t* Application directory.
  */
-const byte_t* env_app_dir();
\ No newline at end of file
+const byte_t* env_app_dir();
+
+/**
+ * @brief Returns the storage profile requested through the TOODLES_STORAGE_PROFILE environment variable.
+ *
+ * @return const byte_t* Name of the storage profile or NULL if the variable is not set.
+ */
+const byte_t* env_storage_profile();
+
+/**
+ * @brief Returns the attachment compression requested through the TOODLES_COMPRESSION environment variable.
+ *
+ * @return const byte_t* Name of the codec (zlib or off) or NULL if the variable is not set.
+ */
+const byte_t* env_compression();
+
+/**
+ * @brief Returns the size from which attachments are kept as files, requested through the TOODLES_BLOB_THRESHOLD
+ * environment variable.
+ *
+ * @return const byte_t* Size in bytes or NULL if the variable is not set.
+ */
+const byte_t* env_blob_threshold();
+
+/**
+ * @brief Returns the storage backend requested through the TOODLES_STORAGE_BACKEND environment variable.
+ *
+ * @return const byte_t* Name of the backend (file or memory) or NULL if the variable is not set.
+ */
+const byte_t* env_storage_backend();
+
+/**
+ * @brief Returns the value of the TOODLES_WRITE_BEHIND environment variable.
+ *
+ * @return const byte_t* 1 if interactive mode should queue writes or NULL if the variable is not set.
+ */
+const byte_t* env_write_behind();
\ No newline at end of file
@@ -0,0 +1,345 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "export.h"
+
+#define BUFLEN_EXPORT_STREAM (1024 * 1024)
+
+static void json_write_string(FILE* f, const byte_t* str)
+{
+    if (str == NULL)
+    {
+        fputs("null", f);
+        return;
+    }
+
+    fputc('"', f);
+
+    for (const ubyte_t* c = (const ubyte_t*)str; *c != 0; c++)
+    {
+        switch (*c)
+        {
+        case '"':
+            fputs("\\\"", f);
+            break;
+        case '\\':
+            fputs("\\\\", f);
+            break;
+        case '\n':
+            fputs("\\n", f);
+            break;
+        case '\r':
+            fputs("\\r", f);
+            break;
+        case '\t':
+            fputs("\\t", f);
+            break;
+        default:
+            if (*c < 0x20)
+            {
+                fprintf(f, "\\u%04x", *c);
+            }
+            else
+            {
+                fputc(*c, f);
+            }
+        }
+    }
+
+    fputc('"', f);
+}
+
+static void csv_write_field(FILE* f, const byte_t* str)
+{
+    if (str == NULL)
+    {
+        return;
+    }
+
+    if (strpbrk(str, ",\"\r\n") == NULL)
+    {
+        fputs(str, f);
+        return;
+    }
+
+    fputc('"', f);
+
+    for (const byte_t* c = str; *c != 0; c++)
+    {
+        if (*c == '"')
+        {
+            fputc('"', f);
+        }
+
+        fputc(*c, f);
+    }
+
+    fputc('"', f);
+}
+
+int export_open(export_writer_t* writer, const byte_t* path, const byte_t* format, bool attachments, const byte_t** err)
+{
+    if (writer == NULL)
+    {
+        return -1;
+    }
+
+    memset(writer, 0, sizeof(export_writer_t));
+
+    writer->attachments = attachments;
+    writer->format = EXPORT_JSONL;
+
+    if (format != NULL)
+    {
+        if (strcasecmp(format, "csv") == 0)
+        {
+            writer->format = EXPORT_CSV;
+        }
+        else if (strcasecmp(format, "jsonl") != 0)
+        {
+            if (err)
+            {
+                *err = "Unknown export format. Use jsonl or csv.";
+            }
+
+            return -1;
+        }
+    }
+    else if (path != NULL)
+    {
+        const byte_t* extension = strrchr(path, '.');
+
+        if (extension != NULL && strcasecmp(extension, ".csv") == 0)
+        {
+            writer->format = EXPORT_CSV;
+        }
+    }
+
+    writer->file = path == NULL ? stdout : fopen(path, "w");
+
+    if (writer->file == NULL)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return -1;
+    }
+
+    setvbuf(writer->file, NULL, _IOFBF, BUFLEN_EXPORT_STREAM);
+
+    if (writer->format == EXPORT_CSV)
+    {
+        fputs("id,title,details,done,created", writer->file);
+        fputs(attachments ? ",attachment_id,attachment_name,attachment_size\n" : "\n", writer->file);
+    }
+
+    return ferror(writer->file) ? -1 : 0;
+}
+
+/**
+ * @brief Closes the JSON object of the previous todo, if there is one.
+ *
+ * @param writer The writer.
+ */
+static void export_close_object(export_writer_t* writer)
+{
+    if (writer->open_id == 0)
+    {
+        return;
+    }
+
+    fputs(writer->attachments ? "]}\n" : "}\n", writer->file);
+
+    writer->open_id = 0;
+    writer->open_attachments = 0;
+}
+
+static void export_row_jsonl(export_writer_t* writer, const export_row_t* row)
+{
+    FILE* f = writer->file;
+
+    if (row->id != writer->open_id)
+    {
+        export_close_object(writer);
+
+        fprintf(f, "{\"id\":%lld,\"title\":", row->id);
+        json_write_string(f, row->title);
+        fputs(",\"details\":", f);
+        json_write_string(f, row->details);
+        fprintf(f, ",\"done\":%s,\"created\":", row->done ? "true" : "false");
+        json_write_string(f, row->created);
+
+        if (writer->attachments)
+        {
+            fputs(",\"attachments\":[", f);
+        }
+
+        writer->open_id = row->id;
+    }
+
+    if (writer->attachments && row->attachment_id != 0)
+    {
+        fprintf(f, "%s{\"id\":%lld,\"name\":", writer->open_attachments == 0 ? "" : ",", row->attachment_id);
+        json_write_string(f, row->attachment_name);
+        fprintf(f, ",\"size\":%lld}", row->attachment_size);
+
+        writer->open_attachments++;
+    }
+}
+
+static void export_row_csv(export_writer_t* writer, const export_row_t* row)
+{
+    FILE* f = writer->file;
+
+    fprintf(f, "%lld,", row->id);
+    csv_write_field(f, row->title);
+    fputc(',', f);
+    csv_write_field(f, row->details);
+    fprintf(f, ",%d,", row->done);
+    csv_write_field(f, row->created);
+
+    if (writer->attachments)
+    {
+        if (row->attachment_id != 0)
+        {
+            fprintf(f, ",%lld,", row->attachment_id);
+            csv_write_field(f, row->attachment_name);
+            fprintf(f, ",%lld", row->attachment_size);
+        }
+        else
+        {
+            fputs(",,,", f);
+        }
+    }
+
+    fputc('\n', f);
+}
+
+int export_row(export_writer_t* writer, const export_row_t* row)
+{
+    if (writer == NULL || writer->file == NULL || row == NULL)
+    {
+        return -1;
+    }
+
+    switch (writer->format)
+    {
+    case EXPORT_JSONL:
+        export_row_jsonl(writer, row);
+        break;
+
+    case EXPORT_CSV:
+        export_row_csv(writer, row);
+        break;
+    }
+
+    return ferror(writer->file) ? -1 : 0;
+}
+
+int export_change(export_writer_t* writer, const export_change_t* change)
+{
+    if (writer == NULL || writer->file == NULL || change == NULL || writer->format != EXPORT_JSONL)
+    {
+        return -1;
+    }
+
+    FILE* f = writer->file;
+
+    fprintf(f, "{\"seq\":%lld,\"time\":", change->seq);
+    json_write_string(f, change->time);
+    fputs(",\"table\":", f);
+    json_write_string(f, change->table);
+    fputs(",\"op\":", f);
+    json_write_string(f, change->op);
+    fprintf(f, ",\"id\":%lld", change->id);
+
+    if (change->todo_id == 0)
+    {
+        fputs(",\"todo\":", f);
+
+        if (change->exists)
+        {
+            fputs("{\"title\":", f);
+            json_write_string(f, change->title);
+            fputs(",\"details\":", f);
+            json_write_string(f, change->details);
+            fprintf(f, ",\"done\":%s,\"created\":", change->done ? "true" : "false");
+            json_write_string(f, change->created);
+            fputc('}', f);
+        }
+        else
+        {
+            fputs("null", f);
+        }
+    }
+    else
+    {
+        fprintf(f, ",\"todo_id\":%lld,\"attachment\":", change->todo_id);
+
+        if (change->exists)
+        {
+            fputs("{\"name\":", f);
+            json_write_string(f, change->name);
+            fprintf(f, ",\"size\":%lld}", change->size);
+        }
+        else
+        {
+            fputs("null", f);
+        }
+    }
+
+    fputs("}\n", f);
+
+    return ferror(f) ? -1 : 0;
+}
+
+int export_close(export_writer_t* writer)
+{
+    if (writer == NULL || writer->file == NULL)
+    {
+        return -1;
+    }
+
+    if (writer->format == EXPORT_JSONL)
+    {
+        export_close_object(writer);
+    }
+
+    int failed = fflush(writer->file) != 0 || ferror(writer->file);
+
+    if (writer->file != stdout)
+    {
+        failed |= fclose(writer->file) != 0;
+    }
+
+    writer->file = NULL;
+
+    return failed ? -1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../types/types.h"
+
+/**
+ * @brief Defines the file formats that can be exported.
+ *
+ */
+typedef enum
+{
+    EXPORT_JSONL,
+    EXPORT_CSV,
+
+} EXPORT_FORMAT;
+
+/**
+ * @brief A todo entry, optionally joined with one of its attachments.
+ *
+ */
+typedef struct
+{
+    long long id;
+    const byte_t* title;
+    const byte_t* details;
+    int done;
+    const byte_t* created;
+
+    /**
+     * @brief Id of the attachment or 0 if the row has no attachment.
+     *
+     */
+    long long attachment_id;
+    const byte_t* attachment_name;
+    long long attachment_size;
+
+} export_row_t;
+
+/**
+ * @brief An event of the change feed. The fields after exists hold the current state of its row.
+ *
+ */
+typedef struct
+{
+    long long seq;
+    const byte_t* time;
+    const byte_t* table;
+    const byte_t* op;
+    long long id;
+
+    /**
+     * @brief Id of the todo of an attachment or 0 for events of todos.
+     *
+     */
+    long long todo_id;
+
+    /**
+     * @brief False if the row was removed since the event.
+     *
+     */
+    bool exists;
+    const byte_t* title;
+    const byte_t* details;
+    int done;
+    const byte_t* created;
+    const byte_t* name;
+    long long size;
+
+} export_change_t;
+
+/**
+ * @brief State for streaming rows into an export file.
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Format of the output.
+     *
+     */
+    EXPORT_FORMAT format;
+
+    /**
+     * @brief The output file.
+     *
+     */
+    FILE* file;
+
+    /**
+     * @brief True if attachment metadata is exported with the todos.
+     *
+     */
+    bool attachments;
+
+    /**
+     * @brief Id of the todo whose JSON object is still open or 0.
+     *
+     */
+    long long open_id;
+
+    /**
+     * @brief Number of attachments written into the open JSON object.
+     *
+     */
+    size_t open_attachments;
+
+} export_writer_t;
+
+/**
+ * @brief Opens the export output.
+ *
+ * @param writer Writer that will be initialized.
+ * @param path Path of the output file or NULL for stdout.
+ * @param format Name of the format (jsonl or csv) or NULL to choose by file extension.
+ * @param attachments True if attachment metadata should be exported.
+ * @param err Pointer to error message.
+ * @return int Success indicator.
+ */
+int export_open(export_writer_t* writer, const byte_t* path, const byte_t* format, bool attachments, const byte_t** err);
+
+/**
+ * @brief Writes a row. Rows of the same todo must follow each other.
+ *
+ * @param writer The writer.
+ * @param row The row.
+ * @return int Success indicator.
+ */
+int export_row(export_writer_t* writer, const export_row_t* row);
+
+/**
+ * @brief Writes an event of the change feed as a JSON line.
+ *
+ * @param writer The writer, opened for jsonl.
+ * @param change The event.
+ * @return int Success indicator.
+ */
+int export_change(export_writer_t* writer, const export_change_t* change);
+
+/**
+ * @brief Finishes the output and closes the file.
+ *
+ * @param writer The writer.
+ * @return int Success indicator.
+ */
+int export_close(export_writer_t* writer);
\ No newline at end of file
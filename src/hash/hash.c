@@ -0,0 +1,51 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#include "hash.h"
+
+bool hash_sha256_init(hash_sha256_t* hash)
+{
+    hash->context = EVP_MD_CTX_new();
+
+    return hash->context != NULL && EVP_DigestInit_ex(hash->context, EVP_sha256(), NULL) == 1;
+}
+
+void hash_sha256_update(hash_sha256_t* hash, const void* data, size_t len)
+{
+    EVP_DigestUpdate(hash->context, data, len);
+}
+
+void hash_sha256_final(hash_sha256_t* hash, ubyte_t digest[HASH_SHA256_SIZE])
+{
+    EVP_DigestFinal_ex(hash->context, digest, NULL);
+}
+
+void hash_sha256_free(hash_sha256_t* hash)
+{
+    EVP_MD_CTX_free(hash->context);
+    hash->context = NULL;
+}
+
+bool hash_sha256(const void* data, size_t len, ubyte_t digest[HASH_SHA256_SIZE])
+{
+    return EVP_Digest(data, len, digest, NULL, EVP_sha256(), NULL) == 1;
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <openssl/evp.h>
+
+#include "../types/types.h"
+
+#define HASH_SHA256_SIZE 32
+
+/**
+ * @brief State of a running SHA-256 computation.
+ *
+ */
+typedef struct
+{
+    EVP_MD_CTX* context;
+
+} hash_sha256_t;
+
+/**
+ * @brief Starts a new SHA-256 computation. Uses the SHA extensions of the CPU where available.
+ *
+ * @param hash The hash state.
+ * @return bool True on success.
+ */
+bool hash_sha256_init(hash_sha256_t* hash);
+
+/**
+ * @brief Adds data to the SHA-256 computation.
+ *
+ * @param hash The hash state.
+ * @param data The data to add.
+ * @param len Number of bytes.
+ */
+void hash_sha256_update(hash_sha256_t* hash, const void* data, size_t len);
+
+/**
+ * @brief Finishes the SHA-256 computation.
+ *
+ * @param hash The hash state.
+ * @param digest Receives HASH_SHA256_SIZE bytes.
+ */
+void hash_sha256_final(hash_sha256_t* hash, ubyte_t digest[HASH_SHA256_SIZE]);
+
+/**
+ * @brief Releases the hash state. Safe to call on a state that failed to initialize.
+ *
+ * @param hash The hash state.
+ */
+void hash_sha256_free(hash_sha256_t* hash);
+
+/**
+ * @brief Computes the SHA-256 of a buffer in one go.
+ *
+ * @param data The data to hash.
+ * @param len Number of bytes.
+ * @param digest Receives HASH_SHA256_SIZE bytes.
+ * @return bool True on success.
+ */
+bool hash_sha256(const void* data, size_t len, ubyte_t digest[HASH_SHA256_SIZE]);
\ No newline at end of file
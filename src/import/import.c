@@ -0,0 +1,966 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "import.h"
+
+#define CSV_MAX_COLUMNS 64
+
+#define COLUMN_TITLE 0
+#define COLUMN_DETAILS 1
+#define COLUMN_DONE 2
+#define COLUMN_CREATED 3
+
+/**
+ * @brief Defines an assignment of file extension to format.
+ *
+ */
+typedef struct
+{
+    const byte_t* extension;
+    IMPORT_FORMAT format;
+
+} import_extension_t;
+
+static const import_extension_t EXTENSIONS[] = {
+
+    {
+        .extension = ".jsonl",
+        .format = IMPORT_JSONL
+    },
+    {
+        .extension = ".ndjson",
+        .format = IMPORT_JSONL
+    },
+    {
+        .extension = ".json",
+        .format = IMPORT_JSONL
+    },
+    {
+        .extension = ".csv",
+        .format = IMPORT_CSV
+    }
+};
+
+/**
+ * @brief Field names that are recognized in JSONL objects and CSV headers, in column order.
+ *
+ */
+static const byte_t* FIELDS[] = {
+    "title",
+    "details",
+    "done",
+    "created",
+};
+
+IMPORT_FORMAT import_format_from_path(const byte_t* path)
+{
+    const byte_t* extension = path == NULL ? NULL : strrchr(path, '.');
+
+    if (extension == NULL)
+    {
+        return IMPORT_TODO_TXT;
+    }
+
+    size_t len = sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (strcasecmp(extension, EXTENSIONS[i].extension) == 0)
+        {
+            return EXTENSIONS[i].format;
+        }
+    }
+
+    return IMPORT_TODO_TXT;
+}
+
+/**
+ * @brief Formats an error message for the current line and hands it out through err.
+ *
+ * @param reader The reader.
+ * @param message Description of the error.
+ * @param err Pointer to error message.
+ * @return IMPORT_RESULT Always IMPORT_ERROR.
+ */
+static IMPORT_RESULT import_fail(import_reader_t* reader, const byte_t* message, const byte_t** err)
+{
+    snprintf(reader->message, BUFLEN_IMPORT_MESSAGE, "Line %zu: %s", reader->line_number, message);
+
+    if (err)
+    {
+        *err = reader->message;
+    }
+
+    return IMPORT_ERROR;
+}
+
+int import_open(import_reader_t* reader, const byte_t* path, const byte_t** err)
+{
+    if (reader == NULL)
+    {
+        return -1;
+    }
+
+    memset(reader, 0, sizeof(import_reader_t));
+
+    if (path == NULL || path[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide a file to import.";
+        }
+
+        return -1;
+    }
+
+    reader->file = fopen(path, "r");
+
+    if (reader->file == NULL)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return -1;
+    }
+
+    reader->format = import_format_from_path(path);
+
+    for (size_t i = 0; i < sizeof(reader->columns) / sizeof(reader->columns[0]); i++)
+    {
+        reader->columns[i] = -1;
+    }
+
+    return 0;
+}
+
+void import_close(import_reader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+
+    if (reader->file != NULL)
+    {
+        fclose(reader->file);
+    }
+
+    free(reader->line);
+    free(reader->record);
+
+    reader->file = NULL;
+    reader->line = NULL;
+    reader->record = NULL;
+}
+
+/**
+ * @brief Reads the next line into the line buffer and strips the line terminator.
+ *
+ * @param reader The reader.
+ * @return ssize_t Length of the line or -1 at the end of the file.
+ */
+static ssize_t import_read_line(import_reader_t* reader)
+{
+    ssize_t len = getline(&reader->line, &reader->line_cap, reader->file);
+
+    if (len == -1)
+    {
+        return -1;
+    }
+
+    reader->line_number++;
+
+    while (len > 0 && (reader->line[len - 1] == '\n' || reader->line[len - 1] == '\r'))
+    {
+        reader->line[--len] = 0;
+    }
+
+    if (reader->line_number == 1 && strncmp(reader->line, "\xEF\xBB\xBF", 3) == 0)
+    {
+        memmove(reader->line, reader->line + 3, len - 2);
+        len -= 3;
+    }
+
+    return len;
+}
+
+/**
+ * @brief Interprets the value of a done field.
+ *
+ * @param value The value.
+ * @param done Receives 0 or 1.
+ * @return true The value is a valid done flag.
+ * @return false The value is not a valid done flag.
+ */
+static bool import_parse_done(const byte_t* value, int* done)
+{
+    const byte_t* done_values[] = { "1", "true", "yes", "x", "done" };
+    const byte_t* open_values[] = { "", "0", "false", "no", "open" };
+
+    for (size_t i = 0; i < sizeof(done_values) / sizeof(done_values[0]); i++)
+    {
+        if (strcasecmp(value, done_values[i]) == 0)
+        {
+            *done = 1;
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(open_values) / sizeof(open_values[0]); i++)
+    {
+        if (strcasecmp(value, open_values[i]) == 0)
+        {
+            *done = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Returns the index of the given field name in FIELDS or -1.
+ *
+ * @param name Field name.
+ * @return int Index of the field.
+ */
+static int import_field_index(const byte_t* name)
+{
+    for (size_t i = 0; i < sizeof(FIELDS) / sizeof(FIELDS[0]); i++)
+    {
+        if (strcasecmp(name, FIELDS[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Stores the value of a field in the todo.
+ *
+ * @param todo The todo entry.
+ * @param field Index of the field in FIELDS.
+ * @param value The value.
+ * @return true The value was accepted.
+ * @return false The value is not valid for the field.
+ */
+static bool import_set_field(import_todo_t* todo, int field, const byte_t* value)
+{
+    switch (field)
+    {
+    case COLUMN_TITLE:
+        todo->title = value;
+        return true;
+
+    case COLUMN_DETAILS:
+        todo->details = value;
+        return true;
+
+    case COLUMN_DONE:
+        return import_parse_done(value, &todo->done);
+
+    case COLUMN_CREATED:
+        todo->created = value[0] == 0 ? NULL : value;
+        return true;
+
+    default:
+        return true;
+    }
+}
+
+static void json_skip_ws(byte_t** pos)
+{
+    while (**pos == ' ' || **pos == '\t')
+    {
+        (*pos)++;
+    }
+}
+
+static int json_hex4(const byte_t* pos)
+{
+    int value = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        byte_t c = pos[i];
+        value <<= 4;
+
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+
+    return value;
+}
+
+static byte_t* json_put_utf8(byte_t* out, unsigned int cp)
+{
+    if (cp < 0x80)
+    {
+        *out++ = cp;
+    }
+    else if (cp < 0x800)
+    {
+        *out++ = 0xC0 | (cp >> 6);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+    else if (cp < 0x10000)
+    {
+        *out++ = 0xE0 | (cp >> 12);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+    else
+    {
+        *out++ = 0xF0 | (cp >> 18);
+        *out++ = 0x80 | ((cp >> 12) & 0x3F);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+
+    return out;
+}
+
+/**
+ * @brief Decodes the JSON string at pos in place. The decoded string is never longer than the encoded one.
+ *
+ * @param pos Points to the opening quote and is moved behind the closing quote.
+ * @param value Receives the decoded string.
+ * @return const byte_t* NULL on success, otherwise a description of the error.
+ */
+static const byte_t* json_string(byte_t** pos, byte_t** value)
+{
+    byte_t* r = *pos + 1;
+    byte_t* w = r;
+
+    *value = w;
+
+    while (*r != '"')
+    {
+        if (*r == 0)
+        {
+            return "Unterminated string.";
+        }
+
+        if (*r != '\\')
+        {
+            *w++ = *r++;
+            continue;
+        }
+
+        r++;
+
+        switch (*r)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            *w++ = *r++;
+            break;
+        case 'b':
+            *w++ = '\b';
+            r++;
+            break;
+        case 'f':
+            *w++ = '\f';
+            r++;
+            break;
+        case 'n':
+            *w++ = '\n';
+            r++;
+            break;
+        case 'r':
+            *w++ = '\r';
+            r++;
+            break;
+        case 't':
+            *w++ = '\t';
+            r++;
+            break;
+        case 'u':
+        {
+            int cp = json_hex4(r + 1);
+
+            if (cp <= 0)
+            {
+                return "Invalid unicode escape.";
+            }
+
+            r += 5;
+
+            if (cp >= 0xD800 && cp <= 0xDBFF)
+            {
+                int low = (r[0] == '\\' && r[1] == 'u') ? json_hex4(r + 2) : -1;
+
+                if (low < 0xDC00 || low > 0xDFFF)
+                {
+                    return "Invalid surrogate pair.";
+                }
+
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                r += 6;
+            }
+
+            w = json_put_utf8(w, cp);
+            break;
+        }
+        default:
+            return "Invalid escape sequence.";
+        }
+    }
+
+    *pos = r + 1;
+    *w = 0;
+
+    return NULL;
+}
+
+/**
+ * @brief Parses a flat JSON object with string, number, boolean and null values.
+ *
+ * @param line The line, which is modified in place.
+ * @param todo Receives the known fields.
+ * @return const byte_t* NULL on success, otherwise a description of the error.
+ */
+static const byte_t* json_object(byte_t* line, import_todo_t* todo)
+{
+    byte_t* pos = line;
+
+    json_skip_ws(&pos);
+
+    if (*pos != '{')
+    {
+        return "Expected a JSON object.";
+    }
+
+    pos++;
+    json_skip_ws(&pos);
+
+    if (*pos == '}')
+    {
+        return NULL;
+    }
+
+    while (1)
+    {
+        json_skip_ws(&pos);
+
+        if (*pos != '"')
+        {
+            return "Expected a key.";
+        }
+
+        byte_t* key = NULL;
+        const byte_t* failed = json_string(&pos, &key);
+
+        if (failed)
+        {
+            return failed;
+        }
+
+        json_skip_ws(&pos);
+
+        if (*pos != ':')
+        {
+            return "Expected ':'.";
+        }
+
+        pos++;
+        json_skip_ws(&pos);
+
+        int field = import_field_index(key);
+
+        if (*pos == '"')
+        {
+            byte_t* value = NULL;
+            failed = json_string(&pos, &value);
+
+            if (failed)
+            {
+                return failed;
+            }
+
+            if (!import_set_field(todo, field, value))
+            {
+                return "Invalid value for done.";
+            }
+        }
+        else if (strncmp(pos, "true", 4) == 0)
+        {
+            if (field != -1 && field != COLUMN_DONE)
+            {
+                return "Expected a string.";
+            }
+
+            todo->done = field == COLUMN_DONE ? 1 : todo->done;
+            pos += 4;
+        }
+        else if (strncmp(pos, "false", 5) == 0)
+        {
+            if (field != -1 && field != COLUMN_DONE)
+            {
+                return "Expected a string.";
+            }
+
+            todo->done = field == COLUMN_DONE ? 0 : todo->done;
+            pos += 5;
+        }
+        else if (strncmp(pos, "null", 4) == 0)
+        {
+            pos += 4;
+        }
+        else if (*pos == '-' || isdigit((ubyte_t)*pos))
+        {
+            byte_t* end = NULL;
+            double number = strtod(pos, &end);
+
+            if (field != -1 && field != COLUMN_DONE)
+            {
+                return "Expected a string.";
+            }
+
+            if (field == COLUMN_DONE)
+            {
+                if (number != 0 && number != 1)
+                {
+                    return "Invalid value for done.";
+                }
+
+                todo->done = number == 1;
+            }
+
+            pos = end;
+        }
+        else
+        {
+            return "Nested or invalid values are not supported.";
+        }
+
+        json_skip_ws(&pos);
+
+        if (*pos == ',')
+        {
+            pos++;
+            continue;
+        }
+
+        if (*pos == '}')
+        {
+            break;
+        }
+
+        return "Expected ',' or '}'.";
+    }
+
+    pos++;
+    json_skip_ws(&pos);
+
+    if (*pos != 0)
+    {
+        return "Unexpected data after the object.";
+    }
+
+    return NULL;
+}
+
+static IMPORT_RESULT import_next_jsonl(import_reader_t* reader, import_todo_t* todo, const byte_t** err)
+{
+    ssize_t len;
+
+    while ((len = import_read_line(reader)) != -1)
+    {
+        if (len == 0)
+        {
+            continue;
+        }
+
+        const byte_t* failed = json_object(reader->line, todo);
+
+        if (failed)
+        {
+            return import_fail(reader, failed, err);
+        }
+
+        return IMPORT_RECORD;
+    }
+
+    return IMPORT_END;
+}
+
+/**
+ * @brief Appends the current line to the record buffer.
+ *
+ * @param reader The reader.
+ * @param len Length of the current line.
+ * @param offset Position in the record buffer to append to.
+ * @return bool Success indicator.
+ */
+static bool import_append_record(import_reader_t* reader, size_t len, size_t offset)
+{
+    size_t needed = offset + len + 2;
+
+    if (needed > reader->record_cap)
+    {
+        size_t cap = reader->record_cap == 0 ? 256 : reader->record_cap;
+
+        while (cap < needed)
+        {
+            cap *= 2;
+        }
+
+        byte_t* record = realloc(reader->record, cap);
+
+        if (record == NULL)
+        {
+            return false;
+        }
+
+        reader->record = record;
+        reader->record_cap = cap;
+    }
+
+    memcpy(reader->record + offset, reader->line, len + 1);
+
+    return true;
+}
+
+/**
+ * @brief Reads the next CSV record into the record buffer. Quoted fields may span multiple lines.
+ *
+ * @param reader The reader.
+ * @param err Pointer to error message.
+ * @return IMPORT_RESULT Read result.
+ */
+static IMPORT_RESULT csv_read_record(import_reader_t* reader, const byte_t** err)
+{
+    ssize_t len;
+
+    do
+    {
+        len = import_read_line(reader);
+
+        if (len == -1)
+        {
+            return IMPORT_END;
+        }
+    } while (len == 0);
+
+    size_t used = 0;
+    bool quoted = false;
+
+    while (1)
+    {
+        if (!import_append_record(reader, len, used))
+        {
+            return import_fail(reader, "Out of memory.", err);
+        }
+
+        for (ssize_t i = 0; i < len; i++)
+        {
+            if (reader->line[i] == '"')
+            {
+                quoted = !quoted;
+            }
+        }
+
+        used += len;
+
+        if (!quoted)
+        {
+            return IMPORT_RECORD;
+        }
+
+        len = import_read_line(reader);
+
+        if (len == -1)
+        {
+            return import_fail(reader, "Unterminated quoted field.", err);
+        }
+
+        reader->record[used++] = '\n';
+    }
+}
+
+/**
+ * @brief Splits the record buffer into fields in place.
+ *
+ * @param record The record.
+ * @param fields Receives the fields.
+ * @param count Receives the number of fields.
+ * @return const byte_t* NULL on success, otherwise a description of the error.
+ */
+static const byte_t* csv_split(byte_t* record, byte_t** fields, int* count)
+{
+    byte_t* r = record;
+    *count = 0;
+
+    while (1)
+    {
+        if (*count == CSV_MAX_COLUMNS)
+        {
+            return "Too many columns.";
+        }
+
+        byte_t* w = r;
+        fields[(*count)++] = w;
+
+        if (*r == '"')
+        {
+            r++;
+
+            while (1)
+            {
+                if (*r == '"' && r[1] == '"')
+                {
+                    *w++ = '"';
+                    r += 2;
+                }
+                else if (*r == '"')
+                {
+                    r++;
+                    break;
+                }
+                else
+                {
+                    *w++ = *r++;
+                }
+            }
+
+            if (*r != ',' && *r != 0)
+            {
+                return "Unexpected data after a quoted field.";
+            }
+        }
+        else
+        {
+            while (*r != ',' && *r != 0)
+            {
+                *w++ = *r++;
+            }
+        }
+
+        byte_t separator = *r;
+        *w = 0;
+
+        if (separator == 0)
+        {
+            return NULL;
+        }
+
+        r++;
+    }
+}
+
+static IMPORT_RESULT import_next_csv(import_reader_t* reader, import_todo_t* todo, const byte_t** err)
+{
+    byte_t* fields[CSV_MAX_COLUMNS];
+    int count = 0;
+
+    IMPORT_RESULT read = csv_read_record(reader, err);
+
+    if (read != IMPORT_RECORD)
+    {
+        return read;
+    }
+
+    const byte_t* failed = csv_split(reader->record, fields, &count);
+
+    if (failed)
+    {
+        return import_fail(reader, failed, err);
+    }
+
+    if (reader->columns[COLUMN_TITLE] == -1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int field = import_field_index(fields[i]);
+
+            if (field != -1)
+            {
+                reader->columns[field] = i;
+            }
+        }
+
+        if (reader->columns[COLUMN_TITLE] == -1)
+        {
+            return import_fail(reader, "The CSV header needs a title column.", err);
+        }
+
+        return import_next_csv(reader, todo, err);
+    }
+
+    for (int field = 0; field < (int)(sizeof(reader->columns) / sizeof(reader->columns[0])); field++)
+    {
+        int column = reader->columns[field];
+
+        if (column == -1 || column >= count)
+        {
+            continue;
+        }
+
+        if (!import_set_field(todo, field, fields[column]))
+        {
+            return import_fail(reader, "Invalid value for done.", err);
+        }
+    }
+
+    return IMPORT_RECORD;
+}
+
+/**
+ * @brief Checks if pos starts with a todo.txt date (YYYY-MM-DD) followed by a space.
+ *
+ * @param pos Position in the line.
+ * @return true A date was found.
+ * @return false No date was found.
+ */
+static bool todo_txt_date(const byte_t* pos)
+{
+    const byte_t* pattern = "dddd-dd-dd ";
+
+    for (size_t i = 0; pattern[i] != 0; i++)
+    {
+        if (pattern[i] == 'd' ? !isdigit((ubyte_t)pos[i]) : pos[i] != pattern[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static IMPORT_RESULT import_next_todo_txt(import_reader_t* reader, import_todo_t* todo, const byte_t** err)
+{
+    ssize_t len;
+
+    while ((len = import_read_line(reader)) != -1)
+    {
+        byte_t* pos = reader->line;
+
+        while (*pos == ' ' || *pos == '\t')
+        {
+            pos++;
+        }
+
+        if (*pos == 0)
+        {
+            continue;
+        }
+
+        if (strncmp(pos, "x ", 2) == 0)
+        {
+            todo->done = 1;
+            pos += 2;
+
+            if (todo_txt_date(pos))
+            {
+                pos += 11;
+            }
+        }
+
+        byte_t* priority = NULL;
+
+        if (pos[0] == '(' && pos[1] >= 'A' && pos[1] <= 'Z' && pos[2] == ')' && pos[3] == ' ')
+        {
+            priority = pos;
+            pos += 4;
+        }
+
+        if (todo_txt_date(pos))
+        {
+            memcpy(reader->created, pos, 10);
+            reader->created[10] = 0;
+            todo->created = reader->created;
+            pos += 11;
+        }
+
+        if (priority != NULL && priority + 4 != pos)
+        {
+            pos -= 4;
+            memmove(pos, priority, 4);
+        }
+
+        todo->title = pos;
+
+        return IMPORT_RECORD;
+    }
+
+    return IMPORT_END;
+}
+
+IMPORT_RESULT import_next(import_reader_t* reader, import_todo_t* todo, const byte_t** err)
+{
+    if (reader == NULL || reader->file == NULL || todo == NULL)
+    {
+        return IMPORT_END;
+    }
+
+    memset(todo, 0, sizeof(import_todo_t));
+
+    IMPORT_RESULT result = IMPORT_END;
+
+    switch (reader->format)
+    {
+    case IMPORT_JSONL:
+        result = import_next_jsonl(reader, todo, err);
+        break;
+
+    case IMPORT_CSV:
+        result = import_next_csv(reader, todo, err);
+        break;
+
+    case IMPORT_TODO_TXT:
+        result = import_next_todo_txt(reader, todo, err);
+        break;
+    }
+
+    if (result == IMPORT_RECORD && (todo->title == NULL || todo->title[0] == 0))
+    {
+        return import_fail(reader, "Missing title.", err);
+    }
+
+    if (result == IMPORT_END && ferror(reader->file))
+    {
+        return import_fail(reader, strerror(errno), err);
+    }
+
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,171 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../types/types.h"
+
+#define BUFLEN_IMPORT_MESSAGE 256
+
+/**
+ * @brief Defines the file formats that can be imported.
+ *
+ */
+typedef enum
+{
+    IMPORT_JSONL,
+    IMPORT_CSV,
+    IMPORT_TODO_TXT,
+
+} IMPORT_FORMAT;
+
+/**
+ * @brief Defines the results of reading the next record.
+ *
+ */
+typedef enum
+{
+    IMPORT_RECORD,
+    IMPORT_END,
+    IMPORT_ERROR,
+
+} IMPORT_RESULT;
+
+/**
+ * @brief A todo entry read from an import file. The strings point into the reader's buffers and stay valid
+ * until the next call to import_next.
+ *
+ */
+typedef struct
+{
+    const byte_t* title;
+    const byte_t* details;
+    int done;
+    const byte_t* created;
+
+} import_todo_t;
+
+/**
+ * @brief State for streaming through an import file.
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Format of the file.
+     *
+     */
+    IMPORT_FORMAT format;
+
+    /**
+     * @brief The opened file.
+     *
+     */
+    FILE* file;
+
+    /**
+     * @brief Line buffer that is reused for every line of the file.
+     *
+     */
+    byte_t* line;
+
+    /**
+     * @brief Capacity of the line buffer.
+     *
+     */
+    size_t line_cap;
+
+    /**
+     * @brief Buffer for CSV records that span multiple lines.
+     *
+     */
+    byte_t* record;
+
+    /**
+     * @brief Capacity of the record buffer.
+     *
+     */
+    size_t record_cap;
+
+    /**
+     * @brief Number of the last line that was read.
+     *
+     */
+    size_t line_number;
+
+    /**
+     * @brief CSV column index of title, details, done and created or -1 if the column is missing.
+     *
+     */
+    int columns[4];
+
+    /**
+     * @brief Creation date of the last todo.txt entry.
+     *
+     */
+    byte_t created[11];
+
+    /**
+     * @brief Buffer for error messages.
+     *
+     */
+    byte_t message[BUFLEN_IMPORT_MESSAGE];
+
+} import_reader_t;
+
+/**
+ * @brief Guesses the import format from the file extension. Files that are neither .jsonl, .json, .ndjson nor .csv are read as todo.txt.
+ *
+ * @param path Path of the file.
+ * @return IMPORT_FORMAT The format.
+ */
+IMPORT_FORMAT import_format_from_path(const byte_t* path);
+
+/**
+ * @brief Opens the given file for importing.
+ *
+ * @param reader Reader that will be initialized.
+ * @param path Path of the file.
+ * @param err Pointer to error message.
+ * @return int Success indicator.
+ */
+int import_open(import_reader_t* reader, const byte_t* path, const byte_t** err);
+
+/**
+ * @brief Reads the next todo entry from the file.
+ *
+ * @param reader The reader.
+ * @param todo Receives the todo entry.
+ * @param err Pointer to error message.
+ * @return IMPORT_RESULT IMPORT_RECORD if a todo was read, IMPORT_END at the end of the file or IMPORT_ERROR.
+ */
+IMPORT_RESULT import_next(import_reader_t* reader, import_todo_t* todo, const byte_t** err);
+
+/**
+ * @brief Closes the file and frees the buffers of the reader.
+ *
+ * @param reader The reader.
+ */
+void import_close(import_reader_t* reader);
\ No newline at end of file
@@ -23,6 +23,7 @@ SOFTWARE. */
 #include <stdlib.h>
 #include <stdio.h>
 #include <locale.h>
+#include <string.h>
 
 #include "types/types.h"
 #include "greeter/greeter.h"
@@ -37,6 +38,17 @@ static void print_byebye()
     printf(CYAN("Byyyeee!\n"));
 }
 
+static void close_storage()
+{
+    const byte_t* err = NULL;
+    STORAGE_ERR_CODE error = storage_shutdown(&err);
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+    }
+}
+
 /**
  * @brief Main routine.
  *
@@ -75,10 +87,27 @@ int main(int argc, byte_t** argv)
         return EXIT_FAILURE;
     }
 
+    if (error == STORAGE_ERROR)
+    {
+        printf(RED("ERR: ") "%s\n", err);
+    }
+
+    atexit(close_storage);
+
     if (argc == 1)
     {
         atexit(print_byebye);
         greeter_hello();
+
+        const byte_t* write_behind = env_write_behind();
+
+        bool queued = write_behind != NULL && strcmp(write_behind, "1") == 0;
+
+        if ((queued ? storage_start_writer(&err) : storage_start_purger(&err)) != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", err);
+        }
+
         cli_prompt();
     }
     else
@@ -23,6 +23,7 @@ SOFTWARE. */
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 #include "args.h"
 
@@ -36,6 +37,16 @@ void args_init(args_t* args)
     args->show_help = false;
     args->command = NONE;
     args->title = NULL;
+    args->id = NULL;
+    args->file = NULL;
+    args->format = NULL;
+    args->option = NULL;
+    args->limit = -1;
+    args->after = 0;
+    args->since = 0;
+    args->older_than = -1;
+    args->all = false;
+    args->attachments = false;
 }
 
 void args_free(args_t* args)
@@ -49,6 +60,26 @@ void args_free(args_t* args)
     {
         free((byte_t*)args->title);
     }
+
+    if (args->id != NULL)
+    {
+        free((byte_t*)args->id);
+    }
+
+    if (args->file != NULL)
+    {
+        free((byte_t*)args->file);
+    }
+
+    if (args->format != NULL)
+    {
+        free((byte_t*)args->format);
+    }
+
+    if (args->option != NULL)
+    {
+        free((byte_t*)args->option);
+    }
 }
 
 static ARGS_COMMANDS parse_command_val(const byte_t* cmd)
@@ -68,9 +99,114 @@ static ARGS_COMMANDS parse_command_val(const byte_t* cmd)
         return ERASE;
     }
 
+    if (strcmp(cmd, "import") == 0)
+    {
+        return IMPORT;
+    }
+
+    if (strcmp(cmd, "export") == 0)
+    {
+        return EXPORT;
+    }
+
+    if (strcmp(cmd, "list") == 0)
+    {
+        return LIST;
+    }
+
+    if (strcmp(cmd, "attach") == 0)
+    {
+        return ATTACH;
+    }
+
+    if (strcmp(cmd, "done") == 0)
+    {
+        return DONE_TODO;
+    }
+
+    if (strcmp(cmd, "open") == 0)
+    {
+        return OPEN_TODO;
+    }
+
+    if (strcmp(cmd, "remove") == 0)
+    {
+        return REMOVE_TODO;
+    }
+
+    if (strcmp(cmd, "detail") == 0)
+    {
+        return DETAIL;
+    }
+
+    if (strcmp(cmd, "sweep") == 0)
+    {
+        return SWEEP;
+    }
+
+    if (strcmp(cmd, "compact") == 0)
+    {
+        return COMPACT;
+    }
+
+    if (strcmp(cmd, "backup") == 0)
+    {
+        return BACKUP;
+    }
+
+    if (strcmp(cmd, "restore") == 0)
+    {
+        return RESTORE;
+    }
+
+    if (strcmp(cmd, "changes") == 0)
+    {
+        return CHANGES;
+    }
+
+    if (strcmp(cmd, "archive") == 0)
+    {
+        return ARCHIVE;
+    }
+
     return NONE;
 }
 
+/**
+ * @brief Reads the action of the sync command and the change file, which may follow it instead of -f.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments, with all non-options moved to the end by getopt.
+ * @param args Parsed arguments.
+ * @param err Pointer to error message.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int parse_sync_action(int argc, byte_t** argv, args_t* args, const byte_t** err)
+{
+    const byte_t* action = optind < argc ? argv[optind] : "";
+
+    if (strcmp(action, "export-changes") == 0)
+    {
+        args->command = SYNC_EXPORT;
+    }
+    else if (strcmp(action, "apply") == 0)
+    {
+        args->command = SYNC_APPLY;
+    }
+    else
+    {
+        *err = "Please use sync export-changes or sync apply.";
+        return -1;
+    }
+
+    if (args->file == NULL && optind + 1 < argc)
+    {
+        args->file = strdup(argv[optind + 1]);
+    }
+
+    return 0;
+}
+
 int args_parse(int argc, byte_t** argv, args_t* args, const byte_t** err)
 {
     if (argc == 1)
@@ -78,21 +214,109 @@ int args_parse(int argc, byte_t** argv, args_t* args, const byte_t** err)
         return -1;
     }
 
-    const byte_t* opts = "c:t:h";
+    const byte_t* opts = "c:t:i:f:F:o:ah";
+
+    const struct option long_opts[] = {
+        { "limit", required_argument, NULL, 'l' },
+        { "after", required_argument, NULL, 'A' },
+        { "since", required_argument, NULL, 'S' },
+        { "older-than", required_argument, NULL, 'O' },
+        { "all", no_argument, NULL, 'L' },
+        { 0 }
+    };
+
+    byte_t* end = NULL;
 
-    byte_t c;
-    while ((c = getopt(argc, argv, opts)) != -1)
+    bool sync = false;
+
+    int c;
+    while ((c = getopt_long(argc, argv, opts, long_opts, NULL)) != -1)
     {
         switch (c)
         {
         case 'c':
             args->command = parse_command_val(optarg);
+            sync = strcmp(optarg, "sync") == 0;
             break;
 
         case 't':
             args->title = strdup(optarg);
             break;
 
+        case 'i':
+            args->id = strdup(optarg);
+            break;
+
+        case 'f':
+            args->file = strdup(optarg);
+            break;
+
+        case 'F':
+            args->format = strdup(optarg);
+            break;
+
+        case 'o':
+            args->option = strdup(optarg);
+            break;
+
+        case 'l':
+        {
+            long limit = strtol(optarg, &end, 10);
+
+            if (*end != 0 || limit <= 0 || limit > INT_MAX)
+            {
+                *err = "Please provide a limit bigger than 0.";
+                return -1;
+            }
+
+            args->limit = (int)limit;
+            break;
+        }
+
+        case 'A':
+            args->after = strtoll(optarg, &end, 10);
+
+            if (*end != 0 || args->after < 0)
+            {
+                *err = "Please provide a valid id for --after.";
+                return -1;
+            }
+
+            break;
+
+        case 'S':
+            args->since = strtoll(optarg, &end, 10);
+
+            if (*end != 0 || args->since < 0)
+            {
+                *err = "Please provide a valid sequence number for --since.";
+                return -1;
+            }
+
+            break;
+
+        case 'O':
+        {
+            long days = strtol(optarg, &end, 10);
+
+            if (*end != 0 || days < 0 || days > INT_MAX)
+            {
+                *err = "Please provide a valid number of days for --older-than.";
+                return -1;
+            }
+
+            args->older_than = (int)days;
+            break;
+        }
+
+        case 'L':
+            args->all = true;
+            break;
+
+        case 'a':
+            args->attachments = true;
+            break;
+
         case 'h':
             args->show_help = true;
             break;
@@ -102,5 +326,10 @@ int args_parse(int argc, byte_t** argv, args_t* args, const byte_t** err)
         }
     }
 
+    if (sync)
+    {
+        return parse_sync_action(argc, argv, args, err);
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -36,6 +36,22 @@ typedef enum
     NONE,
     ADD_TODO,
     ERASE,
+    IMPORT,
+    EXPORT,
+    LIST,
+    ATTACH,
+    DONE_TODO,
+    OPEN_TODO,
+    REMOVE_TODO,
+    DETAIL,
+    SWEEP,
+    COMPACT,
+    BACKUP,
+    RESTORE,
+    SYNC_EXPORT,
+    SYNC_APPLY,
+    CHANGES,
+    ARCHIVE,
 
 } ARGS_COMMANDS;
 
@@ -57,6 +73,66 @@ typedef struct
      */
     const byte_t* title;
 
+    /**
+     * @brief Id of a todo entry or a list of ids and ranges.
+     *
+     */
+    const byte_t* id;
+
+    /**
+     * @brief Path of a file used by the command.
+     *
+     */
+    const byte_t* file;
+
+    /**
+     * @brief Name of a file format.
+     *
+     */
+    const byte_t* format;
+
+    /**
+     * @brief List option (all, open or done).
+     *
+     */
+    const byte_t* option;
+
+    /**
+     * @brief Maximum number of entries to list or -1 for no limit.
+     *
+     */
+    int limit;
+
+    /**
+     * @brief Id after which listing starts.
+     *
+     */
+    long long after;
+
+    /**
+     * @brief Sequence number of the last change feed event already seen.
+     *
+     */
+    long long since;
+
+    /**
+     * @brief Minimum age in days of the done entries to archive or -1 if not given.
+     *
+     */
+    int older_than;
+
+    /**
+     * @brief Identifier for including archived entries.
+     *
+     */
+    bool all;
+
+    /**
+     * @brief Identifier for including attachments.
+     *
+     */
+    bool attachments;
+
     /**
      * @brief Identifier for showing non-interactive help.
      *
@@ -30,15 +30,41 @@ void help_print()
 {
     printf("Following arguments can be given to toodles for non-interactive mode:\n");
     printf("\n");
-    printf(MAGENTA("%-10s%-30s%-30s\n"), "Argument", "Synopsis", "Function");
+    printf(MAGENTA("%-14s%-26s%-30s\n"), "Argument", "Synopsis", "Function");
     printf("\n");
-    printf("%-10s"CYAN("%-30s")"%-30s\n", "-h", "", "Prints out help text for non-interactive mode.");
-    printf("%-10s"CYAN("%-30s")"%-30s\n", "-c", "[COMMAND]", "Specifies the command to execute.");
-    printf("%-10s"CYAN("%-30s")"%-30s\n", "-t", "[TITLE]", "Title for a todo entry.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-h", "", "Prints out help text for non-interactive mode.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-c", "[COMMAND]", "Specifies the command to execute.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-t", "[TITLE]", "Title for a todo entry.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-i", "[ID]", "Id of a todo entry or ids and ranges like 4,7,10-250.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-f", "[FILE]", "File used by the command.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-F", "[FORMAT]", "Export format (jsonl, csv). Chosen by file extension if omitted.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-a", "", "Include attachment metadata in the export.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "-o", "[LIST OPTION]", "Entries to list (all, open, done).");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "--limit", "[LIMIT]", "Maximum number of entries to list.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "--after", "[ID]", "Lists entries after the given id, as printed for the next page.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "--since", "[SEQ]", "Prints change feed events after the given sequence number.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "--all", "", "Lists archived entries too.");
+    printf("%-14s"CYAN("%-26s")"%-30s\n", "--older-than", "[DAYS]", "Minimum age in days of the done entries to archive.");
     printf("\n");
     printf(MAGENTA("COMMANDS")"\n");
     printf("\n");
     printf("%-10s%-30s\n", "add", "Adds a new todo entry.");
     printf("%-10s%-30s\n", "erase", "Erase all data that is stored in the toodles database.");
+    printf("%-10s%-30s\n", "import", "Imports todo entries from a .jsonl, .csv or todo.txt file given with -f.");
+    printf("%-10s%-30s\n", "export", "Exports todo entries to the file given with -f or to stdout.");
+    printf("%-10s%-30s\n", "attach", "Attaches the file given with -f to the todo entry given with -i.");
+    printf("%-10s%-30s\n", "list", "Lists todo entries, one page at a time if --limit is given.");
+    printf("%-10s%-30s\n", "done", "Marks the todo entries given with -i as done.");
+    printf("%-10s%-30s\n", "open", "Marks the todo entries given with -i as open.");
+    printf("%-10s%-30s\n", "remove", "Removes the todo entries given with -i.");
+    printf("%-10s%-30s\n", "detail", "Prints the details of the todo entries given with -i.");
+    printf("%-10s%-30s\n", "sweep", "Deletes attachments of removed todos and blobs nothing refers to.");
+    printf("%-10s%-30s\n", "compact", "Gives free space of the database back to the file system.");
+    printf("%-10s%-30s\n", "backup", "Copies the database and attachment files to the file given with -f.");
+    printf("%-10s%-30s\n", "restore", "Replaces all data with the verified backup given with -f.");
+    printf("%-10s%-30s\n", "sync", "export-changes writes the todo changes since the last export to the file given with -f,");
+    printf("%-10s%-30s\n", "", "apply applies the changes another storage exported to that file.");
+    printf("%-10s%-30s\n", "changes", "Prints the change feed events after --since as JSONL to stdout or the file given with -f.");
+    printf("%-10s%-30s\n", "archive", "Moves done entries unchanged for --older-than days and their attachments into the archive.");
     printf("\n");
 }
\ No newline at end of file
@@ -21,6 +21,9 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE. */
 
 #include <stdio.h>
+#include <time.h>
+#include <wchar.h>
+#include <unistd.h>
 
 #include "ninac.h"
 #include "args/args.h"
@@ -29,9 +32,25 @@ SOFTWARE. */
 #include "../color/color.h"
 #include "../storage/storage.h"
 
+#define BUFLEN_LIST_OPTION 17
+#define PURGE_BUDGET_MS 50
+
+/**
+ * @brief Shows how far a backup or restore got.
+ *
+ * @param copied Number of copied pages.
+ * @param total Number of pages.
+ */
+static void ninac_print_progress(long long copied, long long total)
+{
+    printf("\rCopied %lld of %lld pages", copied, total);
+    fflush(stdout);
+}
+
 int ninac_run(int argc, byte_t** argv)
 {
     args_t arguments = { 0 };
+    args_init(&arguments);
 
     const byte_t* err = NULL;
     int parsed = args_parse(argc, argv, &arguments, &err);
@@ -84,6 +103,344 @@ int ninac_run(int argc, byte_t** argv)
             return EXIT_FAILURE;
         }
 
+        // There is no worker to purge in the background, so a write command takes a short slice of the purge.
+        storage_purge(PURGE_BUDGET_MS, NULL, NULL);
+
+        break;
+    }
+
+    case IMPORT:
+    {
+        const byte_t* import_err_msg = NULL;
+        size_t imported = 0;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        STORAGE_ERR_CODE import_err = storage_import(arguments.file, &imported, &import_err_msg);
+
+        if (import_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", import_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        double rate = seconds > 0 ? imported / seconds : 0;
+
+        printf("Imported %zu todos in %.3f s (%.0f rows/s).\n", imported, seconds, rate);
+
+        break;
+    }
+
+    case EXPORT:
+    {
+        const byte_t* export_err_msg = NULL;
+        size_t exported = 0;
+
+        STORAGE_ERR_CODE export_err = storage_export(arguments.file, arguments.format, arguments.attachments, &exported, &export_err_msg);
+
+        if (export_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", export_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        if (arguments.file != NULL)
+        {
+            printf("Exported %zu todos.\n", exported);
+        }
+
+        break;
+    }
+
+    case ATTACH:
+    {
+        const byte_t* attach_err_msg = NULL;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        long long size = 0;
+        STORAGE_ERR_CODE attach_err = storage_attach_file(arguments.id, arguments.file, &size, &attach_err_msg);
+
+        if (attach_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", attach_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        double rate = seconds > 0 ? size / seconds / (1024 * 1024) : 0;
+
+        printf("Attached %lld bytes in %.3f s (%.1f MB/s).\n", size, seconds, rate);
+
+        break;
+    }
+
+    case LIST:
+    {
+        const byte_t* list_err_msg = NULL;
+        wchar_t option[BUFLEN_LIST_OPTION] = { 0 };
+        long long next = 0;
+
+        if (arguments.option != NULL)
+        {
+            mbstowcs(option, arguments.option, BUFLEN_LIST_OPTION - 1);
+        }
+
+        STORAGE_PRINT_OPTIONS list_option = storage_str_to_option(option);
+
+        STORAGE_ERR_CODE list_err = arguments.all
+            ? storage_print_all_todos_page(list_option, arguments.after, arguments.limit, &next, &list_err_msg)
+            : storage_print_todos_page(list_option, arguments.after, arguments.limit, &next, &list_err_msg);
+
+        if (list_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", list_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        if (next != 0)
+        {
+            printf(YELLOW("Next page: --after %lld\n"), next);
+        }
+
+        break;
+    }
+
+    case DONE_TODO:
+    case OPEN_TODO:
+    {
+        const byte_t* done_err_msg = NULL;
+        size_t affected = 0;
+        STORAGE_DONE_FLAG done = arguments.command == DONE_TODO ? STORAGE_DONE : STORAGE_OPEN;
+
+        STORAGE_ERR_CODE done_err = storage_set_done(arguments.id, done, &affected, &done_err_msg);
+
+        if (done_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", done_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        printf("Marked %zu todos as %s.\n", affected, done == STORAGE_DONE ? "done" : "open");
+
+        break;
+    }
+
+    case REMOVE_TODO:
+    {
+        const byte_t* remove_err_msg = NULL;
+        size_t affected = 0;
+
+        STORAGE_ERR_CODE remove_err = storage_remove_todo(arguments.id, &affected, &remove_err_msg);
+
+        if (remove_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", remove_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        printf("Removed %zu todos.\n", affected);
+
+        storage_purge(PURGE_BUDGET_MS, NULL, NULL);
+
+        break;
+    }
+
+    case DETAIL:
+    {
+        const byte_t* detail_err_msg = NULL;
+
+        STORAGE_ERR_CODE detail_err = storage_print_details(arguments.id, &detail_err_msg);
+
+        if (detail_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", detail_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        break;
+    }
+
+    case SWEEP:
+    {
+        const byte_t* sweep_err_msg = NULL;
+        size_t attachments = 0;
+        long long reclaimed = 0;
+
+        STORAGE_ERR_CODE sweep_err = storage_sweep_orphans(&attachments, &reclaimed, &sweep_err_msg);
+
+        if (sweep_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", sweep_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        printf("Removed %zu orphaned attachments and reclaimed %lld bytes.\n", attachments, reclaimed);
+
+        break;
+    }
+
+    case COMPACT:
+    {
+        const byte_t* compact_err_msg = NULL;
+        long long pages = 0;
+        long long free_pages = 0;
+        long long reclaimed = 0;
+
+        STORAGE_ERR_CODE compact_err = storage_compact(&pages, &free_pages, &reclaimed, &compact_err_msg);
+
+        if (compact_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", compact_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        printf("Reclaimed %lld bytes, %lld pages left, %lld of them free.\n", reclaimed, pages, free_pages);
+
+        break;
+    }
+
+    case BACKUP:
+    case RESTORE:
+    {
+        const byte_t* copy_err_msg = NULL;
+        storage_copy_stats_t stats = { 0 };
+        bool terminal = isatty(STDOUT_FILENO);
+        storage_progress_t progress = terminal ? ninac_print_progress : NULL;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        STORAGE_ERR_CODE copy_err = arguments.command == BACKUP
+            ? storage_backup(arguments.file, progress, &stats, &copy_err_msg)
+            : storage_restore(arguments.file, progress, &stats, &copy_err_msg);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (terminal)
+        {
+            printf("\r\033[2K");
+        }
+
+        if (copy_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", copy_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        long long bytes = stats.pages * stats.page_size;
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        double rate = seconds > 0 ? bytes / seconds / (1024 * 1024) : 0;
+
+        if (arguments.command == BACKUP)
+        {
+            printf("Backed up %lld bytes in %.3f s (%.1f MB/s), wrote %lld of %lld pages and %lld attachment files (%lld bytes).\n",
+                bytes, seconds, rate, stats.written, stats.pages, stats.files, stats.file_bytes);
+        }
+        else
+        {
+            printf("Restored %lld bytes in %.3f s (%.1f MB/s) and %lld attachment files (%lld bytes).\n",
+                bytes, seconds, rate, stats.files, stats.file_bytes);
+        }
+
+        break;
+    }
+
+    case CHANGES:
+    {
+        const byte_t* changes_err_msg = NULL;
+        size_t printed = 0;
+
+        STORAGE_ERR_CODE changes_err = storage_print_changes(arguments.since, arguments.file, &printed, &changes_err_msg);
+
+        if (changes_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", changes_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        if (arguments.file != NULL)
+        {
+            printf("Printed %zu events.\n", printed);
+        }
+
+        break;
+    }
+
+    case ARCHIVE:
+    {
+        if (arguments.older_than < 0)
+        {
+            printf(RED("ERR: ") "%s\n", "Please provide the minimum age in days with --older-than.");
+            return EXIT_FAILURE;
+        }
+
+        const byte_t* archive_err_msg = NULL;
+        long long todos = 0;
+        long long attachments = 0;
+
+        STORAGE_ERR_CODE archive_err = storage_archive(arguments.older_than, &todos, &attachments, &archive_err_msg);
+
+        if (archive_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", archive_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        printf("Archived %lld todos and %lld attachments.\n", todos, attachments);
+
+        break;
+    }
+
+    case SYNC_EXPORT:
+    case SYNC_APPLY:
+    {
+        if (arguments.file == NULL)
+        {
+            printf(RED("ERR: ") "Please provide a file path.\n");
+            return EXIT_FAILURE;
+        }
+
+        const byte_t* sync_err_msg = NULL;
+        storage_sync_stats_t stats = { 0 };
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        STORAGE_ERR_CODE sync_err = arguments.command == SYNC_EXPORT
+            ? storage_sync_export(arguments.file, &stats, &sync_err_msg)
+            : storage_sync_apply(arguments.file, &stats, &sync_err_msg);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (sync_err != STORAGE_NO_ERROR)
+        {
+            printf(RED("ERR: ") "%s\n", sync_err_msg);
+            return EXIT_FAILURE;
+        }
+
+        double millis = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+        if (arguments.command == SYNC_EXPORT)
+        {
+            printf("Exported %lld changes (%lld bytes) in %.1f ms.\n", stats.changes, stats.bytes, millis);
+        }
+        else
+        {
+            printf("Applied %lld changes (%lld bytes) in %.1f ms: %lld added, %lld changed, %lld removed, "
+                "%lld conflicts, %lld newer local todos kept.\n",
+                stats.changes, stats.bytes, millis, stats.added, stats.changed, stats.removed, stats.conflicts, stats.kept);
+
+            storage_purge(PURGE_BUDGET_MS, NULL, NULL);
+        }
+
         break;
     }
 
@@ -19,24 +19,86 @@ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
 LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE. */
-
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <ctype.h>
 
 #define __USE_GNU
 #include <string.h>
 
+#define SQLITE_ENABLE_SESSION
+#define SQLITE_ENABLE_PREUPDATE_HOOK
 #include <sqlite3.h>
+#include <zlib.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 
 #include "storage.h"
 
 #include "../color/color.h"
 #include "../env/env.h"
+#include "../import/import.h"
+#include "../export/export.h"
+#include "../hash/hash.h"
 
 #define STORAGE_FILE_NAME "toodles.sqlite"
+#define BLOB_DIR_NAME "blobs/"
+#define ARCHIVE_FILE_NAME "archive.sqlite"
+#define TRASH_DIR_NAME "trash/"
+
+#define BUFLEN_ERROR_MESSAGE 512
+#define BUFLEN_PRAGMA 512
+
+#define BUSY_TIMEOUT_MS 5000
+
+#define BUFLEN_BLOB_CHUNK (1024 * 1024)
+
+#define COMPRESSION_LEVEL Z_BEST_SPEED
+#define COMPRESSION_MAX_RATIO 0.9
+
+#define BLOB_FILE_THRESHOLD (64LL * 1024 * 1024)
+
+#define CACHE_MAX_ROWS 50000
+#define CACHE_MAX_CHANGES 64
+
+#define WRITE_QUEUE_LEN 256
+
+#define COMPACT_STEP_PAGES 1024
+
+#define BACKUP_STEP_PAGES 1024
+#define BACKUP_RETRY_MS 50
+#define BACKUP_MAX_PAGE_SIZE 65536
+#define BACKUP_VFS_NAME "toodles-backup"
+#define BACKUP_BLOB_DIR_SUFFIX ".blobs/"
+
+#define ARCHIVE_BATCH_TODOS 500
+#define BUFLEN_ARCHIVE_SQL 512
+
+#define FEED_MAX_EVENTS 100000
+#define FEED_PRUNE_EVERY 1000
+#define BUFLEN_FEED_SQL 2048
+
+#define SYNC_COLUMNS 6
+#define SYNC_MODIFIED(table) "coalesce(" table ".MODIFIED, strftime('%Y-%m-%d %H:%M:%f', " table ".CREATED, 'utc'))"
+
+#define PURGE_BATCH_TODOS 500
+#define PURGE_TRASH_MOVES 5
+#define ERASED_UP_TO "(select UP_TO from main.ERASED where ID = 1)"
+#define TODO_ALIVE(table) table ".DELETED = 0 and " table ".ID > " ERASED_UP_TO
 
 /**
  * @brief Full path to the storage file
@@ -44,6 +106,43 @@ SOFTWARE. */
  */
 static byte_t* storage_file_path = NULL;
 
+/**
+ * @brief Full path to the directory of blobs that are kept as files, with a trailing slash.
+ *
+ */
+static byte_t* blob_dir_path = NULL;
+
+/**
+ * @brief Full path to the archive database next to the storage file.
+ *
+ */
+static byte_t* archive_file_path = NULL;
+
+/**
+ * @brief Full path to the directory of archived blobs that are kept as files, with a trailing slash.
+ *
+ */
+static byte_t* archive_blob_dir_path = NULL;
+
+/**
+ * @brief Full path to the directory that erased archives are moved to until the purge deletes them, with a trailing
+ * slash.
+ *
+ */
+static byte_t* trash_dir_path = NULL;
+
+/**
+ * @brief True while the archive database is attached as schema "archive".
+ *
+ */
+static bool archive_attached = false;
+
+/**
+ * @brief Path of the blob file that the running attach created. Removed again if the transaction fails.
+ *
+ */
+static byte_t created_blob_file[PATH_MAX] = { 0 };
+
 /**
  * @brief Flag for checking if the initializer function was called.
  *
@@ -51,1658 +150,8978 @@ static byte_t* storage_file_path = NULL;
 static bool initialized = false;
 
 /**
- * @brief The used handle for sqlite3.
+ * @brief The used handle for sqlite3. Stays open from storage_new_storage until storage_shutdown.
  *
  */
-static sqlite3* sqlite_handle;
+static sqlite3* sqlite_handle = NULL;
 
 /**
- * @brief Defines an assignment of option to str.
+ * @brief Holds a copy of the last sqlite error message, so that it survives resetting the statement that caused it.
+ *
+ */
+static byte_t error_message[BUFLEN_ERROR_MESSAGE] = { 0 };
+
+/**
+ * @brief Buffer of twice BUFLEN_BLOB_CHUNK bytes for copying attachments between files and blobs. The second half
+ * takes the output of the codec. Allocated on first use and kept until storage_shutdown.
+ *
+ */
+static byte_t* blob_buffer = NULL;
+
+/**
+ * @brief Codecs for the content of a blob. Stored in BLOBS.CODEC, so values must not change.
+ * STORAGE_CODEC_FILE blobs have no BLOB_DATA row, their content is the file named by the hash in the blob directory.
+ *
+ */
+typedef enum
+{
+    STORAGE_CODEC_RAW,
+    STORAGE_CODEC_ZLIB,
+    STORAGE_CODEC_FILE,
+
+} STORAGE_CODEC;
+
+static const byte_t* CODEC_NAMES[] = {
+    "raw",
+    "zlib",
+    "file",
+};
+
+/**
+ * @brief A file that is read into the blob store. Regular files are mapped, so that their content is hashed,
+ * compressed and written to the blob straight from the page cache. Otherwise the file is read in chunks. Pipes and
+ * other special files are spooled into a temporary file first, because a blob is created with its final size.
  *
  */
 typedef struct
 {
-    STORAGE_PRINT_OPTIONS option;
-    const wchar_t* str;
+    FILE* file;
 
-} storage_print_option_t;
+    /**
+     * @brief Read-only mapping of the whole file or NULL if it is read with fread.
+     *
+     */
+    const byte_t* map;
 
-static const storage_print_option_t OPTIONS[] = {
+    sqlite3_int64 offset;
 
-    {
-        .option = ALL,
-        .str = L"all"
-    },
-    {
-        .option = DONE,
-        .str = L"done"
-    },
-    {
-        .option = OPEN,
-        .str = L"open"
-    }
-};
+} storage_source_t;
 
-STORAGE_PRINT_OPTIONS storage_str_to_option(const wchar_t* option)
+/**
+ * @brief The mapping of the file that is being attached. A file that shrinks while it is mapped raises SIGBUS on
+ * the next access beyond its new end, storage_map_fault turns that into a failed attach.
+ *
+ */
+typedef struct
 {
-    if (option == NULL)
-    {
-        return ALL;
-    }
+    const byte_t* map;
+    size_t len;
+    long page_size;
 
-    size_t len = sizeof(OPTIONS) / sizeof(OPTIONS[0]);
+    /**
+     * @brief Set by the signal handler once a page of the mapping was gone.
+     *
+     */
+    volatile sig_atomic_t truncated;
 
-    for (size_t i = 0; i < len; i++)
-    {
-        if (wcscmp(option, OPTIONS[i].str) == 0)
-        {
-            return OPTIONS[i].option;
-        }
-    }
+    struct sigaction previous;
 
-    return ALL;
-}
+} storage_map_guard_t;
 
-STORAGE_ERR_CODE storage_init(const byte_t** err)
+/**
+ * @brief Guard of the mapping of the running attach. map is NULL while no file is mapped.
+ *
+ */
+static storage_map_guard_t map_guard = { 0 };
+
+/**
+ * @brief A todo row as kept in the read cache. Title, details and created are stored in one allocation.
+ *
+ */
+typedef struct
 {
-    if (initialized == true)
-    {
-        return STORAGE_NO_ERROR;
-    }
+    sqlite3_int64 id;
+    const byte_t* title;
+    const byte_t* details;
+    const byte_t* created;
+    int done;
 
-    const byte_t* appdir = env_app_dir();
+} storage_cached_todo_t;
 
-    size_t storage_file_len = strlen(appdir) + strlen(STORAGE_FILE_NAME) + 1;
+/**
+ * @brief Copy of the todo table in id order that answers list and detail within a session. Writes of this
+ * connection are recorded by the update hook and only the changed rows are read again, writes of other
+ * processes change PRAGMA data_version and cause a full reload.
+ *
+ */
+typedef struct
+{
+    storage_cached_todo_t* rows;
+    size_t count;
+    size_t capacity;
+
+    /**
+     * @brief True if rows hold the whole table as of data_version. False if the table has more than
+     * CACHE_MAX_ROWS rows, in which case reads go to the database.
+     *
+     */
+    bool complete;
+
+    /**
+     * @brief True if the cache was loaded and no other connection changed the table since.
+     *
+     */
+    bool valid;
+
+    sqlite3_int64 data_version;
+
+    /**
+     * @brief Ids of the rows this connection changed since the cache was last refreshed. The cache is invalidated
+     * instead if there are more than CACHE_MAX_CHANGES.
+     *
+     */
+    sqlite3_int64 changes[CACHE_MAX_CHANGES];
+    size_t change_count;
+
+} storage_todo_cache_t;
 
-    storage_file_path = calloc(storage_file_len, sizeof(byte_t));
+/**
+ * @brief Kinds of writes that the write-behind worker applies.
+ *
+ */
+typedef enum
+{
+    WRITE_ADD,
+    WRITE_DONE,
+    WRITE_OPEN,
+    WRITE_REMOVE
 
-    strcat(storage_file_path, appdir);
-    strcat(storage_file_path, STORAGE_FILE_NAME);
+} STORAGE_WRITE;
 
-    initialized = true;
+/**
+ * @brief A write waiting in the queue of the write-behind worker. The strings are owned by the entry.
+ *
+ */
+typedef struct
+{
+    STORAGE_WRITE kind;
 
-    return STORAGE_NO_ERROR;
-}
+    /**
+     * @brief Title for WRITE_ADD, ids for all other kinds.
+     *
+     */
+    byte_t* text;
+
+    /**
+     * @brief Details for WRITE_ADD, NULL otherwise.
+     *
+     */
+    byte_t* details;
+
+} storage_write_t;
 
 /**
- * @brief Creates the basic todo table.
+ * @brief Bounded queue between the prompt and the write-behind worker. All fields are guarded by the mutex.
  *
- * @return int SQLITE result code.
  */
-static int storage_create_todo_table()
+typedef struct
 {
-    const byte_t* sql = "create table if not exists "
-        "TODOS ("
-        "ID INTEGER"
-        ",TITLE TEXT"
-        ",DETAILS TEXT"
-        ",DONE INTEGER NOT NULL DEFAULT 0 CHECK(DONE = 0 or DONE = 1)"
-        ",CREATED DATE DEFAULT (datetime('now', 'localtime'))"
-        ",primary key(ID autoincrement))";
+    pthread_t thread;
+    pthread_mutex_t mutex;
+
+    /**
+     * @brief Signalled when writes are queued or the worker should stop.
+     *
+     */
+    pthread_cond_t queued;
+
+    /**
+     * @brief Signalled when the worker took writes out of the queue or finished a batch.
+     *
+     */
+    pthread_cond_t progress;
+
+    storage_write_t entries[WRITE_QUEUE_LEN];
+    size_t head;
+    size_t count;
+
+    bool running;
+    bool busy;
+    bool stopping;
+
+    /**
+     * @brief Set if writes are queued instead of applied by the caller.
+     *
+     */
+    bool write_behind;
+
+    /**
+     * @brief Set while tombstones may be left to purge. The worker purges a batch at a time while the queue is empty
+     * and it is not paused, which it is from a flush until storage_resume_purge, so it never runs beside the prompt.
+     *
+     */
+    bool purging;
+    bool paused;
+
+    /**
+     * @brief Number of writes that failed since the last flush and the message of the first one.
+     *
+     */
+    size_t failed;
+    byte_t error[BUFLEN_ERROR_MESSAGE];
+
+} storage_writer_t;
 
-    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+/**
+ * @brief Keys for the statements that are kept in the statement cache.
+ *
+ */
+typedef enum
+{
+    STMT_INSERT_TODO,
+    STMT_PAGE_TODOS_ALL,
+    STMT_PAGE_TODOS_DONE,
+    STMT_PAGE_TODOS_OPEN,
+    STMT_PAGE_ARCHIVE_ALL,
+    STMT_PAGE_ARCHIVE_DONE,
+    STMT_PAGE_ARCHIVE_OPEN,
+    STMT_SEARCH_TODOS,
+    STMT_TOMBSTONE_TODO,
+    STMT_SELECT_DETAILS,
+    STMT_SELECT_DETAILS_RANGE,
+    STMT_UPDATE_DETAILS,
+    STMT_SET_DONE,
+    STMT_SET_OPEN,
+    STMT_INSERT_ATTACHMENT,
+    STMT_DELETE_ATTACHMENT,
+    STMT_SELECT_ATTACHMENTS,
+    STMT_SELECT_ATTACHMENT_BLOB,
+    STMT_SELECT_PHYSICAL_SIZE,
+    STMT_INSERT_BLOB_DATA,
+    STMT_INSERT_BLOB,
+    STMT_FIND_BLOB,
+    STMT_FIND_BLOB_SIZE,
+    STMT_ATTACHMENT_TOTALS,
+    STMT_SELECT_BLOB_GARBAGE,
+    STMT_DELETE_BLOB_GARBAGE,
+    STMT_IMPORT_TODO,
+    STMT_EXPORT_TODOS,
+    STMT_EXPORT_TODOS_ATTACHMENTS,
+    STMT_DATA_VERSION,
+    STMT_CACHE_TODOS,
+    STMT_CACHE_TODO,
+    STMT_CHANGE_BOUNDS,
+    STMT_SELECT_CHANGES,
+    STMT_PURGE_PENDING,
+    STMT_PURGE_TODOS,
+
+    STMT_COUNT
+
+} STORAGE_STATEMENT;
 
-    return result;
+/**
+ * @brief Defines an assignment of statement key to sql.
+ *
+ */
+typedef struct
+{
+    STORAGE_STATEMENT key;
+    const byte_t* sql;
+
+    /**
+     * @brief True if the statement reads a whole table on purpose. All other statements must be answered
+     * through an index, which is checked in debug builds.
+     *
+     */
+    bool scan;
+
+} storage_statement_t;
+
+static const storage_statement_t STATEMENTS[] = {
+
+    {
+        .key = STMT_INSERT_TODO,
+        .sql = "insert into TODOS (TITLE, DETAILS) values (?, ?)"
+    },
+    {
+        .key = STMT_PAGE_TODOS_ALL,
+        .sql = "select ID, TITLE, DONE, CREATED from TODOS where DELETED = 0 and ID > max(?, " ERASED_UP_TO ") order by ID limit ?"
+    },
+    {
+        .key = STMT_PAGE_TODOS_DONE,
+        .sql = "select ID, TITLE, DONE, CREATED from TODOS "
+            "where DONE = 1 and DELETED = 0 and ID > max(?, " ERASED_UP_TO ") order by ID limit ?"
+    },
+    {
+        .key = STMT_PAGE_TODOS_OPEN,
+        .sql = "select ID, TITLE, DONE, CREATED from TODOS "
+            "where DONE = 0 and DELETED = 0 and ID > max(?, " ERASED_UP_TO ") order by ID limit ?"
+    },
+    {
+        .key = STMT_PAGE_ARCHIVE_ALL,
+        .sql = "select ID, TITLE, DONE, CREATED from temp.ALL_TODOS where ID > ? order by ID limit ?"
+    },
+    {
+        .key = STMT_PAGE_ARCHIVE_DONE,
+        .sql = "select ID, TITLE, DONE, CREATED from temp.ALL_TODOS where DONE = 1 and ID > ? order by ID limit ?"
+    },
+    {
+        .key = STMT_PAGE_ARCHIVE_OPEN,
+        .sql = "select ID, TITLE, DONE, CREATED from temp.ALL_TODOS where DONE = 0 and ID > ? order by ID limit ?"
+    },
+    {
+        .key = STMT_SEARCH_TODOS,
+        .sql = "select t.ID, t.TITLE, t.DONE, t.CREATED, snippet(TODOS_FTS, 1, '\033[1;33m', '\033[0m', '...', 12) "
+            "from TODOS_FTS join TODOS t on t.ID = TODOS_FTS.rowid and " TODO_ALIVE("t") " "
+            "where TODOS_FTS match ? order by bm25(TODOS_FTS, 10.0, 1.0)"
+    },
+    {
+        .key = STMT_TOMBSTONE_TODO,
+        .sql = "update TODOS set DELETED = 1 where ID between ? and ? and " TODO_ALIVE("TODOS")
+    },
+    {
+        .key = STMT_SELECT_DETAILS,
+        .sql = "select DETAILS from TODOS where ID = ? and " TODO_ALIVE("TODOS")
+    },
+    {
+        .key = STMT_SELECT_DETAILS_RANGE,
+        .sql = "select ID, TITLE, DETAILS from TODOS where ID between ? and ? and " TODO_ALIVE("TODOS") " order by ID"
+    },
+    {
+        .key = STMT_UPDATE_DETAILS,
+        .sql = "update TODOS set DETAILS = ?, MODIFIED = strftime('%Y-%m-%d %H:%M:%f', 'now') "
+            "where ID = ? and " TODO_ALIVE("TODOS")
+    },
+    {
+        .key = STMT_SET_DONE,
+        .sql = "update TODOS set DONE = 1, MODIFIED = iif(DONE = 1, MODIFIED, strftime('%Y-%m-%d %H:%M:%f', 'now')) "
+            "where ID between ? and ? and " TODO_ALIVE("TODOS")
+    },
+    {
+        .key = STMT_SET_OPEN,
+        .sql = "update TODOS set DONE = 0, MODIFIED = iif(DONE = 0, MODIFIED, strftime('%Y-%m-%d %H:%M:%f', 'now')) "
+            "where ID between ? and ? and " TODO_ALIVE("TODOS")
+    },
+    {
+        .key = STMT_INSERT_ATTACHMENT,
+        .sql = "insert into ATTACHMENTS (NAME, TODO_ID, SIZE, BLOB_ID) values (?, ?, ?, ?)"
+    },
+    {
+        .key = STMT_DELETE_ATTACHMENT,
+        .sql = "delete from ATTACHMENTS where ID = ?"
+    },
+    {
+        .key = STMT_SELECT_ATTACHMENTS,
+        .sql = "select t.ID, t.NAME, t.SIZE, b.STORED, b.CODEC, b.ENCODE_US from ATTACHMENTS t "
+            "join BLOBS b on b.ID = t.BLOB_ID join TODOS o on o.ID = t.TODO_ID and " TODO_ALIVE("o") " "
+            "where t.TODO_ID = ?"
+    },
+    {
+        .key = STMT_SELECT_ATTACHMENT_BLOB,
+        .sql = "select t.BLOB_ID, b.CODEC, b.HASH from ATTACHMENTS t join BLOBS b on b.ID = t.BLOB_ID "
+            "join TODOS o on o.ID = t.TODO_ID and " TODO_ALIVE("o") " where t.ID = ?"
+    },
+    {
+        .key = STMT_SELECT_PHYSICAL_SIZE,
+        .sql = "select coalesce(sum(STORED), 0) from BLOBS where ID in (select BLOB_ID from ATTACHMENTS where TODO_ID = ?)"
+    },
+    {
+        .key = STMT_INSERT_BLOB_DATA,
+        .sql = "insert into BLOB_DATA (ID, CONTENT) values ((select coalesce(max(ID), 0) + 1 from BLOBS), zeroblob(?))"
+    },
+    {
+        .key = STMT_INSERT_BLOB,
+        .sql = "insert into BLOBS (ID, HASH, SIZE, STORED, CODEC, ENCODE_US, REFS) values (?, ?, ?, ?, ?, ?, 0)"
+    },
+    {
+        .key = STMT_FIND_BLOB,
+        .sql = "select ID from BLOBS where HASH = ?"
+    },
+    {
+        .key = STMT_FIND_BLOB_SIZE,
+        .sql = "select 1 from BLOBS where SIZE = ? limit 1"
+    },
+    {
+        .key = STMT_ATTACHMENT_TOTALS,
+        .sql = "select (select coalesce(sum(SIZE), 0) from ATTACHMENTS), (select coalesce(sum(STORED), 0) from BLOBS)",
+        .scan = true
+    },
+    {
+        .key = STMT_SELECT_BLOB_GARBAGE,
+        .sql = "select HASH from BLOB_GARBAGE where HASH not in (select HASH from BLOBS)",
+        .scan = true
+    },
+    {
+        .key = STMT_DELETE_BLOB_GARBAGE,
+        .sql = "delete from BLOB_GARBAGE",
+        .scan = true
+    },
+    {
+        .key = STMT_IMPORT_TODO,
+        .sql = "insert into TODOS (TITLE, DETAILS, DONE, CREATED) values (?, ?, ?, coalesce(datetime(?), datetime('now', 'localtime')))"
+    },
+    {
+        .key = STMT_EXPORT_TODOS,
+        .sql = "select ID, TITLE, DETAILS, DONE, CREATED from TODOS where " TODO_ALIVE("TODOS") " order by ID",
+        .scan = true
+    },
+    {
+        .key = STMT_EXPORT_TODOS_ATTACHMENTS,
+        .sql = "select t.ID, t.TITLE, t.DETAILS, t.DONE, t.CREATED, a.ID, a.NAME, a.SIZE "
+            "from TODOS t left join ATTACHMENTS a on a.TODO_ID = t.ID where " TODO_ALIVE("t") " order by t.ID, a.ID",
+        .scan = true
+    },
+    {
+        .key = STMT_DATA_VERSION,
+        .sql = "pragma data_version"
+    },
+    {
+        .key = STMT_CACHE_TODOS,
+        .sql = "select ID, TITLE, DETAILS, DONE, CREATED from TODOS where " TODO_ALIVE("TODOS") " order by ID limit ?",
+        .scan = true
+    },
+    {
+        .key = STMT_CACHE_TODO,
+        .sql = "select ID, TITLE, DETAILS, DONE, CREATED from TODOS where ID = ? and " TODO_ALIVE("TODOS")
+    },
+    {
+        .key = STMT_CHANGE_BOUNDS,
+        .sql = "select (select min(SEQ) from CHANGES), coalesce(max(SEQ), 0) from CHANGES"
+    },
+    {
+        .key = STMT_SELECT_CHANGES,
+        .sql = "select c.SEQ, c.TIME, c.TABLE_NAME, c.OP, c.ROW_ID, c.TODO_ID, "
+            "coalesce(t.ID, a.ID) is not null, t.TITLE, t.DETAILS, t.DONE, t.CREATED, a.NAME, a.SIZE "
+            "from CHANGES c "
+            "left join TODOS t on c.TODO_ID is null and t.ID = c.ROW_ID and " TODO_ALIVE("t") " "
+            "left join ATTACHMENTS a on c.TODO_ID is not null and a.ID = c.ROW_ID "
+            "where c.SEQ > ? order by c.SEQ"
+    },
+    {
+        .key = STMT_PURGE_PENDING,
+        .sql = "select " ERASED_UP_TO " > 0 or exists (select 1 from TODOS where DELETED = 1)",
+        .scan = true
+    },
+    {
+        .key = STMT_PURGE_TODOS,
+        .sql = "delete from TODOS where ID in (select ID from TODOS where ID <= " ERASED_UP_TO " order by ID limit ?1) "
+            "or ID in (select ID from TODOS where DELETED = 1 order by ID limit ?1)",
+        .scan = true
+    }
+};
+
+/**
+ * @brief Keys for the SQL that runs outside the statement cache, because it runs once per command or holds several
+ * statements for sqlite3_exec. Migrations are not listed, they run once per database.
+ *
+ */
+typedef enum
+{
+    SCRIPT_PURGE_FINISH,
+    SCRIPT_ERASE,
+    SCRIPT_BLOB_SPACE,
+    SCRIPT_SWEEP_ATTACHMENTS,
+    SCRIPT_SWEEP_BLOBS,
+    SCRIPT_BLOB_FILES,
+    SCRIPT_FIND_BLOB_FILE,
+    SCRIPT_SYNC_ASSIGN_UIDS,
+    SCRIPT_SYNC_CAPTURE,
+    SCRIPT_SYNC_TOUCHED_CREATE,
+    SCRIPT_SYNC_TOUCH,
+    SCRIPT_SYNC_REMOVE,
+    SCRIPT_SYNC_KEPT,
+    SCRIPT_SYNC_CHANGE,
+    SCRIPT_SYNC_ADD,
+    SCRIPT_SYNC_TOUCHED_DROP,
+    SCRIPT_ARCHIVE_BATCH_CREATE,
+    SCRIPT_ARCHIVE_BATCH_CLEAR,
+    SCRIPT_ARCHIVE_RECOVER,
+    SCRIPT_ARCHIVE_SELECT,
+    SCRIPT_ARCHIVE_BLOBS,
+    SCRIPT_ARCHIVE_COPY,
+    SCRIPT_ARCHIVE_BLOB_FILES,
+    SCRIPT_ARCHIVE_CURSOR,
+    SCRIPT_ARCHIVE_UNDO,
+    SCRIPT_ARCHIVE_FEED_SEQ,
+    SCRIPT_ARCHIVE_REMOVE,
+    SCRIPT_ARCHIVE_UNSYNC,
+    SCRIPT_ARCHIVE_FEED,
+    SCRIPT_ARCHIVE_ATTACHMENTS,
+
+    SCRIPT_COUNT
+
+} STORAGE_SCRIPT;
+
+/**
+ * @brief Defines an assignment of script key to sql. A script can hold several statements, scan applies to all of
+ * them. Their plans are checked by the plan test.
+ *
+ */
+typedef struct
+{
+    STORAGE_SCRIPT key;
+    const byte_t* sql;
+    bool scan;
+
+} storage_script_t;
+
+static const storage_script_t SCRIPTS[] = {
+
+    {
+        .key = SCRIPT_PURGE_FINISH,
+        .sql = "update sqlite_sequence set seq = 0 where name = 'TODOS' "
+            "and " ERASED_UP_TO " > 0 and not exists (select 1 from TODOS);"
+            "update sqlite_sequence set seq = 0 where name = 'ATTACHMENTS' "
+            "and " ERASED_UP_TO " > 0 and not exists (select 1 from ATTACHMENTS);"
+            "update ERASED set UP_TO = 0 where ID = 1 and UP_TO > 0;",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ERASE,
+        .sql = "update ERASED set UP_TO = max(UP_TO, coalesce((select max(ID) from TODOS), 0)) where ID = 1"
+    },
+    {
+        .key = SCRIPT_BLOB_SPACE,
+        .sql = "select (select coalesce(sum(STORED), 0) from BLOBS) + "
+            "(select coalesce(sum(length(CONTENT)), 0) from BLOB_DATA where ID not in (select ID from BLOBS))",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_SWEEP_ATTACHMENTS,
+        .sql = "delete from ATTACHMENTS where TODO_ID not in (select ID from TODOS)",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_SWEEP_BLOBS,
+        .sql = "delete from BLOBS where ID not in (select BLOB_ID from ATTACHMENTS);"
+            "delete from BLOB_DATA where ID not in (select ID from BLOBS);",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_BLOB_FILES,
+        .sql = "select HASH, STORED from BLOBS where CODEC = ?",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_FIND_BLOB_FILE,
+        .sql = "select 1 from BLOBS where HASH = ? and CODEC = ?"
+    },
+    {
+        .key = SCRIPT_SYNC_ASSIGN_UIDS,
+        .sql = "update or ignore TODOS set UID = substr(lower(hex(SHA256(ID || ':' || CREATED || ':' || TITLE))), 1, 32) "
+            "where UID is null;"
+            "update TODOS set UID = lower(hex(randomblob(16))) where UID is null;"
+    },
+    {
+        .key = SCRIPT_SYNC_CAPTURE,
+        .sql = "create temp table SYNC_CURRENT as "
+            "select t.UID, t.TITLE, t.DETAILS, t.DONE, t.CREATED, " SYNC_MODIFIED("t") " as MODIFIED "
+            "from main.SYNC_DIRTY d join main.TODOS t on t.ID = d.ID and t.UID = d.UID and " TODO_ALIVE("t") ";"
+            "delete from main.SYNC_TODOS where UID in (select UID from main.SYNC_DIRTY) "
+            "and UID not in (select UID from temp.SYNC_CURRENT);"
+            "update main.SYNC_TODOS as b "
+            "set TITLE = c.TITLE, DETAILS = c.DETAILS, DONE = c.DONE, CREATED = c.CREATED, MODIFIED = c.MODIFIED "
+            "from temp.SYNC_CURRENT c where c.UID = b.UID and (b.TITLE is not c.TITLE or b.DETAILS is not c.DETAILS "
+            "or b.DONE is not c.DONE or b.CREATED is not c.CREATED or b.MODIFIED is not c.MODIFIED);"
+            "insert into main.SYNC_TODOS select * from temp.SYNC_CURRENT c "
+            "where not exists (select 1 from main.SYNC_TODOS b where b.UID = c.UID);"
+            "drop table temp.SYNC_CURRENT;"
+            "delete from main.SYNC_DIRTY;",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_SYNC_TOUCHED_CREATE,
+        .sql = "create temp table SYNC_TOUCHED (UID TEXT PRIMARY KEY, OP INTEGER) without rowid"
+    },
+    {
+        .key = SCRIPT_SYNC_TOUCH,
+        .sql = "insert or replace into temp.SYNC_TOUCHED (UID, OP) values (?, ?)"
+    },
+    {
+        .key = SCRIPT_SYNC_REMOVE,
+        .sql = "update main.TODOS set DELETED = 1 "
+            "where UID in (select UID from temp.SYNC_TOUCHED where OP = ?) and " TODO_ALIVE("TODOS"),
+        .scan = true
+    },
+    {
+        // The planner knows nothing about the size of SYNC_TOUCHED, cross joins keep it the outer loop.
+        .key = SCRIPT_SYNC_KEPT,
+        .sql = "select count(*) from temp.SYNC_TOUCHED x "
+            "cross join main.TODOS t on t.UID = x.UID cross join main.SYNC_TODOS b on b.UID = x.UID "
+            "where x.OP != ? and " TODO_ALIVE("t") " and (t.TITLE is not b.TITLE or t.DETAILS is not b.DETAILS or t.DONE is not b.DONE) "
+            "and (" SYNC_MODIFIED("t") ", t.TITLE, coalesce(t.DETAILS, ''), t.DONE) "
+            ">= (coalesce(b.MODIFIED, ''), b.TITLE, coalesce(b.DETAILS, ''), b.DONE)",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_SYNC_CHANGE,
+        .sql = "update main.TODOS as t "
+            "set TITLE = b.TITLE, DETAILS = b.DETAILS, DONE = b.DONE, MODIFIED = b.MODIFIED "
+            "from temp.SYNC_TOUCHED x join main.SYNC_TODOS b on b.UID = x.UID "
+            "where x.UID = t.UID and x.OP != ? and " TODO_ALIVE("t") " "
+            "and (" SYNC_MODIFIED("t") ", t.TITLE, coalesce(t.DETAILS, ''), t.DONE) "
+            "< (coalesce(b.MODIFIED, ''), b.TITLE, coalesce(b.DETAILS, ''), b.DONE)"
+    },
+    {
+        .key = SCRIPT_SYNC_ADD,
+        .sql = "insert into main.TODOS (TITLE, DETAILS, DONE, CREATED, MODIFIED, UID) "
+            "select b.TITLE, b.DETAILS, b.DONE, b.CREATED, b.MODIFIED, b.UID "
+            "from temp.SYNC_TOUCHED x join main.SYNC_TODOS b on b.UID = x.UID "
+            "where x.OP = ? and not exists (select 1 from main.TODOS t where t.UID = x.UID) order by b.CREATED, b.UID",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_SYNC_TOUCHED_DROP,
+        .sql = "drop table temp.SYNC_TOUCHED"
+    },
+    {
+        .key = SCRIPT_ARCHIVE_BATCH_CREATE,
+        .sql = "create temp table if not exists ARCHIVE_BATCH (ID INTEGER PRIMARY KEY)"
+    },
+    {
+        .key = SCRIPT_ARCHIVE_BATCH_CLEAR,
+        .sql = "delete from temp.ARCHIVE_BATCH"
+    },
+    {
+        .key = SCRIPT_ARCHIVE_RECOVER,
+        .sql = "delete from archive.TODOS where exists (select 1 from main.TODOS t where t.ID = TODOS.ID);"
+            "delete from archive.ATTACHMENTS "
+            "where not exists (select 1 from archive.TODOS t where t.ID = ATTACHMENTS.TODO_ID);",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_SELECT,
+        .sql = "insert into temp.ARCHIVE_BATCH (ID) "
+            "select ID from main.TODOS where DONE = 1 and DELETED = 0 and ID > max(?, " ERASED_UP_TO ") "
+            "and " SYNC_MODIFIED("TODOS") " < ? order by ID limit ?"
+    },
+    {
+        // The planner knows nothing about the size of ARCHIVE_BATCH, cross joins keep it the outer loop.
+        .key = SCRIPT_ARCHIVE_BLOBS,
+        .sql = "insert or ignore into archive.BLOBS (HASH, SIZE, STORED, CODEC) "
+            "select b.HASH, b.SIZE, b.STORED, b.CODEC from temp.ARCHIVE_BATCH x "
+            "cross join main.ATTACHMENTS a on a.TODO_ID = x.ID cross join main.BLOBS b on b.ID = a.BLOB_ID;"
+            "insert or ignore into archive.BLOB_DATA (ID, CONTENT) "
+            "select ab.ID, d.CONTENT from temp.ARCHIVE_BATCH x "
+            "cross join main.ATTACHMENTS a on a.TODO_ID = x.ID cross join main.BLOBS b on b.ID = a.BLOB_ID "
+            "cross join main.BLOB_DATA d on d.ID = b.ID cross join archive.BLOBS ab on ab.HASH = b.HASH;",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_COPY,
+        .sql = "insert into archive.ATTACHMENTS (ID, NAME, TODO_ID, SIZE, BLOB_ID) "
+            "select a.ID, a.NAME, a.TODO_ID, a.SIZE, ab.ID from temp.ARCHIVE_BATCH x "
+            "cross join main.ATTACHMENTS a on a.TODO_ID = x.ID cross join main.BLOBS b on b.ID = a.BLOB_ID "
+            "cross join archive.BLOBS ab on ab.HASH = b.HASH;"
+            "insert into archive.TODOS (ID, TITLE, DETAILS, DONE, CREATED, UID, MODIFIED, ARCHIVED) "
+            "select t.ID, t.TITLE, t.DETAILS, t.DONE, t.CREATED, t.UID, t.MODIFIED, strftime('%Y-%m-%d %H:%M:%f', 'now') "
+            "from temp.ARCHIVE_BATCH x cross join main.TODOS t on t.ID = x.ID;",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_BLOB_FILES,
+        .sql = "select distinct b.HASH, b.STORED from temp.ARCHIVE_BATCH x "
+            "cross join main.ATTACHMENTS a on a.TODO_ID = x.ID cross join main.BLOBS b on b.ID = a.BLOB_ID where b.CODEC = ?",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_CURSOR,
+        .sql = "select max(ID) from temp.ARCHIVE_BATCH"
+    },
+    {
+        .key = SCRIPT_ARCHIVE_UNDO,
+        .sql = "delete from archive.TODOS where ID in (select x.ID from temp.ARCHIVE_BATCH x "
+            "where not exists (select 1 from main.TODOS t join archive.TODOS a on a.ID = t.ID where t.ID = x.ID "
+            "and t.DONE = 1 and " TODO_ALIVE("t") " and t.TITLE is a.TITLE and t.DETAILS is a.DETAILS "
+            "and t.CREATED is a.CREATED and t.UID is a.UID and t.MODIFIED is a.MODIFIED "
+            "and (select count(*) from main.ATTACHMENTS m where m.TODO_ID = t.ID) "
+            "= (select count(*) from archive.ATTACHMENTS c where c.TODO_ID = t.ID) "
+            "and not exists (select 1 from main.ATTACHMENTS m where m.TODO_ID = t.ID "
+            "and not exists (select 1 from archive.ATTACHMENTS c where c.ID = m.ID))));"
+            "delete from archive.ATTACHMENTS where TODO_ID in (select x.ID from temp.ARCHIVE_BATCH x "
+            "where not exists (select 1 from archive.TODOS a where a.ID = x.ID));",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_FEED_SEQ,
+        .sql = "select coalesce(max(SEQ), 0) from main.CHANGES"
+    },
+    {
+        .key = SCRIPT_ARCHIVE_REMOVE,
+        .sql = "delete from main.TODOS "
+            "where ID in (select x.ID from temp.ARCHIVE_BATCH x cross join archive.TODOS a on a.ID = x.ID)",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_UNSYNC,
+        .sql = "delete from main.SYNC_DIRTY "
+            "where ID in (select x.ID from temp.ARCHIVE_BATCH x cross join archive.TODOS a on a.ID = x.ID)",
+        .scan = true
+    },
+    {
+        .key = SCRIPT_ARCHIVE_FEED,
+        .sql = "update main.CHANGES set OP = 'archive' where SEQ > ? and OP = 'delete'"
+    },
+    {
+        .key = SCRIPT_ARCHIVE_ATTACHMENTS,
+        .sql = "select count(*) from temp.ARCHIVE_BATCH x "
+            "cross join archive.ATTACHMENTS a on a.TODO_ID = x.ID",
+        .scan = true
+    }
+};
+
+/**
+ * @brief Compiled statements, indexed by STORAGE_STATEMENT. Entries are prepared on first use.
+ *
+ */
+static sqlite3_stmt* statement_cache[STMT_COUNT] = { 0 };
+
+/**
+ * @brief Read cache for todo rows. Loaded by the first list or detail and kept until the table changes.
+ *
+ */
+static storage_todo_cache_t todo_cache = { 0 };
+
+/**
+ * @brief Write-behind worker of interactive mode. Only running after storage_start_writer.
+ *
+ */
+static storage_writer_t writer = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .queued = PTHREAD_COND_INITIALIZER,
+    .progress = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * @brief A file opened through the backup VFS. Wraps the file of the default VFS, which is stored right behind it.
+ *
+ */
+typedef struct
+{
+    sqlite3_file base;
+    sqlite3_file* real;
+
+    /**
+     * @brief True for the database file itself, whose unchanged pages are not written again.
+     *
+     */
+    bool database;
+
+} storage_backup_file_t;
+
+/**
+ * @brief VFS of backup files. Registered on the first backup.
+ *
+ */
+static sqlite3_vfs backup_vfs = { 0 };
+
+/**
+ * @brief Pages the backup VFS wrote and pages it skipped because the file already held the same bytes.
+ *
+ */
+static long long backup_written = 0;
+static long long backup_skipped = 0;
+
+/**
+ * @brief Receives the page that is currently stored in the backup file, to compare it with the new one.
+ *
+ */
+static byte_t backup_page[BACKUP_MAX_PAGE_SIZE];
+
+/**
+ * @brief Defines the pragmas that make up a storage profile.
+ *
+ */
+typedef struct
+{
+    const byte_t* name;
+    const byte_t* journal_mode;
+    const byte_t* synchronous;
+    sqlite3_int64 mmap_size;
+    int cache_size;
+    const byte_t* temp_store;
+
+} storage_profile_t;
+
+/**
+ * @brief Available storage profiles. The first entry is the default.
+ * A negative cache_size is given in KiB, as sqlite expects it.
+ *
+ */
+static const storage_profile_t PROFILES[] = {
+
+    {
+        .name = "safe",
+        .journal_mode = "WAL",
+        .synchronous = "FULL",
+        .mmap_size = 0,
+        .cache_size = -2000,
+        .temp_store = "DEFAULT"
+    },
+    {
+        .name = "fast",
+        .journal_mode = "WAL",
+        .synchronous = "NORMAL",
+        .mmap_size = 64 * 1024 * 1024,
+        .cache_size = -16384,
+        .temp_store = "MEMORY"
+    },
+    {
+        .name = "bulk",
+        .journal_mode = "WAL",
+        .synchronous = "OFF",
+        .mmap_size = 256 * 1024 * 1024,
+        .cache_size = -65536,
+        .temp_store = "MEMORY"
+    }
+};
+
+/**
+ * @brief The profile that is applied to the connection.
+ *
+ */
+static const storage_profile_t* active_profile = &PROFILES[0];
+
+/**
+ * @brief Opens the database in the storage file.
+ *
+ * @param handle Receives the connection.
+ * @return int SQLITE result code.
+ */
+static int storage_open_file(sqlite3** handle)
+{
+    return sqlite3_open(storage_file_path, handle);
+}
+
+/**
+ * @brief Returns the path of the storage file.
+ *
+ * @return const byte_t* Path of the storage file.
+ */
+static const byte_t* storage_file_location()
+{
+    return storage_file_path;
+}
+
+/**
+ * @brief Returns the directory for blobs that are kept as files.
+ *
+ * @return const byte_t* Path of the directory with a trailing slash.
+ */
+static const byte_t* storage_file_blob_dir()
+{
+    return blob_dir_path;
+}
+
+/**
+ * @brief Returns the path of the archive file.
+ *
+ * @return const byte_t* Path of the archive file.
+ */
+static const byte_t* storage_file_archive()
+{
+    return archive_file_path;
+}
+
+/**
+ * @brief Returns the directory for archived blobs that are kept as files.
+ *
+ * @return const byte_t* Path of the directory with a trailing slash.
+ */
+static const byte_t* storage_file_archive_blob_dir()
+{
+    return archive_blob_dir_path;
+}
+
+/**
+ * @brief Returns the directory that erased archives are moved to.
+ *
+ * @return const byte_t* Path of the directory with a trailing slash.
+ */
+static const byte_t* storage_file_trash_dir()
+{
+    return trash_dir_path;
+}
+
+/**
+ * @brief Opens a database that lives in memory until the connection is closed.
+ *
+ * @param handle Receives the connection.
+ * @return int SQLITE result code.
+ */
+static int storage_open_memory(sqlite3** handle)
+{
+    return sqlite3_open(":memory:", handle);
+}
+
+/**
+ * @brief Returns the name of the in-memory database.
+ *
+ * @return const byte_t* Name of the database.
+ */
+static const byte_t* storage_memory_location()
+{
+    return ":memory:";
+}
+
+/**
+ * @brief Returns no blob directory, so that all blobs stay in memory.
+ *
+ * @return const byte_t* NULL.
+ */
+static const byte_t* storage_memory_blob_dir()
+{
+    return NULL;
+}
+
+/**
+ * @brief Returns the name of an in-memory archive, which lives as long as the connection.
+ *
+ * @return const byte_t* Name of the archive.
+ */
+static const byte_t* storage_memory_archive()
+{
+    return ":memory:";
+}
+
+/**
+ * @brief Defines the operations that differ between storage backends. Both backends are SQLite databases, so all
+ * queries are shared and a backend only decides where the data lives.
+ *
+ */
+typedef struct
+{
+    const byte_t* name;
+
+    /**
+     * @brief Opens the connection to the database.
+     *
+     */
+    int (*open)(sqlite3** handle);
+
+    /**
+     * @brief Returns the location of the database for display.
+     *
+     */
+    const byte_t* (*location)();
+
+    /**
+     * @brief Returns the directory for blobs that are kept as files or NULL if every blob stays in the database.
+     *
+     */
+    const byte_t* (*blob_dir)();
+
+    /**
+     * @brief Returns the location of the archive database.
+     *
+     */
+    const byte_t* (*archive)();
+
+    /**
+     * @brief Returns the directory for archived blobs that are kept as files or NULL if there are none.
+     *
+     */
+    const byte_t* (*archive_blob_dir)();
+
+    /**
+     * @brief Returns the directory that erased archives are moved to or NULL if an erased archive leaves no files.
+     *
+     */
+    const byte_t* (*trash_dir)();
+
+} storage_backend_t;
+
+/**
+ * @brief Available storage backends. The first entry is the default. The memory backend does no disk I/O at all and
+ * loses its data when toodles exits.
+ *
+ */
+static const storage_backend_t BACKENDS[] = {
+
+    {
+        .name = "file",
+        .open = storage_open_file,
+        .location = storage_file_location,
+        .blob_dir = storage_file_blob_dir,
+        .archive = storage_file_archive,
+        .archive_blob_dir = storage_file_archive_blob_dir,
+        .trash_dir = storage_file_trash_dir
+    },
+    {
+        .name = "memory",
+        .open = storage_open_memory,
+        .location = storage_memory_location,
+        .blob_dir = storage_memory_blob_dir,
+        .archive = storage_memory_archive,
+        .archive_blob_dir = storage_memory_blob_dir,
+        .trash_dir = storage_memory_blob_dir
+    }
+};
+
+/**
+ * @brief The backend that holds the storage.
+ *
+ */
+static const storage_backend_t* active_backend = &BACKENDS[0];
+
+/**
+ * @brief Defines an assignment of option to str.
+ *
+ */
+typedef struct
+{
+    STORAGE_PRINT_OPTIONS option;
+    const wchar_t* str;
+
+} storage_print_option_t;
+
+static const storage_print_option_t OPTIONS[] = {
+
+    {
+        .option = ALL,
+        .str = L"all"
+    },
+    {
+        .option = DONE,
+        .str = L"done"
+    },
+    {
+        .option = OPEN,
+        .str = L"open"
+    }
+};
+
+STORAGE_PRINT_OPTIONS storage_str_to_option(const wchar_t* option)
+{
+    if (option == NULL)
+    {
+        return ALL;
+    }
+
+    size_t len = sizeof(OPTIONS) / sizeof(OPTIONS[0]);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (wcscmp(option, OPTIONS[i].str) == 0)
+        {
+            return OPTIONS[i].option;
+        }
+    }
+
+    return ALL;
+}
+
+/**
+ * @brief Copies the current error message of the given connection and hands it out through err.
+ *
+ * @param db The connection.
+ * @param err Pointer to error message.
+ */
+static void storage_set_db_error(sqlite3* db, const byte_t** err)
+{
+    if (err)
+    {
+        snprintf(error_message, BUFLEN_ERROR_MESSAGE, "%s", sqlite3_errmsg(db));
+        *err = error_message;
+    }
+}
+
+/**
+ * @brief Copies the current sqlite error message and hands it out through err.
+ *
+ * @param err Pointer to error message.
+ */
+static void storage_set_error(const byte_t** err)
+{
+    storage_set_db_error(sqlite_handle, err);
+}
+
+#ifndef NDEBUG
+/**
+ * @brief Checks if sqlite would answer the given statement by walking a whole table or index. A constant row and a
+ * full-text match do not count.
+ *
+ * @param sql The statement.
+ * @return true The query plan contains a scan.
+ * @return false All tables are accessed through index lookups.
+ */
+static bool storage_plan_has_scan(const byte_t* sql)
+{
+    const byte_t* prefix = "explain query plan ";
+
+    size_t len = strlen(prefix) + strlen(sql) + 1;
+    byte_t explain[len];
+    memset(explain, 0, len * sizeof(byte_t));
+
+    strcat(explain, prefix);
+    strcat(explain, sql);
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, explain, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return false;
+    }
+
+    bool scan = false;
+
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+        const byte_t* detail = (const byte_t*)sqlite3_column_text(statement, 3);
+
+        if (detail != NULL && strncmp(detail, "SCAN ", 5) == 0
+            && strcmp(detail, "SCAN CONSTANT ROW") != 0
+            && strstr(detail, "VIRTUAL TABLE") == NULL)
+        {
+            scan = true;
+        }
+    }
+
+    sqlite3_finalize(statement);
+
+    return scan;
+}
+#endif
+
+/**
+ * @brief Returns the cached statement for the given key. The statement is compiled on first use.
+ *
+ * @param key Key of the statement.
+ * @param statement Pointer that receives the statement.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_statement(STORAGE_STATEMENT key, sqlite3_stmt** statement, const byte_t** err)
+{
+    assert(key < STMT_COUNT);
+    assert(STATEMENTS[key].key == key);
+
+    if (sqlite_handle == NULL)
+    {
+        if (err)
+        {
+            *err = "Storage is not opened.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (statement_cache[key] == NULL)
+    {
+        const byte_t* sql = STATEMENTS[key].sql;
+
+        int result = sqlite3_prepare_v3(sqlite_handle, sql, strlen(sql), SQLITE_PREPARE_PERSISTENT, &statement_cache[key], NULL);
+
+        if (result != SQLITE_OK)
+        {
+            storage_set_error(err);
+            return STORAGE_ERROR;
+        }
+
+        assert(STATEMENTS[key].scan || !storage_plan_has_scan(sql));
+    }
+
+    *statement = statement_cache[key];
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Hands a cached statement back, so that it can be reused by the next caller.
+ *
+ * @param statement The statement to release.
+ */
+static void storage_release(sqlite3_stmt* statement)
+{
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+}
+
+/**
+ * @brief Starts a write transaction.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_begin(const byte_t** err)
+{
+    int result = sqlite3_exec(sqlite_handle, "begin immediate", NULL, NULL, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Commits the current transaction.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_commit(const byte_t** err)
+{
+    int result = sqlite3_exec(sqlite_handle, "commit", NULL, NULL, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Rolls back the current transaction, if there is one.
+ *
+ */
+static void storage_rollback()
+{
+    if (sqlite3_get_autocommit(sqlite_handle) == 0)
+    {
+        sqlite3_exec(sqlite_handle, "rollback", NULL, NULL, NULL);
+    }
+}
+
+STORAGE_ERR_CODE storage_init(const byte_t** err)
+{
+    if (initialized == true)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    const byte_t* appdir = env_app_dir();
+
+    size_t storage_file_len = strlen(appdir) + strlen(STORAGE_FILE_NAME) + 1;
+
+    storage_file_path = calloc(storage_file_len, sizeof(byte_t));
+
+    strcat(storage_file_path, appdir);
+    strcat(storage_file_path, STORAGE_FILE_NAME);
+
+    size_t blob_dir_len = strlen(appdir) + strlen(BLOB_DIR_NAME) + 1;
+
+    blob_dir_path = calloc(blob_dir_len, sizeof(byte_t));
+
+    strcat(blob_dir_path, appdir);
+    strcat(blob_dir_path, BLOB_DIR_NAME);
+
+    size_t archive_file_len = strlen(appdir) + strlen(ARCHIVE_FILE_NAME) + 1;
+
+    archive_file_path = calloc(archive_file_len, sizeof(byte_t));
+
+    strcat(archive_file_path, appdir);
+    strcat(archive_file_path, ARCHIVE_FILE_NAME);
+
+    size_t archive_blob_dir_len = archive_file_len + strlen(BACKUP_BLOB_DIR_SUFFIX);
+
+    archive_blob_dir_path = calloc(archive_blob_dir_len, sizeof(byte_t));
+
+    strcat(archive_blob_dir_path, archive_file_path);
+    strcat(archive_blob_dir_path, BACKUP_BLOB_DIR_SUFFIX);
+
+    size_t trash_dir_len = strlen(appdir) + strlen(TRASH_DIR_NAME) + 1;
+
+    trash_dir_path = calloc(trash_dir_len, sizeof(byte_t));
+
+    strcat(trash_dir_path, appdir);
+    strcat(trash_dir_path, TRASH_DIR_NAME);
+
+    initialized = true;
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Creates the basic todo table.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_todo_table()
+{
+    const byte_t* sql = "create table if not exists "
+        "TODOS ("
+        "ID INTEGER"
+        ",TITLE TEXT"
+        ",DETAILS TEXT"
+        ",DONE INTEGER NOT NULL DEFAULT 0 CHECK(DONE = 0 or DONE = 1)"
+        ",CREATED DATE DEFAULT (datetime('now', 'localtime'))"
+        ",primary key(ID autoincrement))";
+
+    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Creates the todo attachment table. Attachments are deleted together with their todo.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_attachment_table()
+{
+    const byte_t* sql = "create table if not exists "
+        "ATTACHMENTS ("
+        "ID INTEGER, "
+        "NAME TEXT NOT NULL, "
+        "TODO_ID INTEGER NOT NULL, "
+        "SIZE INTEGER NOT NULL, "
+        "BLOB_ID INTEGER NOT NULL, "
+        "primary key(ID autoincrement), "
+        "foreign key(TODO_ID) references TODOS(ID) on delete cascade, "
+        "foreign key(BLOB_ID) references BLOBS(ID))";
+
+    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Creates the content-addressed blob store. BLOBS holds hash, size, codec and reference count of every
+ * distinct attachment content, BLOB_DATA the encoded content itself under the same id. Keeping the two apart means
+ * that changing a reference count never rewrites the blob. SIZE is the size of the content, STORED the size after
+ * encoding and ENCODE_US the time the encoding took. BLOB_GARBAGE holds the hashes of deleted file blobs until
+ * their files are removed.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_blob_tables()
+{
+    const byte_t* sql = "create table if not exists "
+        "BLOBS ("
+        "ID INTEGER primary key, "
+        "HASH BLOB NOT NULL UNIQUE, "
+        "SIZE INTEGER NOT NULL, "
+        "REFS INTEGER NOT NULL, "
+        "STORED INTEGER NOT NULL DEFAULT 0, "
+        "CODEC INTEGER NOT NULL DEFAULT 0, "
+        "ENCODE_US INTEGER NOT NULL DEFAULT 0);"
+        "create table if not exists "
+        "BLOB_DATA ("
+        "ID INTEGER primary key, "
+        "CONTENT BLOB NOT NULL);"
+        "create table if not exists "
+        "BLOB_GARBAGE ("
+        "HASH BLOB NOT NULL);";
+
+    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Adds the codec columns to blob stores that were created without them. Their blobs are all raw.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_migrate_blob_table()
+{
+    const byte_t* check_sql = "select 1 from pragma_table_info('BLOBS') where name = 'CODEC'";
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, check_sql, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    result = sqlite3_step(statement);
+    sqlite3_finalize(statement);
+
+    if (result != SQLITE_DONE)
+    {
+        return result == SQLITE_ROW ? SQLITE_OK : result;
+    }
+
+    const byte_t* sql = "alter table BLOBS add column STORED INTEGER NOT NULL DEFAULT 0;"
+        "alter table BLOBS add column CODEC INTEGER NOT NULL DEFAULT 0;"
+        "alter table BLOBS add column ENCODE_US INTEGER NOT NULL DEFAULT 0;"
+        "update BLOBS set STORED = SIZE;";
+
+    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Creates the triggers that count the references to a blob and delete it with its last reference.
+ * Files cannot be removed from within a transaction, so deleted file blobs are queued in BLOB_GARBAGE.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_blob_triggers()
+{
+    const byte_t* sql = "create trigger if not exists ATTACHMENTS_BLOB_INSERT after insert on ATTACHMENTS begin "
+        "update BLOBS set REFS = REFS + 1 where ID = new.BLOB_ID; "
+        "end;"
+        "create trigger if not exists ATTACHMENTS_BLOB_DELETE after delete on ATTACHMENTS begin "
+        "update BLOBS set REFS = REFS - 1 where ID = old.BLOB_ID; "
+        "end;"
+        "create trigger if not exists BLOBS_COLLECT after update of REFS on BLOBS when new.REFS <= 0 begin "
+        "delete from BLOB_DATA where ID = new.ID; "
+        "delete from BLOBS where ID = new.ID; "
+        "end;"
+        "create trigger if not exists BLOBS_COLLECT_FILE after delete on BLOBS when old.CODEC = 2 begin "
+        "insert into BLOB_GARBAGE (HASH) values (old.HASH); "
+        "end;";
+
+    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief SQL function SHA256(X) that returns the SHA-256 digest of a blob. Used to move existing attachments
+ * into the blob store.
+ *
+ * @param context The function context.
+ * @param argc Number of arguments.
+ * @param argv Arguments.
+ */
+static void storage_sha256_function(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    ubyte_t digest[HASH_SHA256_SIZE];
+
+    if (!hash_sha256(sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), digest))
+    {
+        sqlite3_result_error(context, "Could not compute SHA-256.", -1);
+        return;
+    }
+
+    sqlite3_result_blob(context, digest, HASH_SHA256_SIZE, SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Moves the attachments of older databases, which keep the content in the ATTACHMENT column, into the blob
+ * store. Equal contents are stored once.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_migrate_attachment_table()
+{
+    const byte_t* check_sql = "select 1 from pragma_table_info('ATTACHMENTS') where name = 'ATTACHMENT'";
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, check_sql, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    result = sqlite3_step(statement);
+    sqlite3_finalize(statement);
+
+    if (result != SQLITE_ROW)
+    {
+        return result == SQLITE_DONE ? SQLITE_OK : result;
+    }
+
+    result = sqlite3_create_function(sqlite_handle, "SHA256", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+        storage_sha256_function, NULL, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    const byte_t* sql = "alter table ATTACHMENTS rename to ATTACHMENTS_OLD;"
+        "drop index if exists ATTACHMENTS_TODO;"
+        "create table ATTACHMENTS ("
+        "ID INTEGER, "
+        "NAME TEXT NOT NULL, "
+        "TODO_ID INTEGER NOT NULL, "
+        "SIZE INTEGER NOT NULL, "
+        "BLOB_ID INTEGER NOT NULL, "
+        "primary key(ID autoincrement), "
+        "foreign key(TODO_ID) references TODOS(ID) on delete cascade, "
+        "foreign key(BLOB_ID) references BLOBS(ID));"
+        "create temp table ATTACHMENT_HASHES as select ID, SIZE, SHA256(ATTACHMENT) as HASH from ATTACHMENTS_OLD;"
+        "insert into BLOBS (ID, HASH, SIZE, STORED, REFS) select min(ID), HASH, SIZE, SIZE, count(*) from ATTACHMENT_HASHES group by HASH;"
+        "insert into BLOB_DATA (ID, CONTENT) select b.ID, a.ATTACHMENT from BLOBS b join ATTACHMENTS_OLD a on a.ID = b.ID;"
+        "insert into ATTACHMENTS (ID, NAME, TODO_ID, SIZE, BLOB_ID) "
+        "select a.ID, a.NAME, a.TODO_ID, a.SIZE, b.ID from ATTACHMENTS_OLD a "
+        "join ATTACHMENT_HASHES h on h.ID = a.ID join BLOBS b on b.HASH = h.HASH order by a.ID;"
+        "delete from sqlite_sequence where name = 'ATTACHMENTS';"
+        "update sqlite_sequence set name = 'ATTACHMENTS' where name = 'ATTACHMENTS_OLD';"
+        "drop table ATTACHMENT_HASHES;"
+        "drop table ATTACHMENTS_OLD;";
+
+    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    sqlite3_create_function(sqlite_handle, "SHA256", 1, SQLITE_UTF8, NULL, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Recreates attachment tables whose todo reference does not cascade on delete. Must run while
+ * foreign keys are off. The reference counting triggers are dropped with the old table and created again
+ * by storage_create_blob_triggers.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_migrate_attachment_cascade()
+{
+    const byte_t* check_sql = "select 1 from pragma_foreign_key_list('ATTACHMENTS') "
+        "where \"table\" = 'TODOS' and on_delete = 'CASCADE'";
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, check_sql, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    result = sqlite3_step(statement);
+    sqlite3_finalize(statement);
+
+    if (result != SQLITE_DONE)
+    {
+        return result == SQLITE_ROW ? SQLITE_OK : result;
+    }
+
+    const byte_t* sql = "drop trigger if exists ATTACHMENTS_BLOB_INSERT;"
+        "drop trigger if exists ATTACHMENTS_BLOB_DELETE;"
+        "drop index if exists ATTACHMENTS_TODO;"
+        "alter table ATTACHMENTS rename to ATTACHMENTS_OLD;"
+        "create table ATTACHMENTS ("
+        "ID INTEGER, "
+        "NAME TEXT NOT NULL, "
+        "TODO_ID INTEGER NOT NULL, "
+        "SIZE INTEGER NOT NULL, "
+        "BLOB_ID INTEGER NOT NULL, "
+        "primary key(ID autoincrement), "
+        "foreign key(TODO_ID) references TODOS(ID) on delete cascade, "
+        "foreign key(BLOB_ID) references BLOBS(ID));"
+        "insert into ATTACHMENTS (ID, NAME, TODO_ID, SIZE, BLOB_ID) "
+        "select ID, NAME, TODO_ID, SIZE, BLOB_ID from ATTACHMENTS_OLD order by ID;"
+        "delete from sqlite_sequence where name = 'ATTACHMENTS';"
+        "update sqlite_sequence set name = 'ATTACHMENTS' where name = 'ATTACHMENTS_OLD';"
+        "drop table ATTACHMENTS_OLD;";
+
+    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Applies the pragmas of the active profile to the open connection.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_apply_profile()
+{
+    byte_t sql[BUFLEN_PRAGMA] = { 0 };
+
+    snprintf(sql, BUFLEN_PRAGMA,
+        "pragma journal_mode = %s;"
+        "pragma synchronous = %s;"
+        "pragma mmap_size = %lld;"
+        "pragma cache_size = %d;"
+        "pragma temp_store = %s;",
+        active_profile->journal_mode,
+        active_profile->synchronous,
+        active_profile->mmap_size,
+        active_profile->cache_size,
+        active_profile->temp_store);
+
+    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Looks up the profile with the given name.
+ *
+ * @param name Name of the profile.
+ * @return const storage_profile_t* The profile or NULL if there is no profile with that name.
+ */
+static const storage_profile_t* storage_find_profile(const byte_t* name)
+{
+    if (name == NULL)
+    {
+        return NULL;
+    }
+
+    size_t len = sizeof(PROFILES) / sizeof(PROFILES[0]);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (strcmp(name, PROFILES[i].name) == 0)
+        {
+            return &PROFILES[i];
+        }
+    }
+
+    return NULL;
+}
+
+STORAGE_ERR_CODE storage_set_profile(const byte_t* name, const byte_t** err)
+{
+    const storage_profile_t* profile = storage_find_profile(name);
+
+    if (profile == NULL)
+    {
+        if (err)
+        {
+            *err = "Unknown storage profile. Use safe, fast or bulk.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    active_profile = profile;
+
+    if (sqlite_handle == NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    int result = storage_apply_profile();
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+const byte_t* storage_profile()
+{
+    return active_profile->name;
+}
+
+/**
+ * @brief Looks up a storage backend by name.
+ *
+ * @param name Name of the backend.
+ * @return const storage_backend_t* The backend or NULL if there is none with this name.
+ */
+static const storage_backend_t* storage_find_backend(const byte_t* name)
+{
+    size_t len = sizeof(BACKENDS) / sizeof(BACKENDS[0]);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (strcmp(name, BACKENDS[i].name) == 0)
+        {
+            return &BACKENDS[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Creates the indexes used by the todo and attachment queries.
+ * TODOS_DONE answers list open/done in id order. ATTACHMENTS_TODO covers the attachment listing and finds the
+ * attachments of a deleted todo. ATTACHMENTS_BLOB lets the foreign key check find references to a deleted blob.
+ * BLOBS_SIZE tells on ingest whether a file can have a duplicate at all.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_indexes()
+{
+    const byte_t* sql = "create index if not exists TODOS_DONE on TODOS (DONE, ID);"
+        "create index if not exists ATTACHMENTS_TODO on ATTACHMENTS (TODO_ID, ID, NAME, SIZE);"
+        "create index if not exists ATTACHMENTS_BLOB on ATTACHMENTS (BLOB_ID);"
+        "create index if not exists BLOBS_SIZE on BLOBS (SIZE);";
+
+    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Creates the full-text index over title and details together with the triggers that keep it in sync.
+ * An index that is created for an existing database is filled from the todo table.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_search_index()
+{
+    const byte_t* exists_sql = "select 1 from sqlite_master where type = 'table' and name = 'TODOS_FTS'";
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, exists_sql, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    result = sqlite3_step(statement);
+    sqlite3_finalize(statement);
+
+    if (result == SQLITE_ROW)
+    {
+        return SQLITE_OK;
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        return result;
+    }
+
+    const byte_t* sql = "create virtual table TODOS_FTS using fts5("
+        "TITLE, DETAILS, content = 'TODOS', content_rowid = 'ID', prefix = '2 3');"
+        "create trigger TODOS_FTS_INSERT after insert on TODOS begin "
+        "insert into TODOS_FTS (rowid, TITLE, DETAILS) values (new.ID, new.TITLE, new.DETAILS); "
+        "end;"
+        "create trigger TODOS_FTS_DELETE after delete on TODOS begin "
+        "insert into TODOS_FTS (TODOS_FTS, rowid, TITLE, DETAILS) values ('delete', old.ID, old.TITLE, old.DETAILS); "
+        "end;"
+        "create trigger TODOS_FTS_UPDATE after update of TITLE, DETAILS on TODOS begin "
+        "insert into TODOS_FTS (TODOS_FTS, rowid, TITLE, DETAILS) values ('delete', old.ID, old.TITLE, old.DETAILS); "
+        "insert into TODOS_FTS (rowid, TITLE, DETAILS) values (new.ID, new.TITLE, new.DETAILS); "
+        "end;"
+        "insert into TODOS_FTS (TODOS_FTS) values ('rebuild');";
+
+    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+    return result;
+}
+
+/**
+ * @brief Adds what two databases need to exchange changes. UID identifies a todo in every database it is synced
+ * to, MODIFIED is the UTC time of its last change. SYNC_TODOS holds the todos as they were after the last sync,
+ * SYNC_DIRTY the todos that were changed or removed since, so an export never reads all todos. It is keyed by ID
+ * because appending in ID order is much cheaper than inserting random UIDs when many todos change at once.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_sync_tables()
+{
+    const byte_t* sql = "alter table TODOS add column UID TEXT;"
+        "alter table TODOS add column MODIFIED TEXT;"
+        "create unique index TODOS_UID on TODOS (UID);"
+        "create table SYNC_TODOS ("
+        "UID TEXT PRIMARY KEY, TITLE TEXT, DETAILS TEXT, DONE INTEGER, CREATED TEXT, MODIFIED TEXT"
+        ") without rowid;"
+        "create table SYNC_DIRTY (ID INTEGER PRIMARY KEY, UID TEXT NOT NULL);"
+        "create trigger TODOS_SYNC_UPDATE after update of UID, TITLE, DETAILS, DONE on TODOS "
+        "when new.UID is not null begin "
+        "insert or replace into SYNC_DIRTY (ID, UID) values (new.ID, new.UID); "
+        "end;"
+        "create trigger TODOS_SYNC_DELETE after delete on TODOS when old.UID is not null begin "
+        "insert or replace into SYNC_DIRTY (ID, UID) values (old.ID, old.UID); "
+        "end;";
+
+    return sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+}
+
+/**
+ * @brief Creates the change feed. Triggers append an event to CHANGES for every todo and attachment that is added,
+ * changed or removed. AUTOINCREMENT keeps sequence numbers from being reused after pruning. Every FEED_PRUNE_EVERY
+ * events the oldest ones beyond FEED_MAX_EVENTS are dropped, so the feed stays bounded without a separate job.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_change_feed()
+{
+    byte_t sql[BUFLEN_FEED_SQL];
+
+    snprintf(sql, BUFLEN_FEED_SQL,
+        "create table CHANGES ("
+        "SEQ INTEGER PRIMARY KEY AUTOINCREMENT, "
+        "TIME TEXT NOT NULL DEFAULT (strftime('%%Y-%%m-%%d %%H:%%M:%%f', 'now')), "
+        "TABLE_NAME TEXT NOT NULL, OP TEXT NOT NULL, ROW_ID INTEGER NOT NULL, TODO_ID INTEGER);"
+        "create trigger CHANGES_TODOS_INSERT after insert on TODOS begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID) values ('todos', 'insert', new.ID); "
+        "end;"
+        "create trigger CHANGES_TODOS_UPDATE after update of TITLE, DETAILS, DONE on TODOS "
+        "when new.TITLE is not old.TITLE or new.DETAILS is not old.DETAILS or new.DONE is not old.DONE begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID) values ('todos', 'update', new.ID); "
+        "end;"
+        "create trigger CHANGES_TODOS_DELETE after delete on TODOS begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID) values ('todos', 'delete', old.ID); "
+        "end;"
+        "create trigger CHANGES_ATTACHMENTS_INSERT after insert on ATTACHMENTS begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID, TODO_ID) values ('attachments', 'insert', new.ID, new.TODO_ID); "
+        "end;"
+        "create trigger CHANGES_ATTACHMENTS_DELETE after delete on ATTACHMENTS begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID, TODO_ID) values ('attachments', 'delete', old.ID, old.TODO_ID); "
+        "end;"
+        "create trigger CHANGES_PRUNE after insert on CHANGES when new.SEQ %% %d = 0 begin "
+        "delete from CHANGES where SEQ <= new.SEQ - %d; "
+        "end;",
+        FEED_PRUNE_EVERY, FEED_MAX_EVENTS);
+
+    return sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+}
+
+/**
+ * @brief Lets remove and erase leave tombstones that a purge deletes later in small batches. A removed todo gets
+ * DELETED = 1, erase only moves ERASED.UP_TO to the last id, which marks every todo up to it as gone. TODOS_LIVE
+ * replaces TODOS_DONE and leaves tombstones out, TODOS_DELETED lets the purge find them. The sync and feed triggers
+ * record a removal when the tombstone is set, erased todos are recorded when the purge deletes them.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_tombstones()
+{
+    const byte_t* sql = "alter table TODOS add column DELETED INTEGER NOT NULL DEFAULT 0;"
+        "drop index TODOS_DONE;"
+        "create index TODOS_LIVE on TODOS (DONE, ID) where DELETED = 0;"
+        "create index TODOS_DELETED on TODOS (ID) where DELETED = 1;"
+        "create table ERASED (ID INTEGER PRIMARY KEY CHECK (ID = 1), UP_TO INTEGER NOT NULL);"
+        "insert into ERASED (ID, UP_TO) values (1, 0);"
+        "drop trigger TODOS_SYNC_UPDATE;"
+        "create trigger TODOS_SYNC_UPDATE after update of UID, TITLE, DETAILS, DONE, DELETED on TODOS "
+        "when new.UID is not null begin "
+        "insert or replace into SYNC_DIRTY (ID, UID) values (new.ID, new.UID); "
+        "end;"
+        "drop trigger TODOS_SYNC_DELETE;"
+        "create trigger TODOS_SYNC_DELETE after delete on TODOS when old.UID is not null and old.DELETED = 0 begin "
+        "insert or replace into SYNC_DIRTY (ID, UID) values (old.ID, old.UID); "
+        "end;"
+        "drop trigger CHANGES_TODOS_DELETE;"
+        "create trigger CHANGES_TODOS_DELETE after delete on TODOS when old.DELETED = 0 begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID) values ('todos', 'delete', old.ID); "
+        "end;"
+        "create trigger CHANGES_TODOS_TOMBSTONE after update of DELETED on TODOS "
+        "when new.DELETED = 1 and old.DELETED = 0 begin "
+        "insert into CHANGES (TABLE_NAME, OP, ROW_ID) values ('todos', 'delete', new.ID); "
+        "end;"
+        "create trigger ATTACHMENTS_TOMBSTONE before insert on ATTACHMENTS "
+        "when new.TODO_ID <= (select UP_TO from ERASED where ID = 1) "
+        "or (select DELETED from TODOS where ID = new.TODO_ID) = 1 begin "
+        "select raise(ABORT, 'FOREIGN KEY constraint failed'); "
+        "end;";
+
+    return sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+}
+
+/**
+ * @brief Builds the path of the file that holds the blob with given hash in the given directory.
+ *
+ * @param dir The directory, ending with a slash.
+ * @param digest SHA-256 of the blob.
+ * @param suffix Appended to the file name, "" for the blob itself.
+ * @param path Buffer of PATH_MAX bytes that receives the path.
+ */
+static void storage_blob_path_in(const byte_t* dir, const ubyte_t digest[HASH_SHA256_SIZE], const byte_t* suffix, byte_t* path)
+{
+    byte_t hex[2 * HASH_SHA256_SIZE + 1];
+
+    for (size_t i = 0; i < HASH_SHA256_SIZE; i++)
+    {
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    }
+
+    snprintf(path, PATH_MAX, "%s%s%s", dir, hex, suffix);
+}
+
+/**
+ * @brief Builds the path of the file that holds the blob with given hash.
+ *
+ * @param digest SHA-256 of the blob.
+ * @param suffix Appended to the file name, "" for the blob itself.
+ * @param path Buffer of PATH_MAX bytes that receives the path.
+ */
+static void storage_blob_file_path(const ubyte_t digest[HASH_SHA256_SIZE], const byte_t* suffix, byte_t* path)
+{
+    storage_blob_path_in(active_backend->blob_dir(), digest, suffix, path);
+}
+
+/**
+ * @brief Returns the size from which attachments are kept as files in the blob directory. Set through
+ * TOODLES_BLOB_THRESHOLD, BLOB_FILE_THRESHOLD otherwise. Backends without blob directory keep everything in the
+ * database.
+ *
+ * @return sqlite3_int64 Size in bytes.
+ */
+static sqlite3_int64 storage_blob_threshold()
+{
+    if (active_backend->blob_dir() == NULL)
+    {
+        return LLONG_MAX;
+    }
+
+    const byte_t* requested = env_blob_threshold();
+
+    if (requested == NULL || requested[0] == 0)
+    {
+        return BLOB_FILE_THRESHOLD;
+    }
+
+    byte_t* end = NULL;
+    long long threshold = strtoll(requested, &end, 10);
+
+    return *end == 0 && threshold >= 0 ? threshold : BLOB_FILE_THRESHOLD;
+}
+
+/**
+ * @brief Removes the files of the blobs in BLOB_GARBAGE that are not referenced again and empties the queue.
+ * The queue is checked without a transaction first, so that the common case takes no write lock.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_collect_files(const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE status = storage_statement(STMT_SELECT_BLOB_GARBAGE, &statement, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    int result = sqlite3_step(statement);
+
+    if (result != SQLITE_ROW && result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    if (result == SQLITE_DONE)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    status = storage_statement(STMT_SELECT_BLOB_GARBAGE, &statement, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return status;
+    }
+
+    byte_t path[PATH_MAX];
+
+    while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+    {
+        if (sqlite3_column_bytes(statement, 0) != HASH_SHA256_SIZE)
+        {
+            continue;
+        }
+
+        storage_blob_file_path(sqlite3_column_blob(statement, 0), "", path);
+
+        if (unlink(path) != 0 && errno != ENOENT)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            storage_release(statement);
+            storage_rollback();
+            return STORAGE_ERROR;
+        }
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        storage_rollback();
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    status = storage_statement(STMT_DELETE_BLOB_GARBAGE, &statement, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return status;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        storage_rollback();
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    status = storage_commit(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+    }
+
+    return status;
+}
+
+/**
+ * @brief Tells whether there are tombstones, erased todos or erased archives left to purge. Takes no write lock.
+ *
+ * @param pending Receives whether a purge has work to do.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_purge_pending(bool* pending, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE status = storage_statement(STMT_PURGE_PENDING, &statement, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    if (sqlite3_step(statement) != SQLITE_ROW)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    const byte_t* trash = active_backend->trash_dir();
+
+    *pending = sqlite3_column_int(statement, 0) != 0 || (trash != NULL && access(trash, F_OK) == 0);
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Deletes the files and directories below dir, depth first, until the budget is used up.
+ *
+ * @param dir Path of the directory with a trailing slash. Is kept itself.
+ * @param budget Number of entries that may still be deleted. Is decremented for every deleted entry.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_remove_tree(const byte_t* dir, long long* budget, const byte_t** err)
+{
+    DIR* handle = opendir(dir);
+
+    if (handle == NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    STORAGE_ERR_CODE status = STORAGE_NO_ERROR;
+    struct dirent* entry;
+    byte_t path[PATH_MAX];
+
+    while (status == STORAGE_NO_ERROR && *budget > 0 && (entry = readdir(handle)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        struct stat st;
+        snprintf(path, PATH_MAX, "%s%s", dir, entry->d_name);
+
+        if (lstat(path, &st) != 0)
+        {
+            continue;
+        }
+
+        int result = 0;
+
+        if (S_ISDIR(st.st_mode))
+        {
+            snprintf(path, PATH_MAX, "%s%s/", dir, entry->d_name);
+            status = storage_remove_tree(path, budget, err);
+
+            if (status != STORAGE_NO_ERROR || *budget <= 0)
+            {
+                break;
+            }
+
+            result = rmdir(path);
+        }
+        else
+        {
+            result = unlink(path);
+        }
+
+        if (result != 0 && errno != ENOENT)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            status = STORAGE_ERROR;
+        }
+
+        (*budget)--;
+    }
+
+    closedir(handle);
+
+    return status;
+}
+
+/**
+ * @brief Deletes up to PURGE_BATCH_TODOS files and directories of erased archives from the trash directory, and the
+ * trash directory itself once it is empty.
+ *
+ * @param removed Receives the number of deleted files and directories.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_purge_trash(long long* removed, const byte_t** err)
+{
+    *removed = 0;
+
+    const byte_t* trash = active_backend->trash_dir();
+
+    if (trash == NULL || access(trash, F_OK) != 0)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    long long budget = PURGE_BATCH_TODOS;
+    STORAGE_ERR_CODE status = storage_remove_tree(trash, &budget, err);
+
+    *removed = PURGE_BATCH_TODOS - budget;
+
+    if (status == STORAGE_NO_ERROR && budget > 0 && rmdir(trash) != 0 && errno != ENOENT)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    return status;
+}
+
+/**
+ * @brief Deletes up to PURGE_BATCH_TODOS erased and as many removed todos in a transaction of its own, together
+ * with their attachments. Once none are left, the erase mark is cleared and a storage that an erase emptied hands
+ * out ids from 1 again, as a direct erase did. After that, each batch deletes files of erased archives instead.
+ *
+ * @param purged Receives the number of deleted todos, or of deleted archive files once no todos are left.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_purge_batch(long long* purged, const byte_t** err)
+{
+    *purged = 0;
+
+    STORAGE_ERR_CODE status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    sqlite3_stmt* statement;
+    status = storage_statement(STMT_PURGE_TODOS, &statement, err);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        int result = sqlite3_bind_int(statement, 1, PURGE_BATCH_TODOS);
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_step(statement);
+        }
+
+        if (result != SQLITE_DONE)
+        {
+            storage_set_error(err);
+            status = STORAGE_ERROR;
+        }
+        else
+        {
+            *purged = sqlite3_changes(sqlite_handle);
+        }
+
+        storage_release(statement);
+    }
+
+    if (status == STORAGE_NO_ERROR && *purged == 0 && sqlite3_exec(sqlite_handle, SCRIPTS[SCRIPT_PURGE_FINISH].sql, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        storage_set_error(err);
+        status = STORAGE_ERROR;
+    }
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_commit(err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return status;
+    }
+
+    return *purged > 0 ? storage_collect_files(err) : storage_purge_trash(purged, err);
+}
+
+/**
+ * @brief Purges batches until nothing is left or the time is up.
+ *
+ * @param budget_ms Time after which no further batch is started, -1 for no limit.
+ * @param purged Receives the number of deleted todos and archive files. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_purge_for(long long budget_ms, long long* purged, const byte_t** err)
+{
+    bool pending = false;
+    STORAGE_ERR_CODE status = storage_purge_pending(&pending, err);
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long long total = 0;
+
+    while (status == STORAGE_NO_ERROR && pending)
+    {
+        long long batch = 0;
+        status = storage_purge_batch(&batch, err);
+
+        total += batch;
+        pending = batch > 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+
+        if (budget_ms >= 0 && elapsed_ms >= budget_ms)
+        {
+            break;
+        }
+    }
+
+    if (purged != NULL)
+    {
+        *purged = total;
+    }
+
+    return status;
+}
+
+STORAGE_ERR_CODE storage_purge(long long budget_ms, long long* purged, const byte_t** err)
+{
+    if (sqlite_handle == NULL)
+    {
+        if (err)
+        {
+            *err = "Storage is not opened.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    return storage_purge_for(budget_ms, purged, err);
+}
+
+/**
+ * @brief Frees the rows of the read cache and marks it invalid.
+ *
+ */
+static void storage_cache_clear()
+{
+    for (size_t i = 0; i < todo_cache.count; i++)
+    {
+        free((void*)todo_cache.rows[i].title);
+    }
+
+    todo_cache.count = 0;
+    todo_cache.change_count = 0;
+    todo_cache.complete = false;
+    todo_cache.valid = false;
+}
+
+/**
+ * @brief Update hook of the connection. Records which todo rows this process changes, so that the read cache
+ * can read them again.
+ *
+ * @param arg Unused.
+ * @param op Kind of change.
+ * @param database Name of the database.
+ * @param table Name of the changed table.
+ * @param rowid Rowid of the changed row.
+ */
+static void storage_cache_hook(void* arg, int op, const char* database, const char* table, sqlite3_int64 rowid)
+{
+    if (!todo_cache.valid || !todo_cache.complete || strcmp(table, "TODOS") != 0)
+    {
+        return;
+    }
+
+    if (todo_cache.change_count == CACHE_MAX_CHANGES)
+    {
+        todo_cache.valid = false;
+        return;
+    }
+
+    todo_cache.changes[todo_cache.change_count++] = rowid;
+}
+
+/**
+ * @brief Reads PRAGMA data_version, which changes whenever another connection commits to the database.
+ *
+ * @param version Receives the version.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_data_version(sqlite3_int64* version, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_DATA_VERSION, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    if (sqlite3_step(statement) != SQLITE_ROW)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    *version = sqlite3_column_int64(statement, 0);
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Makes room for one more row in the read cache.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_cache_reserve(const byte_t** err)
+{
+    if (todo_cache.count < todo_cache.capacity)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    size_t capacity = todo_cache.capacity == 0 ? 256 : todo_cache.capacity * 2;
+    storage_cached_todo_t* rows = realloc(todo_cache.rows, capacity * sizeof(storage_cached_todo_t));
+
+    if (rows == NULL)
+    {
+        if (err)
+        {
+            *err = "Could not allocate memory.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    todo_cache.rows = rows;
+    todo_cache.capacity = capacity;
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Copies the row the given statement points to into a cached row.
+ *
+ * @param statement Statement that selects ID, TITLE, DETAILS, DONE and CREATED.
+ * @param row Receives the row.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_cache_fill(sqlite3_stmt* statement, storage_cached_todo_t* row, const byte_t** err)
+{
+    const byte_t* title = (const byte_t*)sqlite3_column_text(statement, 1);
+    const byte_t* details = (const byte_t*)sqlite3_column_text(statement, 2);
+    const byte_t* created = (const byte_t*)sqlite3_column_text(statement, 4);
+
+    size_t title_len = title == NULL ? 0 : strlen(title);
+    size_t details_len = details == NULL ? 0 : strlen(details);
+    size_t created_len = created == NULL ? 0 : strlen(created);
+
+    byte_t* text = malloc(title_len + details_len + created_len + 3);
+
+    if (text == NULL)
+    {
+        if (err)
+        {
+            *err = "Could not allocate memory.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    row->id = sqlite3_column_int64(statement, 0);
+    row->done = sqlite3_column_int(statement, 3);
+
+    row->title = text;
+    memcpy(text, title == NULL ? "" : title, title_len + 1);
+    text += title_len + 1;
+
+    row->details = text;
+    memcpy(text, details == NULL ? "" : details, details_len + 1);
+    text += details_len + 1;
+
+    row->created = text;
+    memcpy(text, created == NULL ? "" : created, created_len + 1);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Returns the index of the first cached row whose id is not lower than the given id.
+ *
+ * @param id The id to look for.
+ * @return size_t Index of the row or the number of rows if there is none.
+ */
+static size_t storage_cache_lower_bound(sqlite3_int64 id)
+{
+    size_t low = 0;
+    size_t high = todo_cache.count;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+
+        if (todo_cache.rows[mid].id < id)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * @brief Reads the todo with given id again and inserts, replaces or removes it in the read cache.
+ *
+ * @param id Id of the changed todo.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_cache_reload_row(sqlite3_int64 id, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_CACHE_TODO, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_int64(statement, 1, id);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result != SQLITE_ROW && result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    size_t index = storage_cache_lower_bound(id);
+    bool cached = index < todo_cache.count && todo_cache.rows[index].id == id;
+
+    if (result == SQLITE_DONE)
+    {
+        if (cached)
+        {
+            free((void*)todo_cache.rows[index].title);
+            memmove(&todo_cache.rows[index], &todo_cache.rows[index + 1], (todo_cache.count - index - 1) * sizeof(storage_cached_todo_t));
+            todo_cache.count--;
+        }
+
+        storage_release(statement);
+        return STORAGE_NO_ERROR;
+    }
+
+    storage_cached_todo_t row;
+    STORAGE_ERR_CODE filled = storage_cache_fill(statement, &row, err);
+
+    if (filled == STORAGE_NO_ERROR && !cached)
+    {
+        filled = storage_cache_reserve(err);
+
+        if (filled != STORAGE_NO_ERROR)
+        {
+            free((void*)row.title);
+        }
+    }
+
+    storage_release(statement);
+
+    if (filled != STORAGE_NO_ERROR)
+    {
+        return filled;
+    }
+
+    if (cached)
+    {
+        free((void*)todo_cache.rows[index].title);
+    }
+    else
+    {
+        memmove(&todo_cache.rows[index + 1], &todo_cache.rows[index], (todo_cache.count - index) * sizeof(storage_cached_todo_t));
+        todo_cache.count++;
+    }
+
+    todo_cache.rows[index] = row;
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Makes sure the read cache reflects the todo table. Costs one PRAGMA data_version if nothing changed and
+ * one lookup per row this process changed. The whole table is read again if another process wrote to it. Tables
+ * with more than CACHE_MAX_ROWS rows are not cached.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_cache_refresh(const byte_t** err)
+{
+    sqlite3_int64 version = 0;
+    STORAGE_ERR_CODE checked = storage_data_version(&version, err);
+
+    if (checked != STORAGE_NO_ERROR)
+    {
+        return checked;
+    }
+
+    if (todo_cache.valid && todo_cache.data_version == version)
+    {
+        size_t count = todo_cache.complete ? todo_cache.change_count : 0;
+        todo_cache.change_count = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            STORAGE_ERR_CODE reloaded = storage_cache_reload_row(todo_cache.changes[i], err);
+
+            if (reloaded != STORAGE_NO_ERROR)
+            {
+                storage_cache_clear();
+                return reloaded;
+            }
+        }
+
+        return STORAGE_NO_ERROR;
+    }
+
+    storage_cache_clear();
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_CACHE_TODOS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    // The version is read before the rows, so a commit in between only causes another reload.
+    int result = sqlite3_bind_int(statement, 1, CACHE_MAX_ROWS + 1);
+
+    while (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+
+        if (result != SQLITE_ROW)
+        {
+            break;
+        }
+
+        if (todo_cache.count == CACHE_MAX_ROWS)
+        {
+            storage_cache_clear();
+            storage_release(statement);
+
+            todo_cache.valid = true;
+            todo_cache.data_version = version;
+            return STORAGE_NO_ERROR;
+        }
+
+        STORAGE_ERR_CODE appended = storage_cache_reserve(err);
+
+        if (appended == STORAGE_NO_ERROR)
+        {
+            appended = storage_cache_fill(statement, &todo_cache.rows[todo_cache.count], err);
+        }
+
+        if (appended != STORAGE_NO_ERROR)
+        {
+            storage_cache_clear();
+            storage_release(statement);
+            return appended;
+        }
+
+        todo_cache.count++;
+
+        result = SQLITE_OK;
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_cache_clear();
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    todo_cache.complete = true;
+    todo_cache.valid = true;
+    todo_cache.data_version = version;
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Reads a single value pragma from the open connection.
+ *
+ * @param pragma Name of the pragma.
+ * @param buffer Buffer that receives the value.
+ * @param buflen Size of the buffer.
+ * @return int SQLITE result code.
+ */
+static int storage_read_pragma(const byte_t* pragma, byte_t* buffer, size_t buflen)
+{
+    byte_t sql[BUFLEN_PRAGMA] = { 0 };
+    snprintf(sql, BUFLEN_PRAGMA, "pragma %s", pragma);
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, sql, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result == SQLITE_ROW)
+    {
+        const ubyte_t* value = sqlite3_column_text(statement, 0);
+        snprintf(buffer, buflen, "%s", value == NULL ? "" : (const byte_t*)value);
+        result = SQLITE_OK;
+    }
+    else if (result == SQLITE_DONE)
+    {
+        // The in-memory database has no value for pragmas such as mmap_size.
+        snprintf(buffer, buflen, "-");
+        result = SQLITE_OK;
+    }
+
+    sqlite3_finalize(statement);
+
+    return result;
+}
+
+/**
+ * @brief Reads a pragma that returns a number.
+ *
+ * @param pragma Name of the pragma.
+ * @param value Receives the value.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_pragma_int(const byte_t* pragma, long long* value, const byte_t** err)
+{
+    byte_t buffer[BUFLEN_PRAGMA] = { 0 };
+    int result = storage_read_pragma(pragma, buffer, BUFLEN_PRAGMA);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    *value = strtoll(buffer, NULL, 10);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Creates the todo, attachment and blob tables of a new database.
+ *
+ * @return int SQLITE result code.
+ */
+static int storage_create_tables()
+{
+    int result = storage_create_todo_table();
+
+    if (result == SQLITE_OK)
+    {
+        result = storage_create_attachment_table();
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = storage_create_blob_tables();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Defines a schema migration. Its version is stored in PRAGMA user_version once it has been applied.
+ *
+ */
+typedef struct
+{
+    int version;
+    const byte_t* description;
+
+    /**
+     * @brief Changes the schema inside the running transaction and returns a SQLITE result code.
+     *
+     */
+    int (*apply)();
+
+} storage_migration_t;
+
+/**
+ * @brief Schema migrations in the order they are applied. New migrations are appended with the next version.
+ * Databases from before user_version was used start at 0, so the first migrations check what is already there.
+ *
+ */
+static const storage_migration_t MIGRATIONS[] = {
+
+    {
+        .version = 1,
+        .description = "todo, attachment and blob tables",
+        .apply = storage_create_tables
+    },
+    {
+        .version = 2,
+        .description = "codec columns of the blob store",
+        .apply = storage_migrate_blob_table
+    },
+    {
+        .version = 3,
+        .description = "attachment contents moved into the blob store",
+        .apply = storage_migrate_attachment_table
+    },
+    {
+        .version = 4,
+        .description = "attachments removed with their todo",
+        .apply = storage_migrate_attachment_cascade
+    },
+    {
+        .version = 5,
+        .description = "blob reference counting triggers",
+        .apply = storage_create_blob_triggers
+    },
+    {
+        .version = 6,
+        .description = "indexes for list, attachments and blobs",
+        .apply = storage_create_indexes
+    },
+    {
+        .version = 7,
+        .description = "full-text search index",
+        .apply = storage_create_search_index
+    },
+    {
+        .version = 8,
+        .description = "sync identity and change base",
+        .apply = storage_create_sync_tables
+    },
+    {
+        .version = 9,
+        .description = "change feed",
+        .apply = storage_create_change_feed
+    },
+    {
+        .version = 10,
+        .description = "tombstones and batched purge",
+        .apply = storage_create_tombstones
+    }
+};
+
+/**
+ * @brief Returns the version of the last migration, which is the user_version of an up to date database.
+ *
+ * @return long long The schema version.
+ */
+static long long storage_schema_version()
+{
+    return MIGRATIONS[sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]) - 1].version;
+}
+
+/**
+ * @brief Brings the schema up to the last migration. Costs a single PRAGMA user_version if it is current, otherwise
+ * all pending migrations and the new version are committed in one transaction. Must run while foreign keys are off.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_migrate(const byte_t** err)
+{
+    size_t len = sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]);
+    long long latest = storage_schema_version();
+    long long version = 0;
+
+    STORAGE_ERR_CODE read = storage_pragma_int("user_version", &version, err);
+
+    if (read != STORAGE_NO_ERROR || version == latest)
+    {
+        return read;
+    }
+
+    if (version == 0)
+    {
+        // Only takes effect for a new database. Existing ones are switched by storage_compact.
+        sqlite3_exec(sqlite_handle, "pragma auto_vacuum = incremental", NULL, NULL, NULL);
+    }
+
+    STORAGE_ERR_CODE status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    // Another process may have migrated while this one waited for the lock.
+    status = storage_pragma_int("user_version", &version, err);
+
+    if (status == STORAGE_NO_ERROR && version > latest)
+    {
+        if (err)
+        {
+            *err = "The storage was created by a newer version of toodles.";
+        }
+
+        status = STORAGE_ERROR;
+    }
+
+    for (size_t i = 0; i < len && status == STORAGE_NO_ERROR; i++)
+    {
+        if (MIGRATIONS[i].version <= version)
+        {
+            continue;
+        }
+
+        if (MIGRATIONS[i].apply() != SQLITE_OK)
+        {
+            storage_set_error(err);
+            status = STORAGE_ERROR;
+        }
+    }
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        byte_t sql[BUFLEN_PRAGMA] = { 0 };
+        snprintf(sql, BUFLEN_PRAGMA, "pragma user_version = %lld", latest);
+
+        if (sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL) != SQLITE_OK)
+        {
+            storage_set_error(err);
+            status = STORAGE_ERROR;
+        }
+    }
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_commit(err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+    }
+
+    return status;
+}
+
+STORAGE_ERR_CODE storage_new_storage(const byte_t** err)
+{
+    if (sqlite_handle != NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    const byte_t* backend = env_storage_backend();
+
+    if (backend != NULL && backend[0] != 0)
+    {
+        active_backend = storage_find_backend(backend);
+
+        if (active_backend == NULL)
+        {
+            active_backend = &BACKENDS[0];
+
+            if (err)
+            {
+                *err = "Unknown storage backend, use file or memory.";
+            }
+
+            return STORAGE_CRITICAL_ERROR;
+        }
+    }
+
+    int result = active_backend->open(&sqlite_handle);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+
+        sqlite3_close(sqlite_handle);
+        sqlite_handle = NULL;
+
+        return STORAGE_CRITICAL_ERROR;
+    }
+
+    sqlite3_busy_timeout(sqlite_handle, BUSY_TIMEOUT_MS);
+
+    STORAGE_ERR_CODE migrated = storage_migrate(err);
+
+    if (migrated != STORAGE_NO_ERROR)
+    {
+        return STORAGE_CRITICAL_ERROR;
+    }
+
+    result = sqlite3_exec(sqlite_handle, "pragma foreign_keys = on", NULL, NULL, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_CRITICAL_ERROR;
+    }
+
+    sqlite3_update_hook(sqlite_handle, storage_cache_hook, NULL);
+
+    storage_collect_files(NULL);
+
+    const byte_t* requested = env_storage_profile();
+
+    if (requested != NULL && requested[0] != 0)
+    {
+        return storage_set_profile(requested, err);
+    }
+
+    result = storage_apply_profile();
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_shutdown(const byte_t** err)
+{
+    if (sqlite_handle == NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    STORAGE_ERR_CODE stopped = storage_stop_writer(err);
+
+    for (size_t i = 0; i < STMT_COUNT; i++)
+    {
+        sqlite3_finalize(statement_cache[i]);
+        statement_cache[i] = NULL;
+    }
+
+    free(blob_buffer);
+    blob_buffer = NULL;
+
+    storage_cache_clear();
+    free(todo_cache.rows);
+    todo_cache.rows = NULL;
+    todo_cache.capacity = 0;
+
+    int result = sqlite3_close(sqlite_handle);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    sqlite_handle = NULL;
+    archive_attached = false;
+
+    return stopped;
+}
+
+/**
+ * @brief Copies a write into the queue of the write-behind worker. Waits while the queue is full.
+ *
+ * @param kind Kind of the write.
+ * @param text Title or ids.
+ * @param details Details for WRITE_ADD or NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_enqueue_write(STORAGE_WRITE kind, const byte_t* text, const byte_t* details, const byte_t** err)
+{
+    byte_t* text_copy = strdup(text);
+    byte_t* details_copy = details == NULL ? NULL : strdup(details);
+
+    if (text_copy == NULL || (details != NULL && details_copy == NULL))
+    {
+        free(text_copy);
+        free(details_copy);
+
+        if (err)
+        {
+            *err = "Could not allocate memory.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    pthread_mutex_lock(&writer.mutex);
+
+    while (writer.count == WRITE_QUEUE_LEN)
+    {
+        pthread_cond_wait(&writer.progress, &writer.mutex);
+    }
+
+    storage_write_t* entry = &writer.entries[(writer.head + writer.count) % WRITE_QUEUE_LEN];
+
+    entry->kind = kind;
+    entry->text = text_copy;
+    entry->details = details_copy;
+    writer.count++;
+
+    pthread_cond_signal(&writer.queued);
+    pthread_mutex_unlock(&writer.mutex);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Inserts a todo without checking its title.
+ *
+ * @param title Title of the todo entry.
+ * @param details Detailed information of the todo.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_insert_todo(const byte_t* title, const byte_t* details, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_INSERT_TODO, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_text(statement, 1, title, strlen(title), NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    result = sqlite3_bind_text(statement, 2, details, details == NULL ? 0 : strlen(details), NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_new_todo(const byte_t* title, const byte_t* details, const byte_t** err)
+{
+    if (!title || title[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide a title.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (writer.write_behind)
+    {
+        return storage_enqueue_write(WRITE_ADD, title, details, err);
+    }
+
+    return storage_insert_todo(title, details, err);
+}
+
+/**
+ * @brief Prints the todo row the given statement currently points to.
+ *
+ * @param statement Statement that selects ID, TITLE, DONE and CREATED.
+ */
+static void storage_print_todo_row(sqlite3_stmt* statement)
+{
+    const ubyte_t* id = sqlite3_column_text(statement, 0);
+    const ubyte_t* title = sqlite3_column_text(statement, 1);
+    int done = sqlite3_column_int(statement, 2);
+    const ubyte_t* created = sqlite3_column_text(statement, 3) == NULL ? (ubyte_t*)"" : sqlite3_column_text(statement, 3);
+
+    printf(CYAN("%-16s") "%-64s%-16s%-24s\n", id, title, done == 0 ? CROSS_MARK : CHECK_MARK, created);
+}
+
+/**
+ * @brief Prints one page of todo rows from the read cache, like storage_print_todos_page.
+ *
+ * @param option Which entries to print.
+ * @param after Cursor of the previous page or 0 for the first page.
+ * @param limit Maximum number of entries or -1 for all remaining entries.
+ * @param next Receives the cursor for the next page or 0 if this was the last page. Can be NULL.
+ */
+static void storage_print_cached_page(STORAGE_PRINT_OPTIONS option, long long after, int limit, long long* next)
+{
+    int count = 0;
+    long long last_id = after;
+
+    for (size_t i = storage_cache_lower_bound(after + 1); i < todo_cache.count; i++)
+    {
+        const storage_cached_todo_t* row = &todo_cache.rows[i];
+
+        if ((option == DONE && row->done == 0) || (option == OPEN && row->done != 0))
+        {
+            continue;
+        }
+
+        if (count == limit)
+        {
+            if (next)
+            {
+                *next = last_id;
+            }
+
+            break;
+        }
+
+        printf(CYAN("%-16lld") "%-64s%-16s%-24s\n", row->id, row->title, row->done == 0 ? CROSS_MARK : CHECK_MARK, row->created);
+
+        last_id = row->id;
+        count++;
+    }
+}
+
+STORAGE_ERR_CODE storage_print_todos(STORAGE_PRINT_OPTIONS option, const byte_t** err)
+{
+    return storage_print_todos_page(option, 0, -1, NULL, err);
+}
+
+/**
+ * @brief Prints one page of entries with one of the page statements.
+ *
+ * @param key The page statement.
+ * @param after Cursor returned for the previous page or 0 for the first page.
+ * @param limit Maximum number of entries on the page or -1 for all remaining entries.
+ * @param next Receives the cursor for the next page or 0 if this was the last page. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_print_page(STORAGE_STATEMENT key, long long after, int limit, long long* next, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(key, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_int64(statement, 1, after);
+
+    if (result == SQLITE_OK)
+    {
+        // One row more than requested tells if there is a next page.
+        result = sqlite3_bind_int(statement, 2, limit < 0 ? -1 : limit + 1);
+    }
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    printf(MAGENTA("%-16s%-64s%-16s%-16s\n"), "Id", "Title", "Done", "Created");
+
+    int count = 0;
+    long long last_id = after;
+
+    while (1)
+    {
+        int rc = sqlite3_step(statement);
+
+        if (rc == SQLITE_ROW)
+        {
+            if (count == limit)
+            {
+                if (next)
+                {
+                    *next = last_id;
+                }
+
+                break;
+            }
+
+            storage_print_todo_row(statement);
+
+            last_id = sqlite3_column_int64(statement, 0);
+            count++;
+            continue;
+        }
+
+        if (rc == SQLITE_DONE)
+        {
+            break;
+        }
+
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_print_todos_page(STORAGE_PRINT_OPTIONS option, long long after, int limit, long long* next, const byte_t** err)
+{
+    STORAGE_STATEMENT key = STMT_PAGE_TODOS_ALL;
+
+    switch (option)
+    {
+    case ALL:
+        break;
+    case DONE:
+        key = STMT_PAGE_TODOS_DONE;
+        break;
+    case OPEN:
+        key = STMT_PAGE_TODOS_OPEN;
+        break;
+    }
+
+    if (next)
+    {
+        *next = 0;
+    }
+
+    STORAGE_ERR_CODE refreshed = storage_cache_refresh(err);
+
+    if (refreshed != STORAGE_NO_ERROR)
+    {
+        return refreshed;
+    }
+
+    if (todo_cache.complete)
+    {
+        printf(MAGENTA("%-16s%-64s%-16s%-16s\n"), "Id", "Title", "Done", "Created");
+        storage_print_cached_page(option, after, limit, next);
+        return STORAGE_NO_ERROR;
+    }
+
+    return storage_print_page(key, after, limit, next, err);
+}
+
+/**
+ * @brief Attaches the archive database as schema "archive" and creates its tables and the temp view ALL_TODOS,
+ * which is the union of the todos in both databases. Archived todos keep their id, which is never given out again.
+ * A todo that is in both databases was not moved completely, the view shows the one in the storage.
+ *
+ * @param create Whether a missing archive is created.
+ * @param attached Receives whether the archive is attached. False if it does not exist and create is false.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_attach_archive(bool create, bool* attached, const byte_t** err)
+{
+    *attached = archive_attached;
+
+    if (archive_attached)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    const byte_t* location = active_backend->archive();
+
+    if (!create && strcmp(location, ":memory:") != 0 && access(location, F_OK) != 0)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    // A memory archive is empty until something is archived, so it is only attached on demand.
+    if (!create && strcmp(location, ":memory:") == 0)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, "attach database ? as archive", -1, &statement, NULL);
+
+    if (result == SQLITE_OK)
+    {
+        sqlite3_bind_text(statement, 1, location, -1, NULL);
+        result = sqlite3_step(statement) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(sqlite_handle);
+    }
+
+    sqlite3_finalize(statement);
+
+    // In WAL mode a transaction over both databases is not atomic, so storage_archive only removes a todo from the
+    // storage once its copy in the archive is committed.
+    byte_t pragmas[BUFLEN_PRAGMA] = { 0 };
+
+    snprintf(pragmas, BUFLEN_PRAGMA,
+        "pragma archive.journal_mode = %s;"
+        "pragma archive.synchronous = %s;",
+        active_profile->journal_mode,
+        active_profile->synchronous);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_exec(sqlite_handle, pragmas, NULL, NULL, NULL);
+    }
+
+    const byte_t* sql = "create table if not exists archive.TODOS ("
+        "ID INTEGER PRIMARY KEY, TITLE TEXT, DETAILS TEXT, DONE INTEGER NOT NULL, CREATED DATE, "
+        "UID TEXT, MODIFIED TEXT, ARCHIVED TEXT NOT NULL);"
+        "create index if not exists archive.TODOS_DONE on TODOS (DONE, ID);"
+        "create table if not exists archive.ATTACHMENTS ("
+        "ID INTEGER PRIMARY KEY, NAME TEXT NOT NULL, TODO_ID INTEGER NOT NULL, SIZE INTEGER NOT NULL, "
+        "BLOB_ID INTEGER NOT NULL);"
+        "create index if not exists archive.ATTACHMENTS_TODO on ATTACHMENTS (TODO_ID, ID, NAME, SIZE);"
+        "create table if not exists archive.BLOBS ("
+        "ID INTEGER PRIMARY KEY, HASH BLOB NOT NULL UNIQUE, SIZE INTEGER NOT NULL, STORED INTEGER NOT NULL, "
+        "CODEC INTEGER NOT NULL);"
+        "create table if not exists archive.BLOB_DATA (ID INTEGER PRIMARY KEY, CONTENT BLOB NOT NULL);"
+        "create temp view if not exists ALL_TODOS as "
+        "select ID, TITLE, DETAILS, DONE, CREATED from main.TODOS where " TODO_ALIVE("TODOS") " "
+        "union all select ID, TITLE, DETAILS, DONE, CREATED from archive.TODOS a "
+        "where not exists (select 1 from main.TODOS t where t.ID = a.ID);";
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+    }
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        sqlite3_exec(sqlite_handle, "detach database archive", NULL, NULL, NULL);
+        return STORAGE_ERROR;
+    }
+
+    archive_attached = true;
+    *attached = true;
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Files of an erased archive that were moved into the trash directory, so that the move can be undone.
+ *
+ */
+typedef struct
+{
+    byte_t dir[PATH_MAX];
+    byte_t from[PURGE_TRASH_MOVES][PATH_MAX];
+    byte_t to[PURGE_TRASH_MOVES][PATH_MAX];
+    size_t count;
+} storage_trash_t;
+
+/**
+ * @brief Moves the archive database, its journal files and its blob directory into a new directory below the trash
+ * directory. These are a few renames no matter how much was archived, the purge deletes the files later. The
+ * archive must be detached.
+ *
+ * @param trash Receives what was moved. Filled as far as the move got if it fails.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_trash_archive(storage_trash_t* trash, const byte_t** err)
+{
+    const byte_t* trash_dir = active_backend->trash_dir();
+
+    if (trash_dir == NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    const byte_t* location = active_backend->archive();
+    const byte_t* blob_dir = active_backend->archive_blob_dir();
+    const byte_t* suffixes[] = { "", "-wal", "-shm", "-journal" };
+
+    byte_t paths[PURGE_TRASH_MOVES][PATH_MAX];
+    size_t count = 0;
+
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++)
+    {
+        snprintf(paths[count], PATH_MAX, "%s%s", location, suffixes[i]);
+        count += access(paths[count], F_OK) == 0;
+    }
+
+    // rename takes the directory without its trailing slash.
+    snprintf(paths[count], PATH_MAX, "%.*s", (int)strlen(blob_dir) - 1, blob_dir);
+    count += access(paths[count], F_OK) == 0;
+
+    if (count == 0)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    snprintf(trash->dir, PATH_MAX, "%serase-XXXXXX", trash_dir);
+
+    if ((mkdir(trash_dir, S_IRWXU | S_IRWXG) != 0 && errno != EEXIST) || mkdtemp(trash->dir) == NULL)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        trash->dir[0] = 0;
+        return STORAGE_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        snprintf(trash->from[i], PATH_MAX, "%s", paths[i]);
+        snprintf(trash->to[i], PATH_MAX, "%s%s", trash->dir, strrchr(paths[i], '/'));
+
+        if (rename(trash->from[i], trash->to[i]) != 0)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            return STORAGE_ERROR;
+        }
+
+        trash->count = i + 1;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Moves the files of a failed erase back out of the trash directory.
+ *
+ * @param trash What storage_trash_archive moved.
+ */
+static void storage_untrash_archive(const storage_trash_t* trash)
+{
+    for (size_t i = trash->count; i > 0; i--)
+    {
+        rename(trash->to[i - 1], trash->from[i - 1]);
+    }
+
+    if (trash->dir[0] != 0)
+    {
+        rmdir(trash->dir);
+    }
+}
+
+STORAGE_ERR_CODE storage_erase(const byte_t** err)
+{
+    if (sqlite_handle == NULL)
+    {
+        if (err)
+        {
+            *err = "Storage is not opened.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    // The archive is moved away as a whole, which SQLite only allows for a detached database outside a transaction.
+    if (archive_attached)
+    {
+        if (sqlite3_exec(sqlite_handle, "detach database archive", NULL, NULL, NULL) != SQLITE_OK)
+        {
+            storage_set_error(err);
+            return STORAGE_ERROR;
+        }
+
+        archive_attached = false;
+    }
+
+    // The mark hides rows without touching them, so the update hook does not see it.
+    storage_cache_clear();
+
+    STORAGE_ERR_CODE status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    // Moving the erase mark hides every todo at once. The purge deletes them, their attachments and blobs later.
+    if (sqlite3_exec(sqlite_handle, SCRIPTS[SCRIPT_ERASE].sql, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_rollback();
+        return STORAGE_ERROR;
+    }
+
+    // The archive goes inside the transaction, so that either both are erased or neither is.
+    storage_trash_t trash = { 0 };
+    status = storage_trash_archive(&trash, err);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_commit(err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        storage_untrash_archive(&trash);
+        return status;
+    }
+
+    if (writer.running)
+    {
+        pthread_mutex_lock(&writer.mutex);
+        writer.purging = true;
+        pthread_mutex_unlock(&writer.mutex);
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Turns free text into an FTS5 query. Every word becomes a quoted prefix term, so that operators and
+ * special characters in the search text are taken literally.
+ *
+ * @param search_str The search text.
+ * @param query Buffer that receives the query. Must hold at least 6 * strlen(search_str) + 1 bytes.
+ */
+static void storage_build_match_query(const byte_t* search_str, byte_t* query)
+{
+    byte_t* w = query;
+    bool in_word = false;
+
+    for (const byte_t* c = search_str; *c != 0; c++)
+    {
+        if (*c == ' ' || *c == '\t')
+        {
+            if (in_word)
+            {
+                *w++ = '"';
+                *w++ = '*';
+                in_word = false;
+            }
+
+            continue;
+        }
+
+        if (!in_word)
+        {
+            if (w != query)
+            {
+                *w++ = ' ';
+            }
+
+            *w++ = '"';
+            in_word = true;
+        }
+
+        if (*c == '"')
+        {
+            *w++ = '"';
+        }
+
+        *w++ = *c;
+    }
+
+    if (in_word)
+    {
+        *w++ = '"';
+        *w++ = '*';
+    }
+
+    *w = 0;
+}
+
+STORAGE_ERR_CODE storage_print_search_results(const byte_t* search_str, const byte_t** err)
+{
+    size_t query_len = (search_str == NULL ? 0 : strlen(search_str)) * 6 + 1;
+    byte_t query[query_len];
+
+    storage_build_match_query(search_str == NULL ? "" : search_str, query);
+
+    if (query[0] == 0)
+    {
+        return storage_print_todos(ALL, err);
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_SEARCH_TODOS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    printf(MAGENTA("%-16s%-64s%-16s%-16s\n"), "Id", "Title", "Done", "Created");
+
+    int result = sqlite3_bind_text(statement, 1, query, strlen(query), NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    while (1)
+    {
+        int rc = sqlite3_step(statement);
+
+        if (rc == SQLITE_ROW)
+        {
+            storage_print_todo_row(statement);
+
+            const byte_t* snippet = (const byte_t*)sqlite3_column_text(statement, 4);
+
+            if (snippet != NULL && strstr(snippet, "\033[1;33m") != NULL)
+            {
+                printf("%-16s", "");
+
+                for (const byte_t* c = snippet; *c != 0; c++)
+                {
+                    putchar(*c == '\n' ? ' ' : *c);
+                }
+
+                printf("\n");
+            }
+
+            continue;
+        }
+
+        if (rc == SQLITE_DONE)
+        {
+            break;
+        }
+
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Runs a cached statement that takes the given id as its only parameter and returns no rows.
+ *
+ * @param key Key of the statement.
+ * @param id The id to bind.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_exec_for_id(STORAGE_STATEMENT key, const byte_t* id, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(key, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Reads the next id or range of ids from a list like "4,7,10-250" or "3 5 9".
+ *
+ * @param cursor Position in the list, moved past the returned item.
+ * @param first Receives the first id of the item.
+ * @param last Receives the last id of the item, which equals first for a single id.
+ * @return int 1 if an item was read, 0 at the end of the list and -1 if the list is invalid.
+ */
+static int storage_next_ids(const byte_t** cursor, sqlite3_int64* first, sqlite3_int64* last)
+{
+    const byte_t* p = *cursor;
+
+    while (*p == ',' || isspace((ubyte_t)*p))
+    {
+        p++;
+    }
+
+    if (*p == 0)
+    {
+        *cursor = p;
+        return 0;
+    }
+
+    if (!isdigit((ubyte_t)*p))
+    {
+        return -1;
+    }
+
+    byte_t* end = NULL;
+    *first = strtoll(p, &end, 10);
+    *last = *first;
+
+    if (*end == '-')
+    {
+        if (!isdigit((ubyte_t)end[1]))
+        {
+            return -1;
+        }
+
+        *last = strtoll(end + 1, &end, 10);
+    }
+
+    if ((*end != 0 && *end != ',' && !isspace((ubyte_t)*end)) || *last < *first)
+    {
+        return -1;
+    }
+
+    *cursor = end;
+
+    return 1;
+}
+
+/**
+ * @brief Checks a list of ids before it is used.
+ *
+ * @param ids The list of ids.
+ * @param single Receives true if the list names exactly one id. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_check_ids(const byte_t* ids, bool* single, const byte_t** err)
+{
+    sqlite3_int64 first = 0;
+    sqlite3_int64 last = 0;
+    size_t items = 0;
+    int next = 0;
+
+    while (ids != NULL && (next = storage_next_ids(&ids, &first, &last)) == 1)
+    {
+        items++;
+    }
+
+    if (ids != NULL && next == -1)
+    {
+        if (err)
+        {
+            *err = "Please provide ids like 4,7,10-250.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (items == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (single != NULL)
+    {
+        *single = items == 1 && first == last;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Runs the statement with given key once for every id or range in the list, without starting a transaction.
+ * The statement takes the first and last id of a range.
+ *
+ * @param key Key of the statement.
+ * @param ids List of ids like "4,7,10-250".
+ * @param affected Receives the number of changed rows. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_step_for_ids(STORAGE_STATEMENT key, const byte_t* ids, size_t* affected, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE status = storage_statement(key, &statement, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    sqlite3_int64 first = 0;
+    sqlite3_int64 last = 0;
+    size_t changes = 0;
+
+    while (storage_next_ids(&ids, &first, &last) == 1)
+    {
+        int result = sqlite3_bind_int64(statement, 1, first);
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_bind_int64(statement, 2, last);
+        }
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_step(statement);
+        }
+
+        if (result != SQLITE_DONE)
+        {
+            storage_set_error(err);
+            storage_release(statement);
+            return STORAGE_ERROR;
+        }
+
+        changes += sqlite3_changes(sqlite_handle);
+        sqlite3_reset(statement);
+    }
+
+    storage_release(statement);
+
+    if (affected != NULL)
+    {
+        *affected = changes;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Runs the statement with given key once for every id or range in the list. All runs share one transaction,
+ * so a list costs a single commit.
+ *
+ * @param key Key of the statement.
+ * @param ids List of ids like "4,7,10-250".
+ * @param affected Receives the number of changed rows. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_exec_for_ids(STORAGE_STATEMENT key, const byte_t* ids, size_t* affected, const byte_t** err)
+{
+    STORAGE_ERR_CODE status = storage_check_ids(ids, NULL, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    size_t changes = 0;
+    status = storage_step_for_ids(key, ids, &changes, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return status;
+    }
+
+    status = storage_commit(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return status;
+    }
+
+    if (affected != NULL)
+    {
+        *affected = changes;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Checks a list of ids and hands it to the write-behind worker.
+ *
+ * @param kind Kind of the write.
+ * @param ids List of ids like "4,7,10-250".
+ * @param affected Set to 0, since the number of changed rows is not known yet. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_enqueue_ids(STORAGE_WRITE kind, const byte_t* ids, size_t* affected, const byte_t** err)
+{
+    STORAGE_ERR_CODE status = storage_check_ids(ids, NULL, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    if (affected != NULL)
+    {
+        *affected = 0;
+    }
+
+    return storage_enqueue_write(kind, ids, NULL, err);
+}
+
+STORAGE_ERR_CODE storage_remove_todo(const byte_t* ids, size_t* affected, const byte_t** err)
+{
+    if (writer.write_behind)
+    {
+        return storage_enqueue_ids(WRITE_REMOVE, ids, affected, err);
+    }
+
+    // Only sets the tombstones, storage_purge deletes the todos and their attachments later.
+    return storage_exec_for_ids(STMT_TOMBSTONE_TODO, ids, affected, err);
+}
+
+STORAGE_ERR_CODE storage_print_details(const byte_t* ids, const byte_t** err)
+{
+    bool single = false;
+    STORAGE_ERR_CODE checked = storage_check_ids(ids, &single, err);
+
+    if (checked != STORAGE_NO_ERROR)
+    {
+        return checked;
+    }
+
+    STORAGE_ERR_CODE refreshed = storage_cache_refresh(err);
+
+    if (refreshed != STORAGE_NO_ERROR)
+    {
+        return refreshed;
+    }
+
+    sqlite3_int64 first = 0;
+    sqlite3_int64 last = 0;
+
+    if (todo_cache.complete)
+    {
+        while (storage_next_ids(&ids, &first, &last) == 1)
+        {
+            for (size_t i = storage_cache_lower_bound(first); i < todo_cache.count && todo_cache.rows[i].id <= last; i++)
+            {
+                if (!single)
+                {
+                    printf(CYAN("%-16lld") "%s\n", todo_cache.rows[i].id, todo_cache.rows[i].title);
+                }
+
+                printf("%s\n", todo_cache.rows[i].details);
+            }
+        }
+
+        return STORAGE_NO_ERROR;
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_SELECT_DETAILS_RANGE, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    while (storage_next_ids(&ids, &first, &last) == 1)
+    {
+        int result = sqlite3_bind_int64(statement, 1, first);
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_bind_int64(statement, 2, last);
+        }
+
+        while (result == SQLITE_OK)
+        {
+            result = sqlite3_step(statement);
+
+            if (result != SQLITE_ROW)
+            {
+                break;
+            }
+
+            const ubyte_t* details = sqlite3_column_text(statement, 2) == NULL ? (ubyte_t*)"" : sqlite3_column_text(statement, 2);
+
+            if (!single)
+            {
+                printf(CYAN("%-16s") "%s\n", sqlite3_column_text(statement, 0), sqlite3_column_text(statement, 1));
+            }
+
+            printf("%s\n", details);
+            result = SQLITE_OK;
+        }
+
+        if (result != SQLITE_DONE)
+        {
+            storage_set_error(err);
+            storage_release(statement);
+            return STORAGE_ERROR;
+        }
+
+        sqlite3_reset(statement);
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_set_done(const byte_t* ids, STORAGE_DONE_FLAG done, size_t* affected, const byte_t** err)
+{
+    STORAGE_STATEMENT key = STMT_SET_DONE;
+
+    switch (done)
+    {
+    case STORAGE_OPEN:
+        key = STMT_SET_OPEN;
+        break;
+
+    case STORAGE_DONE:
+    default:
+        break;
+    }
+
+    if (writer.write_behind)
+    {
+        return storage_enqueue_ids(key == STMT_SET_OPEN ? WRITE_OPEN : WRITE_DONE, ids, affected, err);
+    }
+
+    return storage_exec_for_ids(key, ids, affected, err);
+}
+
+/**
+ * @brief Applies one queued write inside the running transaction.
+ *
+ * @param write The write.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_apply_write(const storage_write_t* write, const byte_t** err)
+{
+    switch (write->kind)
+    {
+    case WRITE_ADD:
+        return storage_insert_todo(write->text, write->details, err);
+
+    case WRITE_DONE:
+        return storage_step_for_ids(STMT_SET_DONE, write->text, NULL, err);
+
+    case WRITE_OPEN:
+        return storage_step_for_ids(STMT_SET_OPEN, write->text, NULL, err);
+
+    case WRITE_REMOVE:
+        return storage_step_for_ids(STMT_TOMBSTONE_TODO, write->text, NULL, err);
+    }
+
+    return STORAGE_ERROR;
+}
+
+/**
+ * @brief Applies a batch of queued writes in one transaction. Every write runs in its own savepoint, so a failing
+ * write does not undo the others.
+ *
+ * @param batch The writes. Their strings are freed.
+ * @param count Number of writes.
+ * @param error Receives the message of the first failure.
+ * @return size_t Number of writes that failed.
+ */
+static size_t storage_write_batch(storage_write_t* batch, size_t count, byte_t* error)
+{
+    const byte_t* err = NULL;
+    STORAGE_ERR_CODE status = storage_begin(&err);
+
+    size_t failed = 0;
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        snprintf(error, BUFLEN_ERROR_MESSAGE, "%s", err);
+        failed = count;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (status == STORAGE_NO_ERROR)
+        {
+            STORAGE_ERR_CODE applied = STORAGE_ERROR;
+            int result = sqlite3_exec(sqlite_handle, "savepoint WRITE", NULL, NULL, NULL);
+
+            if (result == SQLITE_OK)
+            {
+                applied = storage_apply_write(&batch[i], &err);
+            }
+            else
+            {
+                storage_set_error(&err);
+            }
+
+            if (applied == STORAGE_NO_ERROR)
+            {
+                sqlite3_exec(sqlite_handle, "release WRITE", NULL, NULL, NULL);
+            }
+            else
+            {
+                if (failed++ == 0)
+                {
+                    snprintf(error, BUFLEN_ERROR_MESSAGE, "%s", err);
+                }
+
+                sqlite3_exec(sqlite_handle, "rollback to WRITE; release WRITE", NULL, NULL, NULL);
+            }
+        }
+
+        free(batch[i].text);
+        free(batch[i].details);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return failed;
+    }
+
+    status = storage_commit(&err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        snprintf(error, BUFLEN_ERROR_MESSAGE, "%s", err);
+        storage_rollback();
+        return count;
+    }
+
+    return failed;
+}
+
+/**
+ * @brief Main function of the write-behind worker. Takes everything that queued up while the previous batch
+ * was committed, so writes that arrive during a slow fsync share the next commit.
+ *
+ * @param arg Unused.
+ * @return void* NULL.
+ */
+static void* storage_writer_main(void* arg)
+{
+    storage_write_t batch[WRITE_QUEUE_LEN];
+    byte_t error[BUFLEN_ERROR_MESSAGE] = { 0 };
+
+    pthread_mutex_lock(&writer.mutex);
+
+    while (1)
+    {
+        while (writer.count == 0 && !writer.stopping && (!writer.purging || writer.paused))
+        {
+            pthread_cond_wait(&writer.queued, &writer.mutex);
+        }
+
+        if (writer.count == 0 && writer.stopping)
+        {
+            break;
+        }
+
+        if (writer.count == 0)
+        {
+            writer.busy = true;
+            pthread_mutex_unlock(&writer.mutex);
+
+            long long purged = 0;
+            STORAGE_ERR_CODE purge_status = storage_purge_batch(&purged, NULL);
+
+            pthread_mutex_lock(&writer.mutex);
+
+            // A failed batch is tried again after the next removal.
+            writer.purging = purge_status == STORAGE_NO_ERROR && purged > 0;
+            writer.busy = false;
+
+            pthread_cond_broadcast(&writer.progress);
+            continue;
+        }
+
+        size_t count = writer.count;
+        bool removed = false;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            batch[i] = writer.entries[(writer.head + i) % WRITE_QUEUE_LEN];
+            removed = removed || batch[i].kind == WRITE_REMOVE;
+        }
+
+        writer.head = (writer.head + count) % WRITE_QUEUE_LEN;
+        writer.count = 0;
+        writer.busy = true;
+
+        pthread_cond_broadcast(&writer.progress);
+        pthread_mutex_unlock(&writer.mutex);
+
+        size_t failed = storage_write_batch(batch, count, error);
+
+        pthread_mutex_lock(&writer.mutex);
+
+        if (failed > 0 && writer.failed == 0)
+        {
+            memcpy(writer.error, error, BUFLEN_ERROR_MESSAGE);
+        }
+
+        writer.failed += failed;
+        writer.purging = writer.purging || removed;
+        writer.busy = false;
+
+        pthread_cond_broadcast(&writer.progress);
+    }
+
+    pthread_mutex_unlock(&writer.mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief Starts the worker thread. It purges removed todos whenever it is idle and, with write-behind, applies the
+ * queued writes.
+ *
+ * @param write_behind Whether writes are queued from now on.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_start_worker(bool write_behind, const byte_t** err)
+{
+    if (writer.running)
+    {
+        writer.write_behind = writer.write_behind || write_behind;
+        return STORAGE_NO_ERROR;
+    }
+
+    if (sqlite_handle == NULL)
+    {
+        if (err)
+        {
+            *err = "Storage is not opened.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (sqlite3_threadsafe() == 0)
+    {
+        if (err)
+        {
+            *err = "SQLite was built without thread support.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    int result = pthread_create(&writer.thread, NULL, storage_writer_main, NULL);
+
+    if (result != 0)
+    {
+        if (err)
+        {
+            *err = strerror(result);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    writer.running = true;
+    writer.write_behind = write_behind;
+
+    // Tombstones left by earlier runs are purged as soon as the prompt is idle.
+    pthread_mutex_lock(&writer.mutex);
+    writer.purging = true;
+    writer.paused = false;
+    pthread_cond_signal(&writer.queued);
+    pthread_mutex_unlock(&writer.mutex);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_start_writer(const byte_t** err)
+{
+    return storage_start_worker(true, err);
+}
+
+STORAGE_ERR_CODE storage_start_purger(const byte_t** err)
+{
+    return storage_start_worker(false, err);
+}
+
+bool storage_write_behind()
+{
+    return writer.write_behind;
+}
+
+STORAGE_ERR_CODE storage_flush(const byte_t** err)
+{
+    if (!writer.running)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    pthread_mutex_lock(&writer.mutex);
+
+    // Pausing first keeps the worker from starting another purge batch while this waits.
+    writer.paused = true;
+
+    while (writer.count > 0 || writer.busy)
+    {
+        pthread_cond_wait(&writer.progress, &writer.mutex);
+    }
+
+    size_t failed = writer.failed;
+
+    if (failed > 0)
+    {
+        snprintf(error_message, BUFLEN_ERROR_MESSAGE, "%zu queued %s failed: %.400s", failed,
+            failed == 1 ? "write" : "writes", writer.error);
+    }
+
+    writer.failed = 0;
+
+    pthread_mutex_unlock(&writer.mutex);
+
+    if (failed > 0)
+    {
+        if (err)
+        {
+            *err = error_message;
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+void storage_resume_purge()
+{
+    if (!writer.running)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&writer.mutex);
+    writer.paused = false;
+    pthread_cond_signal(&writer.queued);
+    pthread_mutex_unlock(&writer.mutex);
+}
+
+STORAGE_ERR_CODE storage_stop_writer(const byte_t** err)
+{
+    if (!writer.running)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    STORAGE_ERR_CODE flushed = storage_flush(err);
+
+    pthread_mutex_lock(&writer.mutex);
+    writer.stopping = true;
+    pthread_cond_signal(&writer.queued);
+    pthread_mutex_unlock(&writer.mutex);
+
+    pthread_join(writer.thread, NULL);
+
+    writer.running = false;
+    writer.stopping = false;
+    writer.write_behind = false;
+
+    return flushed;
+}
+
+/**
+ * @brief Returns the buffer used for copying attachments and allocates it on first use.
+ *
+ * @param err Pointer to error message.
+ * @return byte_t* The buffer or NULL if it could not be allocated.
+ */
+static byte_t* storage_blob_buffer(const byte_t** err)
+{
+    if (blob_buffer == NULL)
+    {
+        blob_buffer = malloc(2 * BUFLEN_BLOB_CHUNK);
+    }
+
+    if (blob_buffer == NULL && err)
+    {
+        *err = "Could not allocate memory.";
+    }
+
+    return blob_buffer;
+}
+
+/**
+ * @brief SIGBUS handler while a file is mapped. A fault inside the mapping is answered with a page of zeros, so the
+ * access that raised it and every later one read zeros instead of the file, and the attach fails before it commits.
+ * Any other fault gets the default action when the access is retried.
+ *
+ * @param sig The signal.
+ * @param info Holds the faulting address.
+ * @param context Unused.
+ */
+static void storage_map_fault(int sig, siginfo_t* info, void* context)
+{
+    (void)context;
+
+    uintptr_t address = (uintptr_t)info->si_addr;
+    uintptr_t start = (uintptr_t)map_guard.map;
+
+    if (map_guard.map != NULL && address >= start && address < start + map_guard.len)
+    {
+        void* page = (void*)(address & ~(uintptr_t)(map_guard.page_size - 1));
+
+        if (mmap(page, map_guard.page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+        {
+            map_guard.truncated = 1;
+            return;
+        }
+    }
+
+    signal(sig, SIG_DFL);
+}
+
+/**
+ * @brief Installs storage_map_fault for the mapping of a file that is being attached.
+ *
+ * @param map The mapping.
+ * @param len Length of the mapping.
+ */
+static void storage_guard_map(const byte_t* map, size_t len)
+{
+    map_guard.len = len;
+    map_guard.page_size = sysconf(_SC_PAGESIZE);
+    map_guard.truncated = 0;
+    map_guard.map = map;
+
+    struct sigaction action = { 0 };
+    action.sa_sigaction = storage_map_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGBUS, &action, &map_guard.previous);
+}
+
+/**
+ * @brief Restores the SIGBUS handler from before storage_guard_map.
+ *
+ */
+static void storage_unguard_map()
+{
+    sigaction(SIGBUS, &map_guard.previous, NULL);
+    map_guard.map = NULL;
+}
+
+/**
+ * @brief Returns the next len bytes of the source. They point into the mapping of the file or, if the file is not
+ * mapped, into the first half of the blob buffer, and stay valid until the next read.
+ *
+ * @param source The source.
+ * @param len Number of bytes, at most BUFLEN_BLOB_CHUNK.
+ * @param err Pointer to error message.
+ * @return const byte_t* The bytes or NULL if they could not be read.
+ */
+static const byte_t* storage_source_read(storage_source_t* source, size_t len, const byte_t** err)
+{
+    if (source->map != NULL)
+    {
+        if (map_guard.truncated)
+        {
+            if (err)
+            {
+                *err = "The file changed while it was attached.";
+            }
+
+            return NULL;
+        }
+
+        const byte_t* data = source->map + source->offset;
+        source->offset += len;
+
+        return data;
+    }
+
+    byte_t* chunk = storage_blob_buffer(err);
+
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    if (fread(chunk, sizeof(byte_t), len, source->file) != len)
+    {
+        if (err)
+        {
+            *err = ferror(source->file) ? strerror(errno) : "The file changed while it was attached.";
+        }
+
+        return NULL;
+    }
+
+    source->offset += len;
+
+    return chunk;
+}
+
+/**
+ * @brief Moves the source back to its start.
+ *
+ * @param source The source.
+ */
+static void storage_source_rewind(storage_source_t* source)
+{
+    source->offset = 0;
+    rewind(source->file);
+}
+
+/**
+ * @brief Writes the whole buffer to the given file descriptor, continuing after partial writes.
+ *
+ * @param fd The file descriptor.
+ * @param buffer The data to write.
+ * @param len Number of bytes to write.
+ * @return bool True if all bytes were written.
+ */
+static bool storage_write_all(int fd, const byte_t* buffer, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = write(fd, buffer, len);
+
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            return false;
+        }
+
+        buffer += written;
+        len -= written;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Checks if a failed copy_file_range or sendfile only means that the files do not support it.
+ *
+ * @param e The errno of the call.
+ * @return bool True if the next way of copying should be tried.
+ */
+static bool storage_copy_unsupported(int e)
+{
+    return e == EXDEV || e == EINVAL || e == ENOSYS || e == EOPNOTSUPP || e == EBADF;
+}
+
+/**
+ * @brief Sets the error message for a copy that stopped early.
+ *
+ * @param result Return value of the call that failed, 0 if the source ended too early.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Always STORAGE_ERROR.
+ */
+static STORAGE_ERR_CODE storage_copy_failed(ssize_t result, const byte_t** err)
+{
+    if (err)
+    {
+        int e = errno;
+        *err = result < 0 ? strerror(e) : "The file changed while it was copied.";
+    }
+
+    return STORAGE_ERROR;
+}
+
+/**
+ * @brief Copies size bytes from the start of in to the current position of out without passing them through a
+ * user-space buffer where possible. A reflink is made if out is an empty regular file on a filesystem that supports
+ * it, otherwise the data is copied with copy_file_range or sendfile. Reading and writing chunks of BUFLEN_BLOB_CHUNK
+ * bytes is the last resort. Each way continues where the previous one stopped.
+ *
+ * @param in File descriptor of the source, which must be a regular file.
+ * @param out File descriptor of the destination.
+ * @param size Number of bytes to copy.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_copy_fd(int in, int out, sqlite3_int64 size, const byte_t** err)
+{
+    off_t offset = 0;
+
+#ifdef FICLONE
+    struct stat st;
+
+    if (size > 0 && fstat(out, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0 && lseek(out, 0, SEEK_CUR) == 0
+        && ioctl(out, FICLONE, in) == 0)
+    {
+        if (fstat(out, &st) != 0 || st.st_size != size || lseek(out, size, SEEK_SET) != size)
+        {
+            return storage_copy_failed(0, err);
+        }
+
+        return STORAGE_NO_ERROR;
+    }
+#endif
+
+    while (offset < size)
+    {
+        ssize_t copied = copy_file_range(in, &offset, out, NULL, size - offset, 0);
+
+        if (copied > 0 || (copied < 0 && errno == EINTR))
+        {
+            continue;
+        }
+
+        if (copied < 0 && storage_copy_unsupported(errno))
+        {
+            break;
+        }
+
+        return storage_copy_failed(copied, err);
+    }
+
+    while (offset < size)
+    {
+        ssize_t copied = sendfile(out, in, &offset, size - offset);
+
+        if (copied > 0 || (copied < 0 && errno == EINTR))
+        {
+            continue;
+        }
+
+        if (copied < 0 && storage_copy_unsupported(errno))
+        {
+            break;
+        }
+
+        return storage_copy_failed(copied, err);
+    }
+
+    byte_t* chunk = offset < size ? storage_blob_buffer(err) : NULL;
+
+    if (offset < size && chunk == NULL)
+    {
+        return STORAGE_ERROR;
+    }
+
+    while (offset < size)
+    {
+        size_t wanted = size - offset < BUFLEN_BLOB_CHUNK ? size - offset : BUFLEN_BLOB_CHUNK;
+        ssize_t read = pread(in, chunk, wanted, offset);
+
+        if (read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (read <= 0)
+        {
+            return storage_copy_failed(read, err);
+        }
+
+        if (!storage_write_all(out, chunk, read))
+        {
+            return storage_copy_failed(-1, err);
+        }
+
+        offset += read;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Copies the content of the given file into the blob data row with given rowid and hashes it on the way.
+ * The file is read in chunks of BUFLEN_BLOB_CHUNK bytes, so memory use does not depend on the file size.
+ *
+ * @param source The file to copy.
+ * @param rowid Rowid of the blob data, whose content must already have the size of the file.
+ * @param size Size of the file.
+ * @param hash Hash state that receives the content or NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_write_blob(storage_source_t* source, sqlite3_int64 rowid, sqlite3_int64 size, hash_sha256_t* hash, const byte_t** err)
+{
+    sqlite3_blob* blob = NULL;
+    int result = sqlite3_blob_open(sqlite_handle, "main", "BLOB_DATA", "CONTENT", rowid, 1, &blob);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        sqlite3_blob_close(blob);
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_int64 offset = 0;
+
+    while (offset < size)
+    {
+        size_t read = size - offset < BUFLEN_BLOB_CHUNK ? size - offset : BUFLEN_BLOB_CHUNK;
+        const byte_t* data = storage_source_read(source, read, err);
+
+        if (data == NULL)
+        {
+            sqlite3_blob_close(blob);
+            return STORAGE_ERROR;
+        }
+
+        if (hash != NULL)
+        {
+            hash_sha256_update(hash, data, read);
+        }
+
+        result = sqlite3_blob_write(blob, data, read, offset);
+
+        if (result != SQLITE_OK)
+        {
+            storage_set_error(err);
+            sqlite3_blob_close(blob);
+            return STORAGE_ERROR;
+        }
+
+        offset += read;
+    }
+
+    result = sqlite3_blob_close(blob);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Hashes the given file from the start and rewinds it afterwards.
+ *
+ * @param source The file to hash.
+ * @param size Size of the file.
+ * @param digest Receives the SHA-256 of the file.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_hash_file(storage_source_t* source, sqlite3_int64 size, ubyte_t digest[HASH_SHA256_SIZE], const byte_t** err)
+{
+    hash_sha256_t hash;
+
+    if (!hash_sha256_init(&hash))
+    {
+        if (err)
+        {
+            *err = "Could not compute SHA-256.";
+        }
+
+        hash_sha256_free(&hash);
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_int64 offset = 0;
+
+    while (offset < size)
+    {
+        size_t read = size - offset < BUFLEN_BLOB_CHUNK ? size - offset : BUFLEN_BLOB_CHUNK;
+        const byte_t* data = storage_source_read(source, read, err);
+
+        if (data == NULL)
+        {
+            hash_sha256_free(&hash);
+            return STORAGE_ERROR;
+        }
+
+        hash_sha256_update(&hash, data, read);
+        offset += read;
+    }
+
+    hash_sha256_final(&hash, digest);
+    hash_sha256_free(&hash);
+    storage_source_rewind(source);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Looks up a blob by SHA-256 or, if hash is NULL, checks if any blob has the given size.
+ *
+ * @param key STMT_FIND_BLOB or STMT_FIND_BLOB_SIZE.
+ * @param digest The SHA-256 to look for, used with STMT_FIND_BLOB.
+ * @param size The size to look for, used with STMT_FIND_BLOB_SIZE.
+ * @param found Receives the id of the blob for STMT_FIND_BLOB or 1 for STMT_FIND_BLOB_SIZE, 0 if nothing matched.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_find_blob(STORAGE_STATEMENT key, const ubyte_t* digest, sqlite3_int64 size, sqlite3_int64* found, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(key, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = key == STMT_FIND_BLOB
+        ? sqlite3_bind_blob(statement, 1, digest, HASH_SHA256_SIZE, NULL)
+        : sqlite3_bind_int64(statement, 1, size);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result != SQLITE_ROW && result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    *found = result == SQLITE_ROW ? sqlite3_column_int64(statement, 0) : 0;
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Inserts a zeroed blob data row of given size.
+ *
+ * @param size Size of the blob.
+ * @param rowid Receives the rowid of the new row.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_insert_blob_data(sqlite3_int64 size, sqlite3_int64* rowid, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_INSERT_BLOB_DATA, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_int64(statement, 1, size);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    *rowid = sqlite3_last_insert_rowid(sqlite_handle);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Inserts the row that describes a blob into BLOBS.
+ *
+ * @param rowid Id of the blob data or 0 for a blob without data row.
+ * @param digest SHA-256 of the content.
+ * @param size Size of the content.
+ * @param stored Size of the encoded content.
+ * @param codec Codec of the encoded content.
+ * @param encode_us Time the encoding took.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_insert_blob(sqlite3_int64 rowid, const ubyte_t digest[HASH_SHA256_SIZE], sqlite3_int64 size,
+    sqlite3_int64 stored, STORAGE_CODEC codec, sqlite3_int64 encode_us, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_INSERT_BLOB, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = rowid != 0 ? sqlite3_bind_int64(statement, 1, rowid) : sqlite3_bind_null(statement, 1);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_blob(statement, 2, digest, HASH_SHA256_SIZE, NULL);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_int64(statement, 3, size);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_int64(statement, 4, stored);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_int(statement, 5, codec);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_int64(statement, 6, encode_us);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Stores the file with given hash as a file in the blob directory and inserts its BLOBS row. The content is
+ * copied by storage_copy_fd into a temporary file, which is renamed once it is complete. The path of the new file
+ * is kept in created_blob_file, so that it can be removed if the transaction fails.
+ *
+ * @param source The file to store.
+ * @param size Size of the file.
+ * @param digest SHA-256 of the file.
+ * @param blob_id Receives the id of the blob.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_store_file(storage_source_t* source, sqlite3_int64 size, const ubyte_t digest[HASH_SHA256_SIZE], sqlite3_int64* blob_id, const byte_t** err)
+{
+    byte_t tmp_path[PATH_MAX];
+    byte_t path[PATH_MAX];
+
+    storage_blob_file_path(digest, ".tmp", tmp_path);
+    storage_blob_file_path(digest, "", path);
+
+    mkdir(active_backend->blob_dir(), S_IRWXU | S_IRWXG);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE status = storage_copy_fd(fileno(source->file), fd, size, err);
+
+    if (status == STORAGE_NO_ERROR && strcmp(active_profile->synchronous, "OFF") != 0 && fsync(fd) != 0)
+    {
+        status = storage_copy_failed(-1, err);
+    }
+
+    if (close(fd) != 0 && status == STORAGE_NO_ERROR)
+    {
+        status = storage_copy_failed(-1, err);
+    }
+
+    if (status == STORAGE_NO_ERROR && rename(tmp_path, path) != 0)
+    {
+        status = storage_copy_failed(-1, err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        unlink(tmp_path);
+        return status;
+    }
+
+    strcpy(created_blob_file, path);
+
+    status = storage_insert_blob(0, digest, size, size, STORAGE_CODEC_FILE, 0, err);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        *blob_id = sqlite3_last_insert_rowid(sqlite_handle);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Returns the codec for the given file. Compression is used unless it is turned off through
+ * TOODLES_COMPRESSION or the first chunk of the file does not shrink below COMPRESSION_MAX_RATIO.
+ * The file is rewound afterwards.
+ *
+ * @param source The file.
+ * @param size Size of the file.
+ * @param codec Receives the codec.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_choose_codec(storage_source_t* source, sqlite3_int64 size, STORAGE_CODEC* codec, const byte_t** err)
+{
+    *codec = STORAGE_CODEC_RAW;
+
+    const byte_t* requested = env_compression();
+
+    if (size == 0 || (requested != NULL && strcmp(requested, CODEC_NAMES[STORAGE_CODEC_ZLIB]) != 0))
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    byte_t* chunk = storage_blob_buffer(err);
+
+    if (chunk == NULL)
+    {
+        return STORAGE_ERROR;
+    }
+
+    size_t read = size < BUFLEN_BLOB_CHUNK ? size : BUFLEN_BLOB_CHUNK;
+    const byte_t* data = storage_source_read(source, read, err);
+
+    storage_source_rewind(source);
+
+    if (data == NULL)
+    {
+        return STORAGE_ERROR;
+    }
+
+    z_stream stream = { 0 };
+
+    if (deflateInit(&stream, COMPRESSION_LEVEL) != Z_OK)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = read;
+    stream.next_out = (Bytef*)chunk + BUFLEN_BLOB_CHUNK;
+    stream.avail_out = read * COMPRESSION_MAX_RATIO;
+
+    if (deflate(&stream, Z_FINISH) == Z_STREAM_END)
+    {
+        *codec = STORAGE_CODEC_ZLIB;
+    }
+
+    deflateEnd(&stream);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Compresses the file into a temporary file. Reads the file in chunks of BUFLEN_BLOB_CHUNK bytes and
+ * hashes it on the way.
+ *
+ * @param source The file to compress.
+ * @param size Size of the file.
+ * @param hash Hash state that receives the content or NULL.
+ * @param compressed Receives the temporary file, positioned at its start.
+ * @param stored Receives the compressed size.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_deflate_file(storage_source_t* source, sqlite3_int64 size, hash_sha256_t* hash, FILE** compressed, sqlite3_int64* stored, const byte_t** err)
+{
+    byte_t* chunk = storage_blob_buffer(err);
+
+    if (chunk == NULL)
+    {
+        return STORAGE_ERROR;
+    }
+
+    byte_t* out = chunk + BUFLEN_BLOB_CHUNK;
+
+    FILE* tmp = tmpfile();
+
+    if (tmp == NULL)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    z_stream stream = { 0 };
+
+    if (deflateInit(&stream, COMPRESSION_LEVEL) != Z_OK)
+    {
+        if (err)
+        {
+            *err = "Could not initialize compression.";
+        }
+
+        fclose(tmp);
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_int64 offset = 0;
+    int flush = Z_NO_FLUSH;
+
+    while (flush != Z_FINISH)
+    {
+        size_t read = size - offset < BUFLEN_BLOB_CHUNK ? size - offset : BUFLEN_BLOB_CHUNK;
+        const byte_t* data = storage_source_read(source, read, err);
+
+        if (data == NULL)
+        {
+            deflateEnd(&stream);
+            fclose(tmp);
+            return STORAGE_ERROR;
+        }
+
+        if (hash != NULL)
+        {
+            hash_sha256_update(hash, data, read);
+        }
+
+        offset += read;
+        flush = offset == size ? Z_FINISH : Z_NO_FLUSH;
+
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = read;
+
+        do
+        {
+            stream.next_out = (Bytef*)out;
+            stream.avail_out = BUFLEN_BLOB_CHUNK;
+
+            deflate(&stream, flush);
+
+            size_t produced = BUFLEN_BLOB_CHUNK - stream.avail_out;
+
+            if (fwrite(out, sizeof(byte_t), produced, tmp) != produced)
+            {
+                if (err)
+                {
+                    int e = errno;
+                    *err = strerror(e);
+                }
+
+                deflateEnd(&stream);
+                fclose(tmp);
+                return STORAGE_ERROR;
+            }
+
+        } while (stream.avail_out == 0);
+    }
+
+    *stored = stream.total_out;
+    deflateEnd(&stream);
+
+    rewind(tmp);
+    *compressed = tmp;
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Returns the id of the blob with the content of the given file and stores the file if there is none yet.
+ * Files with a size no blob has are streamed into the store and hashed on the way. Otherwise the file is hashed
+ * first, so that a duplicate is found without writing anything. Compressible files are deflated into a temporary
+ * file first, because the blob has to be created with its final size. Files from the size returned by
+ * storage_blob_threshold on are always hashed first and kept as files in the blob directory.
+ *
+ * @param source The file to store.
+ * @param size Size of the file.
+ * @param blob_id Receives the id of the blob.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_store_blob(storage_source_t* source, sqlite3_int64 size, sqlite3_int64* blob_id, const byte_t** err)
+{
+    ubyte_t digest[HASH_SHA256_SIZE];
+    sqlite3_int64 same_size = 0;
+
+    if (size >= storage_blob_threshold())
+    {
+        STORAGE_ERR_CODE status = storage_hash_file(source, size, digest, err);
+
+        if (status == STORAGE_NO_ERROR)
+        {
+            status = storage_find_blob(STMT_FIND_BLOB, digest, 0, blob_id, err);
+        }
+
+        if (status != STORAGE_NO_ERROR || *blob_id != 0)
+        {
+            return status;
+        }
+
+        return storage_store_file(source, size, digest, blob_id, err);
+    }
+
+    STORAGE_ERR_CODE status = storage_find_blob(STMT_FIND_BLOB_SIZE, NULL, size, &same_size, err);
+
+    if (status == STORAGE_NO_ERROR && same_size)
+    {
+        status = storage_hash_file(source, size, digest, err);
+
+        if (status == STORAGE_NO_ERROR)
+        {
+            status = storage_find_blob(STMT_FIND_BLOB, digest, 0, blob_id, err);
+        }
+
+        if (status != STORAGE_NO_ERROR || *blob_id != 0)
+        {
+            return status;
+        }
+    }
+
+    STORAGE_CODEC codec = STORAGE_CODEC_RAW;
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_choose_codec(source, size, &codec, err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    hash_sha256_t hash = { 0 };
+
+    if (!same_size && !hash_sha256_init(&hash))
+    {
+        if (err)
+        {
+            *err = "Could not compute SHA-256.";
+        }
+
+        hash_sha256_free(&hash);
+        return STORAGE_ERROR;
+    }
+
+    storage_source_t compressed = { 0 };
+    storage_source_t* input = source;
+    sqlite3_int64 stored = size;
+    sqlite3_int64 encode_us = 0;
+    bool hashed = same_size;
+
+    if (codec == STORAGE_CODEC_ZLIB)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        status = storage_deflate_file(source, size, hashed ? NULL : &hash, &compressed.file, &stored, err);
+        input = &compressed;
+        hashed = true;
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        encode_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+
+        if (status == STORAGE_NO_ERROR && stored >= size)
+        {
+            fclose(compressed.file);
+            compressed.file = NULL;
+            storage_source_rewind(source);
+
+            input = source;
+            stored = size;
+            codec = STORAGE_CODEC_RAW;
+            encode_us = 0;
+        }
+    }
+
+    sqlite3_int64 rowid = 0;
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_insert_blob_data(stored, &rowid, err);
+    }
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_write_blob(input, rowid, stored, hashed ? NULL : &hash, err);
+    }
+
+    if (compressed.file != NULL)
+    {
+        fclose(compressed.file);
+    }
+
+    if (status == STORAGE_NO_ERROR && !same_size)
+    {
+        hash_sha256_final(&hash, digest);
+    }
+
+    hash_sha256_free(&hash);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    status = storage_insert_blob(rowid, digest, size, stored, codec, encode_us, err);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        *blob_id = rowid;
+    }
+
+    return status;
+}
+
+/**
+ * @brief Stores the file in the blob store and inserts an attachment row that references it.
+ *
+ * @param id Id of the todo entry.
+ * @param filename Name of the attachment.
+ * @param source The file to attach.
+ * @param size Size of the file.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_insert_attachment(const byte_t* id, const byte_t* filename, storage_source_t* source, sqlite3_int64 size, const byte_t** err)
+{
+    sqlite3_int64 blob_id = 0;
+    STORAGE_ERR_CODE stored = storage_store_blob(source, size, &blob_id, err);
+
+    if (stored != STORAGE_NO_ERROR)
+    {
+        return stored;
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_INSERT_ATTACHMENT, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_text(statement, 1, filename, strlen(filename), NULL);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_text(statement, 2, id, strlen(id), NULL);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_int64(statement, 3, size);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_int64(statement, 4, blob_id);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result == SQLITE_CONSTRAINT && sqlite3_extended_errcode(sqlite_handle) == SQLITE_CONSTRAINT_FOREIGNKEY)
+    {
+        if (err)
+        {
+            *err = "There is no todo with this id.";
+        }
+
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Copies everything that can be read from a pipe or other special file into a temporary file, so that it
+ * can be attached like a regular file.
+ *
+ * @param in The file to read.
+ * @param spooled Receives the temporary file, positioned at its start.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_spool_file(FILE* in, FILE** spooled, const byte_t** err)
+{
+    byte_t* chunk = storage_blob_buffer(err);
+
+    if (chunk == NULL)
+    {
+        return STORAGE_ERROR;
+    }
+
+    FILE* tmp = tmpfile();
+
+    if (tmp == NULL)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    size_t read;
+
+    while ((read = fread(chunk, sizeof(byte_t), BUFLEN_BLOB_CHUNK, in)) > 0)
+    {
+        if (fwrite(chunk, sizeof(byte_t), read, tmp) != read)
+        {
+            break;
+        }
+    }
+
+    if (ferror(in) || ferror(tmp) || fflush(tmp) != 0)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        fclose(tmp);
+        return STORAGE_ERROR;
+    }
+
+    rewind(tmp);
+    *spooled = tmp;
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_attach_file(const byte_t* id, const byte_t* filepath, long long* size, const byte_t** err)
+{
+    if (!id || id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (!filepath || filepath[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide a file to attach.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    byte_t* filename = basename(filepath);
+
+    if (strcmp(filename, "") == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide a valid filename.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    FILE* f = fopen(filepath, "rb");
+    struct stat st;
+
+    if (!f || fstat(fileno(f), &st) != 0)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        if (f)
+        {
+            fclose(f);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        FILE* spooled = NULL;
+        STORAGE_ERR_CODE spool = storage_spool_file(f, &spooled, err);
+
+        fclose(f);
+
+        if (spool != STORAGE_NO_ERROR)
+        {
+            return spool;
+        }
+
+        f = spooled;
+
+        if (fstat(fileno(f), &st) != 0)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            fclose(f);
+            return STORAGE_ERROR;
+        }
+    }
+
+    if (st.st_size > sqlite3_limit(sqlite_handle, SQLITE_LIMIT_LENGTH, -1) && st.st_size < storage_blob_threshold())
+    {
+        if (err)
+        {
+            snprintf(error_message, BUFLEN_ERROR_MESSAGE, "The file is too big, attachments can have at most %d bytes.",
+                sqlite3_limit(sqlite_handle, SQLITE_LIMIT_LENGTH, -1));
+            *err = error_message;
+        }
+
+        fclose(f);
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        fclose(f);
+        return status;
+    }
+
+    storage_source_t source = { .file = f };
+
+    if (st.st_size > 0)
+    {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+
+        if (map != MAP_FAILED)
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            source.map = map;
+            storage_guard_map(source.map, st.st_size);
+        }
+    }
+
+    created_blob_file[0] = 0;
+
+    status = storage_insert_attachment(id, filename, &source, st.st_size, err);
+
+    // The last chunk is consumed after the last read, so a fault in it only shows here.
+    if (status == STORAGE_NO_ERROR && map_guard.truncated)
+    {
+        if (err)
+        {
+            *err = "The file changed while it was attached.";
+        }
+
+        status = STORAGE_ERROR;
+    }
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_commit(err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+
+        if (created_blob_file[0] != 0)
+        {
+            unlink(created_blob_file);
+        }
+    }
+
+    if (source.map != NULL)
+    {
+        storage_unguard_map();
+        munmap((void*)source.map, st.st_size);
+    }
+
+    fclose(f);
+
+    if (status == STORAGE_NO_ERROR && size)
+    {
+        *size = st.st_size;
+    }
+
+    return status;
+}
+
+STORAGE_ERR_CODE storage_remove_attachment(const byte_t* id, const byte_t** err)
+{
+    if (!id || id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE removed = storage_exec_for_id(STMT_DELETE_ATTACHMENT, id, err);
+
+    if (removed != STORAGE_NO_ERROR)
+    {
+        return removed;
+    }
+
+    return storage_collect_files(err);
+}
+
+/**
+ * @brief Returns the space taken by blob content, including data rows that lost their blob.
+ *
+ * @param size Receives the size in bytes.
+ * @return int SQLITE result code.
+ */
+static int storage_blob_space(sqlite3_int64* size)
+{
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_BLOB_SPACE].sql, -1, &statement, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result == SQLITE_ROW)
+    {
+        *size = sqlite3_column_int64(statement, 0);
+        result = SQLITE_OK;
+    }
+
+    sqlite3_finalize(statement);
+
+    return result;
+}
+
+/**
+ * @brief Reads the SHA-256 from the start of a file name in the blob directory.
+ *
+ * @param name The file name.
+ * @param digest Receives the SHA-256.
+ * @return bool True if the name starts with 64 hex digits.
+ */
+static bool storage_blob_name_digest(const byte_t* name, ubyte_t digest[HASH_SHA256_SIZE])
+{
+    size_t len = strlen(name);
+    size_t parsed = 0;
+
+    for (; parsed < HASH_SHA256_SIZE && parsed * 2 < len; parsed++)
+    {
+        if (!isxdigit((ubyte_t)name[2 * parsed]) || !isxdigit((ubyte_t)name[2 * parsed + 1])
+            || sscanf(name + 2 * parsed, "%2hhx", &digest[parsed]) != 1)
+        {
+            break;
+        }
+    }
+
+    return parsed == HASH_SHA256_SIZE;
+}
+
+/**
+ * @brief Removes files from the blob directory that no blob refers to, such as files of interrupted attaches.
+ * Runs in a write transaction, so that no attach can add a file at the same time.
+ *
+ * @param reclaimed Receives the size of the removed files in bytes.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sweep_blob_dir(sqlite3_int64* reclaimed, const byte_t** err)
+{
+    *reclaimed = 0;
+
+    const byte_t* blob_dir = active_backend->blob_dir();
+    DIR* dir = blob_dir != NULL ? opendir(blob_dir) : NULL;
+
+    if (dir == NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
+
+    STORAGE_ERR_CODE status = storage_begin(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        closedir(dir);
+        return status;
+    }
+
+    struct dirent* entry;
+    byte_t path[PATH_MAX];
+
+    while (status == STORAGE_NO_ERROR && (entry = readdir(dir)) != NULL)
+    {
+        ubyte_t digest[HASH_SHA256_SIZE];
+        size_t len = strlen(entry->d_name);
+        bool tmp = len == 2 * HASH_SHA256_SIZE + strlen(".tmp") && strcmp(entry->d_name + 2 * HASH_SHA256_SIZE, ".tmp") == 0;
+
+        if (!storage_blob_name_digest(entry->d_name, digest) || (len != 2 * HASH_SHA256_SIZE && !tmp))
+        {
+            continue;
+        }
+
+        sqlite3_int64 blob_id = 0;
+
+        if (!tmp)
+        {
+            status = storage_find_blob(STMT_FIND_BLOB, digest, 0, &blob_id, err);
+        }
+
+        struct stat st;
+        snprintf(path, PATH_MAX, "%s%s", blob_dir, entry->d_name);
+
+        if (status == STORAGE_NO_ERROR && blob_id == 0 && stat(path, &st) == 0 && unlink(path) == 0)
+        {
+            *reclaimed += st.st_size;
+        }
+    }
+
+    closedir(dir);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_commit(err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+    }
+
+    return status;
+}
+
+STORAGE_ERR_CODE storage_sweep_orphans(size_t* attachments, long long* reclaimed, const byte_t** err)
+{
+    // Removed todos go first, so that their attachments are gone before the blobs are counted.
+    STORAGE_ERR_CODE status = storage_purge(-1, NULL, err);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_begin(err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
+    }
+
+    sqlite3_int64 before = 0;
+    sqlite3_int64 after = 0;
+    int result = storage_blob_space(&before);
+    int orphans = 0;
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_exec(sqlite_handle, SCRIPTS[SCRIPT_SWEEP_ATTACHMENTS].sql, NULL, NULL, NULL);
+        orphans = sqlite3_changes(sqlite_handle);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_exec(sqlite_handle, SCRIPTS[SCRIPT_SWEEP_BLOBS].sql, NULL, NULL, NULL);
+    }
+
+    if (result == SQLITE_OK)
+    {
+        result = storage_blob_space(&after);
+    }
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_rollback();
+        return STORAGE_ERROR;
+    }
+
+    status = storage_commit(err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return status;
+    }
+
+    sqlite3_int64 files = 0;
+    status = storage_collect_files(err);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_sweep_blob_dir(&files, err);
+    }
+
+    if (attachments != NULL)
+    {
+        *attachments = orphans;
+    }
+
+    if (reclaimed != NULL)
+    {
+        *reclaimed = before - after + files;
+    }
+
+    return status;
+}
+
+STORAGE_ERR_CODE storage_print_attachments(const byte_t* todo_id, const byte_t** err)
+{
+    if (!todo_id || todo_id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_SELECT_ATTACHMENTS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    printf(MAGENTA("%-16s%-48s%-16s%-16s%-8s%-8s%-8s\n"), "Id", "Name", "Size in bytes", "Stored", "Codec", "Ratio", "MB/s");
+
+    sqlite3_int64 logical = 0;
+
+    int result = sqlite3_bind_text(statement, 1, todo_id, strlen(todo_id), NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    while (1)
+    {
+        int rc = sqlite3_step(statement);
+
+        if (rc == SQLITE_ROW)
+        {
+            const ubyte_t* id = sqlite3_column_text(statement, 0);
+            const ubyte_t* name = sqlite3_column_text(statement, 1);
+            sqlite3_int64 size = sqlite3_column_int64(statement, 2);
+            sqlite3_int64 stored = sqlite3_column_int64(statement, 3);
+            int codec = sqlite3_column_int(statement, 4);
+            sqlite3_int64 encode_us = sqlite3_column_int64(statement, 5);
+
+            const byte_t* codec_name = codec >= 0 && codec <= STORAGE_CODEC_FILE ? CODEC_NAMES[codec] : "?";
+            double ratio = stored > 0 ? (double)size / stored : 1.0;
+
+            printf(CYAN("%-16s") "%-48s%-16lld%-16lld%-8s%-8.2f", id, name, size, stored, codec_name, ratio);
+
+            if (encode_us > 0)
+            {
+                printf("%-8.1f\n", size / (encode_us / 1e6) / (1024 * 1024));
+            }
+            else
+            {
+                printf("%-8s\n", "-");
+            }
+
+            logical += size;
+            continue;
+        }
+
+        if (rc == SQLITE_DONE)
+        {
+            break;
+        }
+
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    prepared = storage_statement(STMT_SELECT_PHYSICAL_SIZE, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    result = sqlite3_bind_text(statement, 1, todo_id, strlen(todo_id), NULL);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result != SQLITE_ROW)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_int64 physical = sqlite3_column_int64(statement, 0);
+    storage_release(statement);
+
+    printf("\nLogical size: %lld bytes, physical size: %lld bytes.\n", logical, physical);
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Opens the blob of the attachment with given id for reading. Blobs with STORAGE_CODEC_FILE are opened
+ * as file instead.
+ *
+ * @param attachment_id The id of the attachment.
+ * @param blob Receives the opened blob or NULL for a file blob.
+ * @param file Receives the file descriptor of a file blob or -1.
+ * @param codec Receives the codec of the blob content.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_open_attachment(const byte_t* attachment_id, sqlite3_blob** blob, int* file, STORAGE_CODEC* codec, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_SELECT_ATTACHMENT_BLOB, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_text(statement, 1, attachment_id, strlen(attachment_id), NULL);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
+    }
+
+    if (result == SQLITE_DONE)
+    {
+        if (err)
+        {
+            *err = "There is no attachment with this id.";
+        }
+
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    if (result != SQLITE_ROW)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_int64 blob_id = sqlite3_column_int64(statement, 0);
+    *codec = sqlite3_column_int(statement, 1);
+    *blob = NULL;
+    *file = -1;
+
+    if (*codec == STORAGE_CODEC_FILE)
+    {
+        byte_t path[PATH_MAX];
+        storage_blob_file_path(sqlite3_column_blob(statement, 2), "", path);
+        storage_release(statement);
+
+        *file = open(path, O_RDONLY);
+
+        if (*file < 0)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            return STORAGE_ERROR;
+        }
+
+        return STORAGE_NO_ERROR;
+    }
+
+    storage_release(statement);
+
+    result = sqlite3_blob_open(sqlite_handle, "main", "BLOB_DATA", "CONTENT", blob_id, 0, blob);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        sqlite3_blob_close(*blob);
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Inflates the blob to the file descriptor. The compressed content is read in chunks of BUFLEN_BLOB_CHUNK
+ * bytes and every chunk of output is written as soon as it is complete.
+ *
+ * @param blob The opened blob.
+ * @param fd The file descriptor to write to.
+ * @param chunk Buffer of twice BUFLEN_BLOB_CHUNK bytes.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_inflate_blob(sqlite3_blob* blob, int fd, byte_t* chunk, const byte_t** err)
+{
+    byte_t* out = chunk + BUFLEN_BLOB_CHUNK;
+
+    z_stream stream = { 0 };
+
+    if (inflateInit(&stream) != Z_OK)
+    {
+        if (err)
+        {
+            *err = "Could not initialize decompression.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    int size = sqlite3_blob_bytes(blob);
+    int inflated = Z_OK;
+
+    for (int offset = 0; offset < size && inflated != Z_STREAM_END; offset += BUFLEN_BLOB_CHUNK)
+    {
+        int len = size - offset < BUFLEN_BLOB_CHUNK ? size - offset : BUFLEN_BLOB_CHUNK;
+
+        if (sqlite3_blob_read(blob, chunk, len, offset) != SQLITE_OK)
+        {
+            storage_set_error(err);
+            inflateEnd(&stream);
+            return STORAGE_ERROR;
+        }
+
+        stream.next_in = (Bytef*)chunk;
+        stream.avail_in = len;
+
+        do
+        {
+            stream.next_out = (Bytef*)out;
+            stream.avail_out = BUFLEN_BLOB_CHUNK;
+
+            inflated = inflate(&stream, Z_NO_FLUSH);
+
+            if (inflated != Z_OK && inflated != Z_STREAM_END && inflated != Z_BUF_ERROR)
+            {
+                if (err)
+                {
+                    *err = "The attachment is corrupt.";
+                }
+
+                inflateEnd(&stream);
+                return STORAGE_ERROR;
+            }
+
+            if (!storage_write_all(fd, out, BUFLEN_BLOB_CHUNK - stream.avail_out))
+            {
+                if (err)
+                {
+                    int e = errno;
+                    *err = strerror(e);
+                }
+
+                inflateEnd(&stream);
+                return STORAGE_ERROR;
+            }
+
+        } while (stream.avail_out == 0);
+    }
+
+    inflateEnd(&stream);
+
+    if (inflated != Z_STREAM_END)
+    {
+        if (err)
+        {
+            *err = "The attachment is corrupt.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Copies the blob to the file descriptor. The blob is read in chunks of BUFLEN_BLOB_CHUNK bytes,
+ * so the content is written byte for byte with constant memory use.
+ *
+ * @param blob The opened blob.
+ * @param fd The file descriptor to write to.
+ * @param chunk Buffer of at least BUFLEN_BLOB_CHUNK bytes.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_read_blob(sqlite3_blob* blob, int fd, byte_t* chunk, const byte_t** err)
+{
+    int size = sqlite3_blob_bytes(blob);
+
+    for (int offset = 0; offset < size; offset += BUFLEN_BLOB_CHUNK)
+    {
+        int len = size - offset < BUFLEN_BLOB_CHUNK ? size - offset : BUFLEN_BLOB_CHUNK;
+
+        if (sqlite3_blob_read(blob, chunk, len, offset) != SQLITE_OK)
+        {
+            storage_set_error(err);
+            return STORAGE_ERROR;
+        }
+
+        if (!storage_write_all(fd, chunk, len))
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            return STORAGE_ERROR;
+        }
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Decodes the blob to the file descriptor and closes it. File blobs are copied by storage_copy_fd.
+ *
+ * @param blob The opened blob or NULL for a file blob.
+ * @param file File descriptor of a file blob or -1.
+ * @param codec The codec of the blob content.
+ * @param fd The file descriptor to write to.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_copy_attachment(sqlite3_blob* blob, int file, STORAGE_CODEC codec, int fd, const byte_t** err)
+{
+    if (codec == STORAGE_CODEC_FILE)
+    {
+        struct stat st;
+        STORAGE_ERR_CODE copied = fstat(file, &st) == 0 ? storage_copy_fd(file, fd, st.st_size, err) : storage_copy_failed(-1, err);
+
+        close(file);
+
+        return copied;
+    }
+
+    byte_t* chunk = storage_blob_buffer(err);
+
+    STORAGE_ERR_CODE copied = STORAGE_ERROR;
+
+    if (chunk != NULL)
+    {
+        copied = codec == STORAGE_CODEC_ZLIB ? storage_inflate_blob(blob, fd, chunk, err) : storage_read_blob(blob, fd, chunk, err);
+    }
+
+    sqlite3_blob_close(blob);
+
+    return copied;
+}
+
+STORAGE_ERR_CODE storage_print_attachment_content(const byte_t* attachment_id, const byte_t** err)
+{
+    if (!attachment_id || attachment_id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_blob* blob = NULL;
+    int file = -1;
+    STORAGE_CODEC codec = STORAGE_CODEC_RAW;
+    STORAGE_ERR_CODE opened = storage_open_attachment(attachment_id, &blob, &file, &codec, err);
+
+    if (opened != STORAGE_NO_ERROR)
+    {
+        return opened;
+    }
+
+    fflush(stdout);
+
+    STORAGE_ERR_CODE copied = storage_copy_attachment(blob, file, codec, STDOUT_FILENO, err);
+
+    if (copied != STORAGE_NO_ERROR)
+    {
+        return copied;
+    }
+
+    printf("\n");
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_save_attachment_to_disk(const byte_t* attachment_id, const byte_t* save_path, const byte_t** err)
+{
+    if (!attachment_id || attachment_id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (!save_path || save_path[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide a path for saving.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_blob* blob = NULL;
+    int file = -1;
+    STORAGE_CODEC codec = STORAGE_CODEC_RAW;
+    STORAGE_ERR_CODE opened = storage_open_attachment(attachment_id, &blob, &file, &codec, err);
+
+    if (opened != STORAGE_NO_ERROR)
+    {
+        return opened;
+    }
+
+    int fd = open(save_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        sqlite3_blob_close(blob);
+
+        if (file >= 0)
+        {
+            close(file);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE copied = storage_copy_attachment(blob, file, codec, fd, err);
+
+    if (close(fd) != 0 && copied == STORAGE_NO_ERROR)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (copied != STORAGE_NO_ERROR)
+    {
+        unlink(save_path);
+    }
+
+    return copied;
+}
+
+STORAGE_ERR_CODE storage_get_details(const byte_t* id, byte_t* buffer, size_t buflen, size_t* written, const byte_t** err)
+{
+    assert(buffer != NULL);
+
+    if (!id || id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_SELECT_DETAILS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result != SQLITE_ROW && result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+    else
+    {
+        const ubyte_t* details = sqlite3_column_text(statement, 0);
+
+        if (details)
+        {
+            for (size_t i = 0; i < buflen - 1; i++)
+            {
+                if (details[i] == 0)
+                {
+                    break;
+                }
+
+                buffer[i] = details[i];
+                *written = i + 1;
+            }
+        }
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_save_details(const byte_t* id, byte_t* buffer, size_t buflen, const byte_t** err)
+{
+    assert(buffer != NULL);
+
+    if (!id || id[0] == 0)
+    {
+        if (err)
+        {
+            *err = "Please provide an id.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_UPDATE_DETAILS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    int result = sqlite3_bind_text(statement, 1, buffer, strlen(buffer), NULL);
+
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_bind_text(statement, 2, id, strlen(id), NULL);
+    }
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    result = sqlite3_step(statement);
+
+    if (result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_import(const byte_t* filepath, size_t* imported, const byte_t** err)
+{
+    assert(imported != NULL);
+
+    *imported = 0;
+
+    import_reader_t reader;
+    int opened = import_open(&reader, filepath, err);
+
+    if (opened != 0)
+    {
+        return STORAGE_ERROR;
+    }
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_IMPORT_TODO, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        import_close(&reader);
+        return prepared;
+    }
+
+    STORAGE_ERR_CODE begun = storage_begin(err);
+
+    if (begun != STORAGE_NO_ERROR)
+    {
+        import_close(&reader);
+        return begun;
+    }
+
+    size_t count = 0;
+    import_todo_t todo;
+    IMPORT_RESULT read;
+
+    while ((read = import_next(&reader, &todo, err)) == IMPORT_RECORD)
+    {
+        int result = sqlite3_bind_text(statement, 1, todo.title, -1, NULL);
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_bind_text(statement, 2, todo.details, -1, NULL);
+        }
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_bind_int(statement, 3, todo.done);
+        }
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_bind_text(statement, 4, todo.created, -1, NULL);
+        }
+
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_step(statement) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        }
+
+        if (result != SQLITE_OK)
+        {
+            storage_set_error(err);
+            break;
+        }
+
+        sqlite3_reset(statement);
+        count++;
+    }
+
+    storage_release(statement);
+
+    if (read == IMPORT_ERROR && err)
+    {
+        snprintf(error_message, BUFLEN_ERROR_MESSAGE, "%s", reader.message);
+        *err = error_message;
+    }
+
+    import_close(&reader);
+
+    if (read != IMPORT_END)
+    {
+        storage_rollback();
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE committed = storage_commit(err);
+
+    if (committed != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return committed;
+    }
+
+    *imported = count;
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_export(const byte_t* filepath, const byte_t* format, bool attachments, size_t* exported, const byte_t** err)
+{
+    assert(exported != NULL);
+
+    *exported = 0;
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(attachments ? STMT_EXPORT_TODOS_ATTACHMENTS : STMT_EXPORT_TODOS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    export_writer_t writer;
+    int opened = export_open(&writer, filepath, format, attachments, err);
+
+    if (opened != 0)
+    {
+        return STORAGE_ERROR;
+    }
+
+    int result = sqlite3_exec(sqlite_handle, "begin", NULL, NULL, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        export_close(&writer);
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE error = STORAGE_NO_ERROR;
+    size_t count = 0;
+    long long last_id = 0;
+
+    while (1)
+    {
+        int rc = sqlite3_step(statement);
+
+        if (rc == SQLITE_DONE)
+        {
+            break;
+        }
+
+        if (rc != SQLITE_ROW)
+        {
+            storage_set_error(err);
+            error = STORAGE_ERROR;
+            break;
+        }
+
+        export_row_t row = {
+            .id = sqlite3_column_int64(statement, 0),
+            .title = (const byte_t*)sqlite3_column_text(statement, 1),
+            .details = (const byte_t*)sqlite3_column_text(statement, 2),
+            .done = sqlite3_column_int(statement, 3),
+            .created = (const byte_t*)sqlite3_column_text(statement, 4),
+        };
+
+        if (attachments)
+        {
+            row.attachment_id = sqlite3_column_int64(statement, 5);
+            row.attachment_name = (const byte_t*)sqlite3_column_text(statement, 6);
+            row.attachment_size = sqlite3_column_int64(statement, 7);
+        }
+
+        if (export_row(&writer, &row) != 0)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            error = STORAGE_ERROR;
+            break;
+        }
+
+        if (row.id != last_id)
+        {
+            last_id = row.id;
+            count++;
+        }
+    }
+
+    storage_release(statement);
+    storage_rollback();
+
+    if (export_close(&writer) != 0 && error == STORAGE_NO_ERROR)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        error = STORAGE_ERROR;
+    }
+
+    *exported = count;
+
+    return error;
+}
+
+/**
+ * @brief Checks that a consumer who has seen the events up to since can continue from there: the events after it
+ * must not have been pruned, and the feed must not have started over, which only a restore of an older backup does.
+ *
+ * @param since Sequence number of the last event the consumer has seen.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_check_feed(long long since, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_CHANGE_BOUNDS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    if (sqlite3_step(statement) != SQLITE_ROW)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    long long last = sqlite3_column_int64(statement, 1);
+    long long first = sqlite3_column_type(statement, 0) == SQLITE_NULL ? last + 1 : sqlite3_column_int64(statement, 0);
+
+    storage_release(statement);
+
+    if (since + 1 < first)
+    {
+        if (err)
+        {
+            snprintf(error_message, BUFLEN_ERROR_MESSAGE,
+                "Events up to %lld were pruned. Export all todos again and follow the feed from %lld.", first - 1, last);
+            *err = error_message;
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    if (since > last)
+    {
+        if (err)
+        {
+            snprintf(error_message, BUFLEN_ERROR_MESSAGE,
+                "The feed ends at %lld and has no event %lld. Export all todos again and follow the feed from %lld.",
+                last, since, last);
+            *err = error_message;
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_print_changes(long long since, const byte_t* filepath, size_t* printed, const byte_t** err)
+{
+    assert(printed != NULL);
+
+    *printed = 0;
+
+    int result = sqlite3_exec(sqlite_handle, "begin", NULL, NULL, NULL);
+
+    if (result != SQLITE_OK)
+    {
+        storage_set_error(err);
+        return STORAGE_ERROR;
+    }
+
+    STORAGE_ERR_CODE error = storage_check_feed(since, err);
+
+    sqlite3_stmt* statement = NULL;
+
+    if (error == STORAGE_NO_ERROR)
+    {
+        error = storage_statement(STMT_SELECT_CHANGES, &statement, err);
+    }
+
+    if (error == STORAGE_NO_ERROR && sqlite3_bind_int64(statement, 1, since) != SQLITE_OK)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        error = STORAGE_ERROR;
+    }
+
+    if (error != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
+        return error;
+    }
+
+    export_writer_t writer;
+
+    if (export_open(&writer, filepath, "jsonl", false, err) != 0)
+    {
+        storage_release(statement);
+        storage_rollback();
+        return STORAGE_ERROR;
+    }
+
+    size_t count = 0;
+
+    while (1)
+    {
+        int rc = sqlite3_step(statement);
+
+        if (rc == SQLITE_DONE)
+        {
+            break;
+        }
+
+        if (rc != SQLITE_ROW)
+        {
+            storage_set_error(err);
+            error = STORAGE_ERROR;
+            break;
+        }
+
+        export_change_t change = {
+            .seq = sqlite3_column_int64(statement, 0),
+            .time = (const byte_t*)sqlite3_column_text(statement, 1),
+            .table = (const byte_t*)sqlite3_column_text(statement, 2),
+            .op = (const byte_t*)sqlite3_column_text(statement, 3),
+            .id = sqlite3_column_int64(statement, 4),
+            .todo_id = sqlite3_column_int64(statement, 5),
+            .exists = sqlite3_column_int(statement, 6) != 0,
+            .title = (const byte_t*)sqlite3_column_text(statement, 7),
+            .details = (const byte_t*)sqlite3_column_text(statement, 8),
+            .done = sqlite3_column_int(statement, 9),
+            .created = (const byte_t*)sqlite3_column_text(statement, 10),
+            .name = (const byte_t*)sqlite3_column_text(statement, 11),
+            .size = sqlite3_column_int64(statement, 12),
+        };
+
+        if (export_change(&writer, &change) != 0)
+        {
+            if (err)
+            {
+                int e = errno;
+                *err = strerror(e);
+            }
+
+            error = STORAGE_ERROR;
+            break;
+        }
+
+        count++;
+    }
+
+    storage_release(statement);
+    storage_rollback();
+
+    if (export_close(&writer) != 0 && error == STORAGE_NO_ERROR)
+    {
+        if (err)
+        {
+            int e = errno;
+            *err = strerror(e);
+        }
+
+        error = STORAGE_ERROR;
+    }
+
+    *printed = count;
+
+    return error;
+}
+
+STORAGE_ERR_CODE storage_print_environment(const byte_t** err)
+{
+    if (sqlite_handle == NULL)
+    {
+        if (err)
+        {
+            *err = "Storage is not opened.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    const byte_t* pragmas[] = {
+        "journal_mode",
+        "synchronous",
+        "mmap_size",
+        "cache_size",
+        "temp_store",
+        "auto_vacuum",
+        "page_size",
+        "page_count",
+        "freelist_count",
+        "user_version",
+    };
+
+    printf(CYAN("%-20s") GREEN("%-128s\n"), "Storage backend", active_backend->name);
+    printf(CYAN("%-20s") GREEN("%-128s\n"), "Storage profile", active_profile->name);
+
+    for (size_t i = 0; i < sizeof(pragmas) / sizeof(pragmas[0]); i++)
+    {
+        byte_t value[BUFLEN_PRAGMA] = { 0 };
+        int result = storage_read_pragma(pragmas[i], value, BUFLEN_PRAGMA);
+
+        if (result != SQLITE_OK)
+        {
+            storage_set_error(err);
+            return STORAGE_ERROR;
+        }
+
+        printf(CYAN("  %-18s") GREEN("%-128s\n"), pragmas[i], value);
+    }
+
+    long long page_size = 0;
+    long long page_count = 0;
+    long long freelist_count = 0;
+
+    STORAGE_ERR_CODE read = storage_pragma_int("page_size", &page_size, err);
+
+    if (read == STORAGE_NO_ERROR)
+    {
+        read = storage_pragma_int("page_count", &page_count, err);
+    }
+
+    if (read == STORAGE_NO_ERROR)
+    {
+        read = storage_pragma_int("freelist_count", &freelist_count, err);
+    }
+
+    if (read != STORAGE_NO_ERROR)
+    {
+        return read;
+    }
+
+    printf(CYAN("%-20s") GREEN("%lld bytes in free pages, %.1f %% of the file\n"), "Fragmentation",
+        freelist_count * page_size, page_count == 0 ? 0.0 : 100.0 * freelist_count / page_count);
+
+    sqlite3_stmt* statement;
+    STORAGE_ERR_CODE prepared = storage_statement(STMT_ATTACHMENT_TOTALS, &statement, err);
+
+    if (prepared != STORAGE_NO_ERROR)
+    {
+        return prepared;
+    }
+
+    if (sqlite3_step(statement) != SQLITE_ROW)
+    {
+        storage_set_error(err);
+        storage_release(statement);
+        return STORAGE_ERROR;
+    }
+
+    printf(CYAN("%-20s") GREEN("%lld bytes logical, %lld bytes physical\n"), "Attachments",
+        sqlite3_column_int64(statement, 0), sqlite3_column_int64(statement, 1));
+
+    storage_release(statement);
+
+    return STORAGE_NO_ERROR;
+}
+
+STORAGE_ERR_CODE storage_compact(long long* pages, long long* free_pages, long long* reclaimed, const byte_t** err)
+{
+    if (sqlite_handle == NULL)
+    {
+        if (err)
+        {
+            *err = "Storage is not opened.";
+        }
+
+        return STORAGE_ERROR;
+    }
+
+    // Removed and erased todos go first, so that their pages are free by the time they are given back.
+    STORAGE_ERR_CODE read = storage_purge(-1, NULL, err);
+
+    if (read != STORAGE_NO_ERROR)
+    {
+        return read;
+    }
+
+    long long mode = 0;
+    long long page_size = 0;
+    long long before = 0;
+
+    read = storage_pragma_int("auto_vacuum", &mode, err);
+
+    if (read == STORAGE_NO_ERROR)
+    {
+        read = storage_pragma_int("page_size", &page_size, err);
+    }
+
+    if (read == STORAGE_NO_ERROR)
+    {
+        read = storage_pragma_int("page_count", &before, err);
+    }
+
+    if (read != STORAGE_NO_ERROR)
+    {
+        return read;
+    }
+
+    // Databases created with auto_vacuum NONE need one full vacuum to keep the pointer map of incremental mode.
+    if (mode != 2)
+    {
+        int result = sqlite3_exec(sqlite_handle, "pragma auto_vacuum = incremental; vacuum", NULL, NULL, NULL);
+
+        if (result != SQLITE_OK)
+        {
+            storage_set_error(err);
+            return STORAGE_ERROR;
+        }
+    }
+
+    byte_t sql[BUFLEN_PRAGMA] = { 0 };
+    snprintf(sql, BUFLEN_PRAGMA, "pragma incremental_vacuum(%d)", COMPACT_STEP_PAGES);
+
+    long long free_count = 0;
+
+    while (1)
+    {
+        read = storage_pragma_int("freelist_count", &free_count, err);
+
+        if (read != STORAGE_NO_ERROR)
+        {
+            return read;
+        }
+
+        if (free_count == 0)
+        {
+            break;
+        }
+
+        // Every step is a transaction of its own, so other processes get the lock in between.
+        int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+
+        if (result != SQLITE_OK)
+        {
+            storage_set_error(err);
+            return STORAGE_ERROR;
+        }
+    }
+
+    // The file only shrinks when the write-ahead log is checkpointed. Readers may keep it from completing.
+    sqlite3_exec(sqlite_handle, "pragma wal_checkpoint(truncate)", NULL, NULL, NULL);
+
+    long long after = 0;
+    read = storage_pragma_int("page_count", &after, err);
+
+    if (read != STORAGE_NO_ERROR)
+    {
+        return read;
+    }
+
+    if (pages)
+    {
+        *pages = after;
+    }
+
+    if (free_pages)
+    {
+        *free_pages = free_count;
+    }
+
+    if (reclaimed)
+    {
+        *reclaimed = (before - after) * page_size;
+    }
+
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Returns the file of the default VFS that a backup file wraps.
+ *
+ * @param file The backup file.
+ * @return sqlite3_file* The wrapped file.
+ */
+static sqlite3_file* storage_backup_real(sqlite3_file* file)
+{
+    return ((storage_backup_file_t*)file)->real;
+}
+
+static int storage_backup_close(sqlite3_file* file)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xClose(real);
+}
+
+static int storage_backup_read(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xRead(real, buffer, amount, offset);
+}
+
+/**
+ * @brief Writes to a backup file. A page of the database file is only written if the file holds different bytes
+ * at its offset, so that taking a backup over an earlier one only writes the pages that changed since.
+ *
+ * @param file The backup file.
+ * @param data The data to write.
+ * @param amount Number of bytes.
+ * @param offset Offset in the file.
+ * @return int SQLITE result code.
+ */
+static int storage_backup_write(sqlite3_file* file, const void* data, int amount, sqlite3_int64 offset)
+{
+    storage_backup_file_t* backup_file = (storage_backup_file_t*)file;
+    sqlite3_file* real = backup_file->real;
+
+    if (!backup_file->database)
+    {
+        return real->pMethods->xWrite(real, data, amount, offset);
+    }
+
+    if (amount <= BACKUP_MAX_PAGE_SIZE && real->pMethods->xRead(real, backup_page, amount, offset) == SQLITE_OK
+        && memcmp(backup_page, data, amount) == 0)
+    {
+        backup_skipped++;
+        return SQLITE_OK;
+    }
+
+    backup_written++;
+
+    return real->pMethods->xWrite(real, data, amount, offset);
+}
+
+static int storage_backup_truncate(sqlite3_file* file, sqlite3_int64 size)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xTruncate(real, size);
+}
+
+static int storage_backup_sync(sqlite3_file* file, int flags)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xSync(real, flags);
+}
+
+static int storage_backup_file_size(sqlite3_file* file, sqlite3_int64* size)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xFileSize(real, size);
+}
+
+static int storage_backup_lock(sqlite3_file* file, int lock)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xLock(real, lock);
+}
+
+static int storage_backup_unlock(sqlite3_file* file, int lock)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xUnlock(real, lock);
+}
+
+static int storage_backup_check_lock(sqlite3_file* file, int* reserved)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xCheckReservedLock(real, reserved);
+}
+
+static int storage_backup_file_control(sqlite3_file* file, int op, void* arg)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xFileControl(real, op, arg);
+}
+
+static int storage_backup_sector_size(sqlite3_file* file)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xSectorSize(real);
+}
+
+static int storage_backup_device(sqlite3_file* file)
+{
+    sqlite3_file* real = storage_backup_real(file);
+    return real->pMethods->xDeviceCharacteristics(real);
 }
 
 /**
- * @brief Creates the todo attachment table.
+ * @brief Methods of backup files. Version 1 has no shared memory, which is fine as backups are written with
+ * exclusive locking.
  *
+ */
+static const sqlite3_io_methods BACKUP_IO_METHODS = {
+    .iVersion = 1,
+    .xClose = storage_backup_close,
+    .xRead = storage_backup_read,
+    .xWrite = storage_backup_write,
+    .xTruncate = storage_backup_truncate,
+    .xSync = storage_backup_sync,
+    .xFileSize = storage_backup_file_size,
+    .xLock = storage_backup_lock,
+    .xUnlock = storage_backup_unlock,
+    .xCheckReservedLock = storage_backup_check_lock,
+    .xFileControl = storage_backup_file_control,
+    .xSectorSize = storage_backup_sector_size,
+    .xDeviceCharacteristics = storage_backup_device
+};
+
+/**
+ * @brief Opens a file through the default VFS and wraps it in a backup file.
+ *
+ * @param vfs The backup VFS.
+ * @param name Name of the file.
+ * @param file Receives the backup file.
+ * @param flags Open flags.
+ * @param out_flags Receives the flags the file was opened with.
  * @return int SQLITE result code.
  */
-static int storage_create_attachment_table()
+static int storage_backup_open(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* out_flags)
 {
-    const byte_t* sql = "create table if not exists "
-        "ATTACHMENTS ("
-        "ID INTEGER, "
-        "NAME TEXT NOT NULL, "
-        "TODO_ID INTEGER NOT NULL, "
-        "ATTACHMENT BLOB NOT NULL, "
-        "SIZE INTEGER NOT NULL, "
-        "primary key(ID autoincrement), "
-        "foreign key(TODO_ID) references TODOS(ID))";
+    sqlite3_vfs* root = vfs->pAppData;
+    storage_backup_file_t* backup_file = (storage_backup_file_t*)file;
 
-    int result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+    backup_file->real = (sqlite3_file*)&backup_file[1];
+    backup_file->database = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+
+    int result = root->xOpen(root, name, backup_file->real, flags, out_flags);
+
+    backup_file->base.pMethods = result == SQLITE_OK ? &BACKUP_IO_METHODS : NULL;
 
     return result;
 }
 
-STORAGE_ERR_CODE storage_new_storage(const byte_t** err)
+/**
+ * @brief Registers the backup VFS on first use. It forwards everything to the default VFS except for writes.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_register_backup_vfs(const byte_t** err)
 {
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    if (backup_vfs.zName != NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
 
-    if (result != SQLITE_OK)
+    sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+
+    if (root == NULL)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "There is no default VFS.";
         }
 
-        return STORAGE_CRITICAL_ERROR;
+        return STORAGE_ERROR;
     }
 
-    result = storage_create_todo_table();
+    backup_vfs = *root;
+    backup_vfs.pNext = NULL;
+    backup_vfs.zName = BACKUP_VFS_NAME;
+    backup_vfs.szOsFile = sizeof(storage_backup_file_t) + root->szOsFile;
+    backup_vfs.pAppData = root;
+    backup_vfs.xOpen = storage_backup_open;
 
-    if (result != SQLITE_OK)
+    if (sqlite3_vfs_register(&backup_vfs, 0) != SQLITE_OK)
     {
+        backup_vfs.zName = NULL;
+
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "Could not register the backup VFS.";
         }
 
-        return STORAGE_CRITICAL_ERROR;
+        return STORAGE_ERROR;
     }
 
-    result = storage_create_attachment_table();
+    return STORAGE_NO_ERROR;
+}
 
-    if (result != SQLITE_OK)
+/**
+ * @brief Copies the whole database from source to dest in steps of BACKUP_STEP_PAGES pages. The source is only
+ * locked for the duration of a step. Steps that find a database busy are retried for up to BUSY_TIMEOUT_MS.
+ *
+ * @param dest Connection to copy to.
+ * @param source Connection to copy from.
+ * @param progress Called after every step. Can be NULL.
+ * @param stats Receives the number of pages.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_copy_database(sqlite3* dest, sqlite3* source, storage_progress_t progress, storage_copy_stats_t* stats, const byte_t** err)
+{
+    sqlite3_backup* backup = sqlite3_backup_init(dest, "main", source, "main");
+
+    if (backup == NULL)
     {
-        if (err)
+        storage_set_db_error(dest, err);
+        return STORAGE_ERROR;
+    }
+
+    int result = SQLITE_OK;
+    int waited = 0;
+
+    while (1)
+    {
+        result = sqlite3_backup_step(backup, BACKUP_STEP_PAGES);
+
+        if ((result == SQLITE_BUSY || result == SQLITE_LOCKED) && waited < BUSY_TIMEOUT_MS)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            sqlite3_sleep(BACKUP_RETRY_MS);
+            waited += BACKUP_RETRY_MS;
+            continue;
         }
 
-        return STORAGE_CRITICAL_ERROR;
+        waited = 0;
+
+        if (result != SQLITE_OK && result != SQLITE_DONE)
+        {
+            break;
+        }
+
+        int total = sqlite3_backup_pagecount(backup);
+
+        if (progress)
+        {
+            progress(total - sqlite3_backup_remaining(backup), total);
+        }
+
+        stats->pages = total;
+
+        if (result == SQLITE_DONE)
+        {
+            break;
+        }
     }
 
-    result = sqlite3_close(sqlite_handle);
+    int finished = sqlite3_backup_finish(backup);
 
-    if (result != SQLITE_OK)
+    if (result != SQLITE_DONE)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            snprintf(error_message, BUFLEN_ERROR_MESSAGE, "%s", sqlite3_errstr(result));
+            *err = error_message;
         }
 
-        return STORAGE_CRITICAL_ERROR;
+        return STORAGE_ERROR;
+    }
+
+    if (finished != SQLITE_OK)
+    {
+        storage_set_db_error(dest, err);
+        return STORAGE_ERROR;
     }
 
     return STORAGE_NO_ERROR;
 }
 
-STORAGE_ERR_CODE storage_new_todo(const byte_t* title, const byte_t* details, const byte_t** err)
+/**
+ * @brief Copies an attachment file through a temporary file, so that the target never holds a partial copy.
+ *
+ * @param source Path of the file to copy.
+ * @param target Path of the copy.
+ * @param tmp Path of the temporary file.
+ * @param size Size of the file.
+ * @param digest If not NULL, the SHA-256 the file must have to be copied.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_copy_blob_file(const byte_t* source, const byte_t* target, const byte_t* tmp, sqlite3_int64 size, const ubyte_t* digest, const byte_t** err)
 {
-    if (!title || title[0] == 0)
+    FILE* in = fopen(source, "rb");
+
+    if (in == NULL)
     {
         if (err)
         {
-            *err = "Please provide a title.";
+            snprintf(error_message, BUFLEN_ERROR_MESSAGE, "Attachment file %.400s is missing.", source);
+            *err = error_message;
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    STORAGE_ERR_CODE status = STORAGE_NO_ERROR;
 
-    if (result != SQLITE_OK)
+    if (digest != NULL)
     {
-        if (err)
+        storage_source_t checked = { .file = in };
+        ubyte_t actual[HASH_SHA256_SIZE];
+
+        status = storage_hash_file(&checked, size, actual, err);
+
+        if (status == STORAGE_NO_ERROR && memcmp(actual, digest, HASH_SHA256_SIZE) != 0)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+            if (err)
+            {
+                snprintf(error_message, BUFLEN_ERROR_MESSAGE, "Attachment file %.400s is damaged.", source);
+                *err = error_message;
+            }
 
-        return STORAGE_ERROR;
+            status = STORAGE_ERROR;
+        }
     }
 
-    const byte_t* sql = "insert into TODOS (TITLE, DETAILS) values (?, ?)";
+    int fd = status == STORAGE_NO_ERROR ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    if (status == STORAGE_NO_ERROR && fd < 0)
+    {
+        status = storage_copy_failed(-1, err);
+    }
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        status = storage_copy_fd(fileno(in), fd, size, err);
+    }
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR && fsync(fd) != 0)
+    {
+        status = storage_copy_failed(-1, err);
+    }
+
+    if (fd >= 0 && close(fd) != 0 && status == STORAGE_NO_ERROR)
+    {
+        status = storage_copy_failed(-1, err);
     }
 
-    result = sqlite3_bind_text(statement, 1, title, strlen(title), NULL);
+    fclose(in);
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR && rename(tmp, target) != 0)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        status = storage_copy_failed(-1, err);
+    }
 
-        return STORAGE_ERROR;
+    if (status != STORAGE_NO_ERROR && fd >= 0)
+    {
+        unlink(tmp);
     }
 
-    result = sqlite3_bind_text(statement, 2, details, details == NULL ? 0 : strlen(details), NULL);
+    return status;
+}
 
-    if (result != SQLITE_OK)
+/**
+ * @brief Copies the attachment files a database refers to from one blob directory to another. Files that are
+ * already in the target are skipped, since the name of a file is the SHA-256 of its content.
+ *
+ * @param db The database whose file blobs are copied.
+ * @param from Directory to copy from. NULL if the storage backend keeps no files.
+ * @param to Directory to copy to. NULL if the storage backend keeps no files.
+ * @param verify Whether a file must match its SHA-256 to be copied.
+ * @param stats Receives the number and size of the copied files.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_copy_blob_files(sqlite3* db, const byte_t* from, const byte_t* to, bool verify, storage_copy_stats_t* stats, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(db, SCRIPTS[SCRIPT_BLOB_FILES].sql, -1, &statement, NULL);
+
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        result = sqlite3_bind_int(statement, 1, STORAGE_CODEC_FILE);
+    }
 
+    if (result != SQLITE_OK)
+    {
+        storage_set_db_error(db, err);
+        sqlite3_finalize(statement);
         return STORAGE_ERROR;
     }
 
-    int rc = sqlite3_step(statement);
+    STORAGE_ERR_CODE status = STORAGE_NO_ERROR;
+
+    byte_t source[PATH_MAX];
+    byte_t target[PATH_MAX];
+    byte_t tmp[PATH_MAX];
 
-    if (rc != SQLITE_DONE)
+    while (status == STORAGE_NO_ERROR && (result = sqlite3_step(statement)) == SQLITE_ROW)
     {
-        if (err)
+        const ubyte_t* digest = sqlite3_column_blob(statement, 0);
+        sqlite3_int64 size = sqlite3_column_int64(statement, 1);
+
+        if (digest == NULL || sqlite3_column_bytes(statement, 0) != HASH_SHA256_SIZE)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            continue;
         }
 
-        return STORAGE_ERROR;
-    }
+        if (from == NULL || to == NULL)
+        {
+            if (err)
+            {
+                *err = "The storage backend cannot keep attachment files.";
+            }
+
+            status = STORAGE_ERROR;
+            break;
+        }
 
-    result = sqlite3_finalize(statement);
+        struct stat st;
+        storage_blob_path_in(to, digest, "", target);
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        if (stat(target, &st) == 0 && st.st_size == size)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            continue;
         }
 
-        return STORAGE_ERROR;
-    }
+        mkdir(to, S_IRWXU | S_IRWXG);
 
-    result = sqlite3_close(sqlite_handle);
+        storage_blob_path_in(from, digest, "", source);
+        storage_blob_path_in(to, digest, ".tmp", tmp);
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        status = storage_copy_blob_file(source, target, tmp, size, verify ? digest : NULL, err);
+
+        if (status == STORAGE_NO_ERROR)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            stats->files++;
+            stats->file_bytes += size;
         }
+    }
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR && result != SQLITE_DONE)
+    {
+        storage_set_db_error(db, err);
+        status = STORAGE_ERROR;
     }
 
-    return STORAGE_NO_ERROR;
+    sqlite3_finalize(statement);
+
+    return status;
 }
 
-static int print_todo(void* arg, int column_count, byte_t** values, byte_t** columns)
+/**
+ * @brief Removes the files from the blob directory of a backup that the backed up database no longer refers to.
+ *
+ * @param db The backup.
+ * @param dir The blob directory of the backup.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_prune_blob_files(sqlite3* db, const byte_t* dir, const byte_t** err)
 {
-    byte_t* id = values[0];
-    byte_t* title = values[1];
-    byte_t* done = values[2];
-    byte_t* created = values[3] == NULL ? "" : values[3];
+    DIR* handle = opendir(dir);
 
-    int done_i = atoi(done);
+    if (handle == NULL)
+    {
+        return STORAGE_NO_ERROR;
+    }
 
-    printf(CYAN("%-16s")"%-64s%-16s%-24s\n", id, title, done_i == 0 ? CROSS_MARK : CHECK_MARK, created);
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(db, SCRIPTS[SCRIPT_FIND_BLOB_FILE].sql, -1, &statement, NULL);
 
-    return 0;
-}
+    if (result != SQLITE_OK)
+    {
+        storage_set_db_error(db, err);
+        closedir(handle);
+        return STORAGE_ERROR;
+    }
 
-STORAGE_ERR_CODE storage_print_todos(STORAGE_PRINT_OPTIONS option, const byte_t** err)
-{
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    struct dirent* entry;
+    byte_t path[PATH_MAX];
 
-    if (result != SQLITE_OK)
+    while (result == SQLITE_OK && (entry = readdir(handle)) != NULL)
     {
-        if (err)
+        ubyte_t digest[HASH_SHA256_SIZE];
+
+        if (!storage_blob_name_digest(entry->d_name, digest))
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            continue;
         }
 
-        return STORAGE_ERROR;
-    }
+        result = sqlite3_bind_blob(statement, 1, digest, HASH_SHA256_SIZE, NULL);
 
-    printf(MAGENTA("%-16s%-64s%-16s%-16s\n"), "Id", "Title", "Done", "Created");
+        if (result == SQLITE_OK)
+        {
+            result = sqlite3_bind_int(statement, 2, STORAGE_CODEC_FILE);
+        }
 
-    const byte_t* select = "select ID, TITLE, DONE, CREATED from TODOS ";
-    const byte_t* where = "";
+        int found = result == SQLITE_OK ? sqlite3_step(statement) : result;
+        sqlite3_reset(statement);
 
-    switch (option)
-    {
-    case ALL:
-        break;
-    case DONE:
-        where = "where DONE = 1";
-        break;
-    case OPEN:
-        where = "where DONE = 0";
-        break;
+        if (found != SQLITE_ROW && found != SQLITE_DONE)
+        {
+            result = found;
+            break;
+        }
+
+        if (found == SQLITE_DONE || strlen(entry->d_name) != 2 * HASH_SHA256_SIZE)
+        {
+            snprintf(path, PATH_MAX, "%s%s", dir, entry->d_name);
+            unlink(path);
+        }
     }
 
-    size_t select_len = strlen(select) + 1;
-    size_t where_len = strlen(where) + 1;
+    closedir(handle);
 
-    char sql[select_len + where_len];
-    memset(sql, 0, (select_len + where_len) * sizeof(char));
+    if (result != SQLITE_OK)
+    {
+        storage_set_db_error(db, err);
+    }
 
-    strcat(sql, select);
-    strcat(sql, where);
+    sqlite3_finalize(statement);
 
-    result = sqlite3_exec(sqlite_handle, sql, print_todo, NULL, NULL);
+    return result == SQLITE_OK ? STORAGE_NO_ERROR : STORAGE_ERROR;
+}
 
-    if (result != SQLITE_OK)
+/**
+ * @brief Checks that a backup is intact and not newer than this version of toodles.
+ *
+ * @param db The backup.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_verify_backup(sqlite3* db, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(db, "pragma integrity_check", -1, &statement, NULL);
+
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        result = sqlite3_step(statement);
+    }
 
+    if (result != SQLITE_ROW)
+    {
+        storage_set_db_error(db, err);
+        sqlite3_finalize(statement);
         return STORAGE_ERROR;
     }
 
-    result = sqlite3_close(sqlite_handle);
+    const ubyte_t* check = sqlite3_column_text(statement, 0);
 
-    if (result != SQLITE_OK)
+    if (check == NULL || strcmp((const byte_t*)check, "ok") != 0)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            snprintf(error_message, BUFLEN_ERROR_MESSAGE, "The backup is damaged: %.400s", check == NULL ? "" : (const byte_t*)check);
+            *err = error_message;
         }
 
+        sqlite3_finalize(statement);
         return STORAGE_ERROR;
     }
 
-    return STORAGE_NO_ERROR;
-}
+    sqlite3_finalize(statement);
 
-STORAGE_ERR_CODE storage_erase(const byte_t** err)
-{
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    result = sqlite3_prepare_v2(db, "pragma user_version", -1, &statement, NULL);
 
-    if (result != SQLITE_OK)
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        result = sqlite3_step(statement);
+    }
 
+    if (result != SQLITE_ROW)
+    {
+        storage_set_db_error(db, err);
+        sqlite3_finalize(statement);
         return STORAGE_ERROR;
     }
 
-    const byte_t* sql = "delete from TODOS";
-
-    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+    long long version = sqlite3_column_int64(statement, 0);
+    sqlite3_finalize(statement);
 
-    if (result != SQLITE_OK)
+    if (version > storage_schema_version())
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "The backup was created by a newer version of toodles.";
         }
 
         return STORAGE_ERROR;
     }
 
-    sql = "update sqlite_sequence set seq = 0 where name = 'TODOS'";
+    return STORAGE_NO_ERROR;
+}
 
-    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+/**
+ * @brief Starts a backup file as a copy of the earlier backup at path, so that only changed pages are written to
+ * it. The copy is a reflink where the filesystem supports it. Without an earlier backup nothing is copied.
+ *
+ * @param path Path of the backup.
+ * @param tmp Path of the file the new backup is written to.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_seed_backup(const byte_t* path, const byte_t* tmp, const byte_t** err)
+{
+    if (unlink(tmp) != 0 && errno != ENOENT)
+    {
+        return storage_copy_failed(-1, err);
+    }
 
-    if (result != SQLITE_OK)
+    int in = open(path, O_RDONLY);
+    struct stat st;
+
+    if (in < 0)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        return errno == ENOENT ? STORAGE_NO_ERROR : storage_copy_failed(-1, err);
+    }
 
-        return STORAGE_ERROR;
+    if (fstat(in, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(in);
+        return STORAGE_NO_ERROR;
     }
 
-    sql = "delete from ATTACHMENTS";
+    int out = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    STORAGE_ERR_CODE status = out < 0 ? storage_copy_failed(-1, err) : storage_copy_fd(in, out, st.st_size, err);
 
-    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
+    if (out >= 0 && close(out) != 0 && status == STORAGE_NO_ERROR)
+    {
+        status = storage_copy_failed(-1, err);
+    }
 
-    if (result != SQLITE_OK)
+    close(in);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        unlink(tmp);
+    }
+
+    return status;
+}
+
+STORAGE_ERR_CODE storage_backup(const byte_t* path, storage_progress_t progress, storage_copy_stats_t* stats, const byte_t** err)
+{
+    if (sqlite_handle == NULL)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "Storage is not opened.";
         }
 
         return STORAGE_ERROR;
     }
 
-    sql = "update sqlite_sequence set seq = 0 where name = 'ATTACHMENTS'";
-
-    result = sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL);
-
-    if (result != SQLITE_OK)
+    if (path == NULL || path[0] == 0)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "Please provide a file path.";
         }
 
         return STORAGE_ERROR;
     }
 
-    result = sqlite3_close(sqlite_handle);
+    byte_t resolved[PATH_MAX];
+    byte_t live[PATH_MAX];
 
-    if (result != SQLITE_OK)
+    if (realpath(path, resolved) != NULL && realpath(storage_file(), live) != NULL && strcmp(resolved, live) == 0)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "The backup cannot replace the storage file itself.";
         }
 
         return STORAGE_ERROR;
     }
 
-    return STORAGE_NO_ERROR;
-}
+    STORAGE_ERR_CODE status = storage_register_backup_vfs(err);
 
-STORAGE_ERR_CODE storage_print_search_results(const byte_t* search_str, const byte_t** err)
-{
-    if (!search_str || search_str[0] == 0)
+    if (status != STORAGE_NO_ERROR)
     {
-        search_str = "%";
+        return status;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    memset(stats, 0, sizeof(storage_copy_stats_t));
+    backup_written = 0;
+    backup_skipped = 0;
 
-    if (result != SQLITE_OK)
+    // The backup is written next to the earlier one and only replaces it once it is complete, an interrupted
+    // backup leaves the earlier one as it was.
+    byte_t tmp[PATH_MAX];
+
+    if (snprintf(tmp, PATH_MAX, "%s.tmp", path) >= PATH_MAX)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "The file path is too long.";
         }
 
         return STORAGE_ERROR;
     }
 
-    printf(MAGENTA("%-16s%-64s%-16s%-16s\n"), "Id", "Title", "Done", "Created");
-
-    const byte_t* sql = "select ID, TITLE, DONE, CREATED from TODOS where TITLE like ?";
-
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    status = storage_seed_backup(path, tmp, err);
 
-    if (result != SQLITE_OK)
+    if (status != STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        return status;
     }
 
-    byte_t* search = calloc(strlen(search_str) + 3, sizeof(char));
-    strcat(search, "%");
-    strcat(search, search_str);
-    strcat(search, "%");
+    sqlite3* dest = NULL;
+    int result = sqlite3_open_v2(tmp, &dest, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, BACKUP_VFS_NAME);
 
-    result = sqlite3_bind_text(statement, 1, search, strlen(search), NULL);
+    // Pages must be compared with what is already in the file, a rollback journal would get a copy of all of them.
+    // The file is a copy that is thrown away if the backup fails, so it needs none.
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_exec(dest, "pragma locking_mode = exclusive; pragma journal_mode = off", NULL, NULL, NULL);
+    }
 
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_db_error(dest, err);
+        sqlite3_close(dest);
+        unlink(tmp);
         return STORAGE_ERROR;
     }
 
-    while (1)
+    status = storage_copy_database(dest, sqlite_handle, progress, stats, err);
+    stats->written = backup_written;
+
+    // The copied header still asks for a write-ahead log. A backup is a single file.
+    if (status == STORAGE_NO_ERROR && sqlite3_exec(dest, "pragma journal_mode = delete", NULL, NULL, NULL) != SQLITE_OK)
     {
-        int rc = sqlite3_step(statement);
+        storage_set_db_error(dest, err);
+        status = STORAGE_ERROR;
+    }
 
-        if (rc == SQLITE_ROW)
-        {
-            const ubyte_t* id = sqlite3_column_text(statement, 0);
-            const ubyte_t* title = sqlite3_column_text(statement, 1);
+    byte_t blob_dir[PATH_MAX];
+    snprintf(blob_dir, PATH_MAX, "%s%s", path, BACKUP_BLOB_DIR_SUFFIX);
+
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_copy_blob_files(dest, active_backend->blob_dir(), blob_dir, false, stats, err);
+    }
 
-            const ubyte_t* done = sqlite3_column_text(statement, 2);
-            int done_i = atoi((const byte_t*)done);
+    sqlite3_close(dest);
 
-            const ubyte_t* created = sqlite3_column_text(statement, 3) == NULL ? (ubyte_t*)"" : sqlite3_column_text(statement, 3);
+    if (status == STORAGE_NO_ERROR)
+    {
+        int fd = open(tmp, O_RDONLY);
 
-            printf(CYAN("%-16s") "%-64s%-16s%-24s\n", id, title, done_i == 0 ? CROSS_MARK : CHECK_MARK, created);
+        if (fd < 0 || fsync(fd) != 0)
+        {
+            status = storage_copy_failed(-1, err);
         }
 
-        if (rc == SQLITE_DONE)
+        if (fd >= 0)
         {
-            break;
+            close(fd);
         }
     }
 
-    free(search);
+    if (status == STORAGE_NO_ERROR && rename(tmp, path) != 0)
+    {
+        status = storage_copy_failed(-1, err);
+    }
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        unlink(tmp);
+        return status;
+    }
 
-    result = sqlite3_finalize(statement);
+    // Only now does no backup refer to the files of the earlier one anymore.
+    sqlite3* db = NULL;
 
-    if (result != SQLITE_OK)
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        storage_set_db_error(db, err);
+        status = STORAGE_ERROR;
+    }
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_prune_blob_files(db, blob_dir, err);
     }
 
-    result = sqlite3_close(sqlite_handle);
+    sqlite3_close(db);
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_pragma_int("page_size", &stats->page_size, err);
     }
 
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
-STORAGE_ERR_CODE storage_remove_todo(const byte_t* id, const byte_t** err)
+STORAGE_ERR_CODE storage_restore(const byte_t* path, storage_progress_t progress, storage_copy_stats_t* stats, const byte_t** err)
 {
-    if (!id || id[0] == 0)
+    if (sqlite_handle == NULL)
     {
         if (err)
         {
-            *err = "Please provide an id.";
+            *err = "Storage is not opened.";
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
-
-    if (result != SQLITE_OK)
+    if (path == NULL || path[0] == 0)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = "Please provide a file path.";
         }
 
         return STORAGE_ERROR;
     }
 
-    const byte_t* sql = "delete from TODOS where ID = ?";
+    memset(stats, 0, sizeof(storage_copy_stats_t));
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    sqlite3* source = NULL;
+    int result = sqlite3_open_v2(path, &source, SQLITE_OPEN_READONLY, NULL);
 
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_db_error(source, err);
+        sqlite3_close(source);
         return STORAGE_ERROR;
     }
 
-    result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
+    // Everything is checked before the storage is touched, so a bad backup leaves it as it was.
+    STORAGE_ERR_CODE status = storage_verify_backup(source, err);
 
-    if (result != SQLITE_OK)
+    byte_t blob_dir[PATH_MAX];
+    snprintf(blob_dir, PATH_MAX, "%s%s", path, BACKUP_BLOB_DIR_SUFFIX);
+
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        status = storage_copy_blob_files(source, blob_dir, active_backend->blob_dir(), true, stats, err);
+    }
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR)
+    {
+        storage_cache_clear();
+        status = storage_copy_database(sqlite_handle, source, progress, stats, err);
     }
 
-    result = sqlite3_step(statement);
+    sqlite3_close(source);
 
-    if (result != SQLITE_DONE)
+    if (status != STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        return status;
     }
 
-    result = sqlite3_finalize(statement);
+    stats->written = stats->pages;
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+    // Backups of older versions are brought up to date like any other database.
+    sqlite3_exec(sqlite_handle, "pragma foreign_keys = off", NULL, NULL, NULL);
+    status = storage_migrate(err);
+    sqlite3_exec(sqlite_handle, "pragma foreign_keys = on", NULL, NULL, NULL);
 
-        return STORAGE_ERROR;
-    }
+    storage_cache_clear();
 
-    result = sqlite3_close(sqlite_handle);
+    // Drops the files of attachments that only the replaced database had.
+    sqlite3_int64 reclaimed = 0;
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        status = storage_sweep_blob_dir(&reclaimed, err);
+    }
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_pragma_int("page_size", &stats->page_size, err);
     }
 
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
-STORAGE_ERR_CODE storage_print_details(const byte_t* id, const byte_t** err)
+/**
+ * @brief Gives every todo without one a UID. The UID is derived from the todo itself, so copies of one database
+ * agree on the UIDs of the todos they had in common before they first synced.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_assign_uids(const byte_t** err)
 {
-    if (!id || id[0] == 0)
-    {
-        if (err)
-        {
-            *err = "Please provide an id.";
-        }
+    int result = sqlite3_create_function(sqlite_handle, "SHA256", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+        storage_sha256_function, NULL, NULL);
 
-        return STORAGE_ERROR;
+    // A todo that was received from another database may already hold the UID, that todo gets a random one.
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_exec(sqlite_handle, SCRIPTS[SCRIPT_SYNC_ASSIGN_UIDS].sql, NULL, NULL, NULL);
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
-
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        storage_set_error(err);
     }
 
-    const byte_t* sql = "select DETAILS from TODOS where ID = ?";
+    sqlite3_create_function(sqlite_handle, "SHA256", 1, SQLITE_UTF8, NULL, NULL, NULL, NULL);
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    return result == SQLITE_OK ? STORAGE_NO_ERROR : STORAGE_ERROR;
+}
 
-    if (result != SQLITE_OK)
+/**
+ * @brief Runs SQL that is part of a sync.
+ *
+ * @param sql The statements.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_exec(const byte_t* sql, const byte_t** err)
+{
+    if (sqlite3_exec(sqlite_handle, sql, NULL, NULL, NULL) != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_error(err);
         return STORAGE_ERROR;
     }
 
-    result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
+    return STORAGE_NO_ERROR;
+}
+
+/**
+ * @brief Walks through a changeset, checks that it only changes SYNC_TODOS and counts its changes.
+ *
+ * @param size Size of the changeset.
+ * @param changeset The changeset.
+ * @param touched Statement that records the UID and operation of every change. Can be NULL.
+ * @param changes Receives the number of changes.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_read_changes(int size, void* changeset, sqlite3_stmt* touched, long long* changes, const byte_t** err)
+{
+    sqlite3_changeset_iter* iter;
+    int result = sqlite3changeset_start(&iter, size, changeset);
 
     if (result != SQLITE_OK)
     {
         if (err)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *err = sqlite3_errstr(result);
         }
 
         return STORAGE_ERROR;
     }
 
-    int rc = 0;
-    rc = sqlite3_step(statement);
+    bool valid = true;
+    *changes = 0;
 
-    if (rc == SQLITE_ROW)
+    while (result == SQLITE_OK && valid && sqlite3changeset_next(iter) == SQLITE_ROW)
     {
-        const ubyte_t* details = sqlite3_column_text(statement, 0) == NULL ? (ubyte_t*)"" : sqlite3_column_text(statement, 0);
+        const char* table;
+        int columns;
+        int op;
 
-        printf("%s\n", details);
-    }
+        sqlite3changeset_op(iter, &table, &columns, &op, NULL);
 
-    result = sqlite3_finalize(statement);
+        valid = strcmp(table, "SYNC_TODOS") == 0 && columns == SYNC_COLUMNS;
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        if (valid && touched != NULL)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+            sqlite3_value* uid;
+            result = op == SQLITE_INSERT ? sqlite3changeset_new(iter, 0, &uid) : sqlite3changeset_old(iter, 0, &uid);
 
-        return STORAGE_ERROR;
-    }
+            if (result == SQLITE_OK)
+            {
+                result = sqlite3_bind_value(touched, 1, uid);
+            }
 
-    result = sqlite3_close(sqlite_handle);
+            if (result == SQLITE_OK)
+            {
+                result = sqlite3_bind_int(touched, 2, op);
+            }
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
+            if (result == SQLITE_OK)
+            {
+                result = sqlite3_step(touched) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(sqlite_handle);
+            }
+
+            sqlite3_reset(touched);
         }
 
-        return STORAGE_ERROR;
+        (*changes)++;
     }
 
-    return STORAGE_NO_ERROR;
-}
+    int finished = sqlite3changeset_finalize(iter);
 
-STORAGE_ERR_CODE storage_set_done(const byte_t* id, STORAGE_DONE_FLAG done, const byte_t** err)
-{
-    if (!id || id[0] == 0)
+    if (!valid || finished != SQLITE_OK)
     {
         if (err)
         {
-            *err = "Please provide an id.";
+            *err = "Not a toodles change file.";
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
-
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_error(err);
         return STORAGE_ERROR;
     }
 
-    const byte_t* sql = "update TODOS set DONE = 1 where ID = ?";
-
-    switch (done)
-    {
-    case STORAGE_OPEN:
-        sql = "update TODOS set DONE = 0 where ID = ?";
-        break;
-
-    case STORAGE_DONE:
-    default:
-        break;
-    }
+    return STORAGE_NO_ERROR;
+}
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+/**
+ * @brief Records the todos that changed since the last sync as a changeset. A session on SYNC_TODOS captures how
+ * the todos of SYNC_DIRTY are carried over to it, so only those are read.
+ *
+ * @param size Receives the size of the changeset.
+ * @param changeset Receives the changeset, to be freed with sqlite3_free.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_capture(int* size, void** changeset, const byte_t** err)
+{
+    sqlite3_session* session;
+    int result = sqlite3session_create(sqlite_handle, "main", &session);
 
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_error(err);
         return STORAGE_ERROR;
     }
 
-    result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
+    result = sqlite3session_attach(session, "SYNC_TODOS");
 
-    if (result != SQLITE_OK)
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        result = sqlite3_exec(sqlite_handle, SCRIPTS[SCRIPT_SYNC_CAPTURE].sql, NULL, NULL, NULL);
     }
 
-    int rc = sqlite3_step(statement);
-
-    if (rc != SQLITE_DONE)
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        result = sqlite3session_changeset(session, size, changeset);
     }
 
-    result = sqlite3_finalize(statement);
-
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        storage_set_error(err);
     }
 
-    result = sqlite3_close(sqlite_handle);
-
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
-    }
+    sqlite3session_delete(session);
 
-    return STORAGE_NO_ERROR;
+    return result == SQLITE_OK ? STORAGE_NO_ERROR : STORAGE_ERROR;
 }
 
 /**
- * @brief Reads in a given file and stores the content in buffer.
+ * @brief Writes a change file through a temporary file, so a failed write never leaves half a file behind.
  *
- * @param filepath File to read in.
- * @param buffer_size Size of the filled buffer.
- * @param buffer Buffer which contains the file content.
+ * @param path Path of the change file.
+ * @param size Size of the changeset.
+ * @param changeset The changeset.
  * @param err Pointer to error message.
  * @return STORAGE_ERR_CODE Success indicator.
  */
-static STORAGE_ERR_CODE storage_read_file(const byte_t* filepath, ssize_t* buffer_size, byte_t** buffer, const byte_t** err)
+static STORAGE_ERR_CODE storage_sync_write_file(const byte_t* path, int size, const void* changeset, const byte_t** err)
 {
-    assert(buffer != NULL);
+    byte_t tmp[PATH_MAX];
+    snprintf(tmp, PATH_MAX, "%s.tmp", path);
 
-    FILE* f = fopen(filepath, "rb");
+    FILE* file = fopen(tmp, "wb");
 
-    if (!f)
+    if (file == NULL)
     {
-        if (err)
-        {
-            int e = errno;
-            *err = strerror(e);
-        }
-
-        return STORAGE_ERROR;
+        return storage_copy_failed(-1, err);
     }
 
-    fseek(f, 0, SEEK_END);
-    *buffer_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    STORAGE_ERR_CODE status = STORAGE_NO_ERROR;
 
-    *buffer = calloc(*buffer_size, sizeof(char));
+    if ((size > 0 && fwrite(changeset, size, 1, file) != 1) || fflush(file) != 0 || fsync(fileno(file)) != 0)
+    {
+        status = storage_copy_failed(-1, err);
+    }
 
-    ssize_t read = fread(*buffer, sizeof(char), *buffer_size, f);
+    if (fclose(file) != 0 && status == STORAGE_NO_ERROR)
+    {
+        status = storage_copy_failed(-1, err);
+    }
 
-    if (read <= 0)
+    if (status == STORAGE_NO_ERROR && rename(tmp, path) != 0)
     {
-        if (err)
-        {
-            int e = errno;
-            *err = strerror(e);
-        }
+        status = storage_copy_failed(-1, err);
+    }
 
-        free(*buffer);
-        fclose(f);
-        return STORAGE_ERROR;
+    if (status != STORAGE_NO_ERROR)
+    {
+        unlink(tmp);
     }
 
-    fclose(f);
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
-STORAGE_ERR_CODE storage_attach_file(const byte_t* id, const byte_t* filepath, const byte_t** err)
+/**
+ * @brief Reads a change file into memory.
+ *
+ * @param path Path of the change file.
+ * @param size Receives the size of the changeset.
+ * @param changeset Receives the changeset, to be freed with free.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_read_file(const byte_t* path, int* size, void** changeset, const byte_t** err)
 {
-    if (!id || id[0] == 0)
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL)
     {
-        if (err)
-        {
-            *err = "Please provide an id.";
-        }
+        return storage_copy_failed(-1, err);
+    }
 
-        return STORAGE_ERROR;
+    struct stat info;
+
+    if (fstat(fileno(file), &info) != 0)
+    {
+        fclose(file);
+        return storage_copy_failed(-1, err);
     }
 
-    if (!filepath || filepath[0] == 0)
+    if (info.st_size > INT_MAX)
     {
+        fclose(file);
+
         if (err)
         {
-            *err = "Please provide a file to attach.";
+            *err = "Not a toodles change file.";
         }
 
         return STORAGE_ERROR;
     }
 
-    byte_t* filename = basename(filepath);
+    *size = (int)info.st_size;
+    *changeset = malloc(*size > 0 ? *size : 1);
 
-    if (strcmp(filename, "") == 0)
+    if (*changeset == NULL)
     {
+        fclose(file);
+
         if (err)
         {
-            *err = "Please provide a valid filename.";
+            *err = "Could not allocate memory.";
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
-
-    if (result != SQLITE_OK)
+    if (*size > 0 && fread(*changeset, *size, 1, file) != 1)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        fclose(file);
+        free(*changeset);
+        *changeset = NULL;
 
-        return STORAGE_ERROR;
+        return storage_copy_failed(-1, err);
     }
 
-    const byte_t* sql = "insert into ATTACHMENTS (NAME, TODO_ID, ATTACHMENT, SIZE) values (?, ?, ?, ?)";
+    fclose(file);
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    return STORAGE_NO_ERROR;
+}
 
-    if (result != SQLITE_OK)
+/**
+ * @brief Tells whether a conflicting row of SYNC_TODOS already holds the values a change brings.
+ *
+ * @param iter The change.
+ * @return true Every changed column already has its new value.
+ * @return false At least one column differs.
+ */
+static bool storage_sync_already_applied(sqlite3_changeset_iter* iter)
+{
+    for (int i = 0; i < SYNC_COLUMNS; i++)
     {
-        if (err)
+        sqlite3_value* wanted = NULL;
+        sqlite3_value* current = NULL;
+
+        // Updates leave the new value of unchanged columns out.
+        if (sqlite3changeset_new(iter, i, &wanted) != SQLITE_OK || wanted == NULL)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            continue;
         }
 
-        return STORAGE_ERROR;
-    }
-
-    result = sqlite3_bind_text(statement, 1, filename, strlen(filename), NULL);
-
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        if (sqlite3changeset_conflict(iter, i, &current) != SQLITE_OK || current == NULL)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            return false;
         }
 
-        return STORAGE_ERROR;
-    }
-
-    result = sqlite3_bind_text(statement, 2, id, strlen(id), NULL);
+        int type = sqlite3_value_type(wanted);
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        if (type != sqlite3_value_type(current))
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            return false;
         }
 
-        return STORAGE_ERROR;
-    }
+        if (type == SQLITE_INTEGER && sqlite3_value_int64(wanted) != sqlite3_value_int64(current))
+        {
+            return false;
+        }
 
-    ssize_t bufsz = 0;
-    byte_t* buffer = NULL;
-    result = storage_read_file(filepath, &bufsz, &buffer, err);
+        if (type == SQLITE_FLOAT && sqlite3_value_double(wanted) != sqlite3_value_double(current))
+        {
+            return false;
+        }
 
-    if (result != SQLITE_OK)
-    {
-        return STORAGE_ERROR;
+        if ((type == SQLITE_TEXT || type == SQLITE_BLOB) && (sqlite3_value_bytes(wanted) != sqlite3_value_bytes(current)
+            || memcmp(sqlite3_value_blob(wanted), sqlite3_value_blob(current), sqlite3_value_bytes(wanted)) != 0))
+        {
+            return false;
+        }
     }
 
-    result = sqlite3_bind_blob(statement, 3, buffer, bufsz, NULL);
+    return true;
+}
 
-    if (result != SQLITE_OK)
+/**
+ * @brief Resolves the conflicts of a changeset with SYNC_TODOS. A row that both databases changed takes the
+ * remote version here, which todo wins is decided afterwards by comparing it with the local todo. Changes to rows
+ * that are gone already are dropped, everything else aborts the apply.
+ *
+ * @param context Counter of the rows both databases changed.
+ * @param conflict The kind of conflict.
+ * @param iter The change.
+ * @return int How to go on with the change.
+ */
+static int storage_sync_conflict(void* context, int conflict, sqlite3_changeset_iter* iter)
+{
+    switch (conflict)
     {
-        if (err)
+    case SQLITE_CHANGESET_DATA:
+    case SQLITE_CHANGESET_CONFLICT:
+        if (!storage_sync_already_applied(iter))
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            (*(long long*)context)++;
         }
 
-        return STORAGE_ERROR;
+        return SQLITE_CHANGESET_REPLACE;
+
+    case SQLITE_CHANGESET_NOTFOUND:
+        return SQLITE_CHANGESET_OMIT;
+
+    default:
+        return SQLITE_CHANGESET_ABORT;
     }
+}
 
-    result = sqlite3_bind_int64(statement, 4, bufsz);
+/**
+ * @brief Runs a statement of a sync that takes the operation of a change as its only parameter.
+ *
+ * @param sql The statement.
+ * @param op The operation.
+ * @param count Receives the number of changed rows or, for a query, its single result. Can be NULL.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_step(const byte_t* sql, int op, long long* count, const byte_t** err)
+{
+    sqlite3_stmt* statement;
+    int result = sqlite3_prepare_v2(sqlite_handle, sql, -1, &statement, NULL);
 
-    if (result != SQLITE_OK)
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        result = sqlite3_bind_int(statement, 1, op);
+    }
 
-        return STORAGE_ERROR;
+    if (result == SQLITE_OK)
+    {
+        result = sqlite3_step(statement);
     }
 
-    result = sqlite3_step(statement);
+    if (result == SQLITE_ROW && count)
+    {
+        *count = sqlite3_column_int64(statement, 0);
+        result = SQLITE_DONE;
+    }
+    else if (result == SQLITE_DONE && count)
+    {
+        *count = sqlite3_changes(sqlite_handle);
+    }
 
     if (result != SQLITE_DONE)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        free(buffer);
-        return STORAGE_ERROR;
+        storage_set_error(err);
     }
 
-    free(buffer);
+    sqlite3_finalize(statement);
 
-    result = sqlite3_finalize(statement);
+    return result == SQLITE_DONE ? STORAGE_NO_ERROR : STORAGE_ERROR;
+}
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+/**
+ * @brief Carries the changes that were applied to SYNC_TODOS over to the todos. Removals always win. When both
+ * databases changed a todo, the later change wins, equal times are decided by the content so that both databases
+ * pick the same version. A todo that already has the content of the change takes its time if that is later, so the
+ * databases also agree on when it was changed.
+ *
+ * @param stats Receives the counts of the apply.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_sync_merge(storage_sync_stats_t* stats, const byte_t** err)
+{
+    STORAGE_ERR_CODE status = storage_sync_step(SCRIPTS[SCRIPT_SYNC_REMOVE].sql, SQLITE_DELETE, &stats->removed, err);
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_sync_step(SCRIPTS[SCRIPT_SYNC_KEPT].sql, SQLITE_DELETE, &stats->kept, err);
     }
 
-    result = sqlite3_close(sqlite_handle);
-
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_step(SCRIPTS[SCRIPT_SYNC_CHANGE].sql, SQLITE_DELETE, &stats->changed, err);
     }
 
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_sync_step(SCRIPTS[SCRIPT_SYNC_ADD].sql, SQLITE_INSERT, &stats->added, err);
+    }
 
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
-STORAGE_ERR_CODE storage_remove_attachment(const byte_t* id, const byte_t** err)
+STORAGE_ERR_CODE storage_sync_export(const byte_t* path, storage_sync_stats_t* stats, const byte_t** err)
 {
-    if (!id || id[0] == 0)
+    assert(stats != NULL);
+
+    if (sqlite_handle == NULL)
     {
         if (err)
         {
-            *err = "Please provide an id.";
+            *err = "Storage is not opened.";
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    memset(stats, 0, sizeof(storage_sync_stats_t));
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+    STORAGE_ERR_CODE status = storage_begin(err);
 
-        return STORAGE_ERROR;
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
     }
 
-    const byte_t* sql = "delete from ATTACHMENTS where ID = ?";
+    status = storage_sync_assign_uids(err);
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    int size = 0;
+    void* changeset = NULL;
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_capture(&size, &changeset, err);
     }
 
-    result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
-
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_read_changes(size, changeset, NULL, &stats->changes, err);
     }
 
-    result = sqlite3_step(statement);
-
-    if (result != SQLITE_DONE)
+    // The file is written before the new state is committed. If the commit fails, the next export repeats the
+    // changes, and applying a change twice does no harm.
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_write_file(path, size, changeset, err);
     }
 
-    result = sqlite3_finalize(statement);
-
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_commit(err);
     }
 
-    result = sqlite3_close(sqlite_handle);
-
-    if (result != SQLITE_OK)
+    if (status != STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        storage_rollback();
     }
 
-    return STORAGE_NO_ERROR;
+    sqlite3_free(changeset);
+
+    stats->bytes = size;
+
+    return status;
 }
 
-STORAGE_ERR_CODE storage_print_attachments(const byte_t* todo_id, const byte_t** err)
+STORAGE_ERR_CODE storage_sync_apply(const byte_t* path, storage_sync_stats_t* stats, const byte_t** err)
 {
-    if (!todo_id || todo_id[0] == 0)
+    assert(stats != NULL);
+
+    if (sqlite_handle == NULL)
     {
         if (err)
         {
-            *err = "Please provide an id.";
+            *err = "Storage is not opened.";
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    memset(stats, 0, sizeof(storage_sync_stats_t));
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+    int size = 0;
+    void* changeset = NULL;
 
-        return STORAGE_ERROR;
+    STORAGE_ERR_CODE status = storage_sync_read_file(path, &size, &changeset, err);
+
+    if (status != STORAGE_NO_ERROR)
+    {
+        return status;
     }
 
-    printf(MAGENTA("%-16s%-64s%-16s\n"), "Id", "Name", "Size in bytes");
+    stats->bytes = size;
+    status = storage_begin(err);
 
-    const byte_t* sql = "select t.ID, t.NAME, t.SIZE from ATTACHMENTS t where t.TODO_ID = ?";
+    if (status != STORAGE_NO_ERROR)
+    {
+        free(changeset);
+        return status;
+    }
 
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    status = storage_sync_assign_uids(err);
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_exec(SCRIPTS[SCRIPT_SYNC_TOUCHED_CREATE].sql, err);
     }
 
-    result = sqlite3_bind_text(statement, 1, todo_id, strlen(todo_id), NULL);
+    sqlite3_stmt* touched = NULL;
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR
+        && sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_SYNC_TOUCH].sql, -1, &touched, NULL) != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        storage_set_error(err);
+        status = STORAGE_ERROR;
     }
 
-    while (1)
+    if (status == STORAGE_NO_ERROR)
     {
-        int rc = sqlite3_step(statement);
+        status = storage_sync_read_changes(size, changeset, touched, &stats->changes, err);
+    }
 
-        if (rc == SQLITE_ROW)
-        {
-            const ubyte_t* id = sqlite3_column_text(statement, 0);
-            const ubyte_t* name = sqlite3_column_text(statement, 1);
-            sqlite3_int64 size = sqlite3_column_int64(statement, 2);
+    sqlite3_finalize(touched);
 
-            printf(CYAN("%-16s") "%-64s%-16lld\n", id, name, size);
-        }
+    if (status == STORAGE_NO_ERROR)
+    {
+        int result = sqlite3changeset_apply(sqlite_handle, size, changeset, NULL, storage_sync_conflict, &stats->conflicts);
 
-        if (rc == SQLITE_DONE)
+        if (result != SQLITE_OK)
         {
-            break;
+            if (err)
+            {
+                *err = result == SQLITE_ABORT ? "The change file does not fit this storage." : sqlite3_errstr(result);
+            }
+
+            status = STORAGE_ERROR;
         }
     }
 
-    result = sqlite3_finalize(statement);
-
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_merge(stats, err);
     }
 
-    result = sqlite3_close(sqlite_handle);
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_sync_exec(SCRIPTS[SCRIPT_SYNC_TOUCHED_DROP].sql, err);
+    }
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+        status = storage_commit(err);
+    }
 
-        return STORAGE_ERROR;
+    if (status != STORAGE_NO_ERROR)
+    {
+        storage_rollback();
     }
 
-    return STORAGE_NO_ERROR;
+    free(changeset);
+
+    return status;
 }
 
-STORAGE_ERR_CODE storage_print_attachment_content(const byte_t* attachment_id, const byte_t** err)
+STORAGE_ERR_CODE storage_print_all_todos_page(STORAGE_PRINT_OPTIONS option, long long after, int limit, long long* next, const byte_t** err)
 {
-    if (!attachment_id || attachment_id[0] == 0)
+    bool attached = false;
+    STORAGE_ERR_CODE status = storage_attach_archive(false, &attached, err);
+
+    if (status != STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = "Please provide an id.";
-        }
+        return status;
+    }
 
-        return STORAGE_ERROR;
+    if (!attached)
+    {
+        return storage_print_todos_page(option, after, limit, next, err);
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    STORAGE_STATEMENT key = STMT_PAGE_ARCHIVE_ALL;
 
-    if (result != SQLITE_OK)
+    switch (option)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+    case ALL:
+        break;
+    case DONE:
+        key = STMT_PAGE_ARCHIVE_DONE;
+        break;
+    case OPEN:
+        key = STMT_PAGE_ARCHIVE_OPEN;
+        break;
+    }
+
+    if (next)
+    {
+        *next = 0;
+    }
+
+    return storage_print_page(key, after, limit, next, err);
+}
+
+/**
+ * @brief Gives the archive the files of the file blobs of a batch. A hard link costs no copying, and the file in
+ * the blob directory is removed as usual once no todo in the storage refers to it anymore.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_archive_blob_files(const byte_t** err)
+{
+    const byte_t* dir = active_backend->archive_blob_dir();
 
-        return STORAGE_ERROR;
+    if (dir == NULL)
+    {
+        return STORAGE_NO_ERROR;
     }
 
-    const byte_t* sql = "select t.ATTACHMENT from ATTACHMENTS t where t.ID = ?";
-
     sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    int result = sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_ARCHIVE_BLOB_FILES].sql, -1, &statement, NULL);
 
-    if (result != SQLITE_OK)
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        result = sqlite3_bind_int(statement, 1, STORAGE_CODEC_FILE);
     }
 
-    result = sqlite3_bind_text(statement, 1, attachment_id, strlen(attachment_id), NULL);
-
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_error(err);
+        sqlite3_finalize(statement);
         return STORAGE_ERROR;
     }
 
-    int rc = 0;
-    rc = sqlite3_step(statement);
-
-    if (rc == SQLITE_ROW)
-    {
-        const ubyte_t* content = sqlite3_column_text(statement, 0) == NULL ? (ubyte_t*)"" : sqlite3_column_text(statement, 0);
+    STORAGE_ERR_CODE status = STORAGE_NO_ERROR;
 
-        printf("%s\n", content);
-    }
+    byte_t source[PATH_MAX];
+    byte_t target[PATH_MAX];
+    byte_t tmp[PATH_MAX];
 
-    result = sqlite3_finalize(statement);
+    result = SQLITE_DONE;
 
-    if (result != SQLITE_OK)
+    while (status == STORAGE_NO_ERROR && (result = sqlite3_step(statement)) == SQLITE_ROW)
     {
-        if (err)
+        if (sqlite3_column_bytes(statement, 0) != HASH_SHA256_SIZE)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            continue;
         }
 
-        return STORAGE_ERROR;
-    }
+        const ubyte_t* digest = sqlite3_column_blob(statement, 0);
 
-    result = sqlite3_close(sqlite_handle);
+        storage_blob_file_path(digest, "", source);
+        storage_blob_path_in(dir, digest, "", target);
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        if (mkdir(dir, S_IRWXU | S_IRWXG) != 0 && errno != EEXIST)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            status = storage_copy_failed(-1, err);
+            break;
         }
 
-        return STORAGE_ERROR;
+        if (link(source, target) == 0 || errno == EEXIST)
+        {
+            continue;
+        }
+
+        // The archive sits on another file system.
+        storage_blob_path_in(dir, digest, ".tmp", tmp);
+        status = storage_copy_blob_file(source, target, tmp, sqlite3_column_int64(statement, 1), NULL, err);
     }
 
-    return STORAGE_NO_ERROR;
+    if (status == STORAGE_NO_ERROR && result != SQLITE_DONE)
+    {
+        storage_set_error(err);
+        status = STORAGE_ERROR;
+    }
+
+    sqlite3_finalize(statement);
+
+    return status;
 }
 
-STORAGE_ERR_CODE storage_save_attachment_to_disk(const byte_t* attachment_id, const byte_t* save_path, const byte_t** err)
+/**
+ * @brief Drops todos from the archive that are still in the storage, and their attachments. They are left over from
+ * a move that copied a batch but was interrupted before it removed the batch from the storage.
+ *
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_archive_recover(const byte_t** err)
 {
-    if (!attachment_id || attachment_id[0] == 0)
-    {
-        if (err)
-        {
-            *err = "Please provide an id.";
-        }
+    STORAGE_ERR_CODE status = storage_begin(err);
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_RECOVER].sql, err);
     }
 
-    if (!save_path || save_path[0] == 0)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = "Please provide a path for saving.";
-        }
-
-        return STORAGE_ERROR;
+        status = storage_commit(err);
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
-
-    if (result != SQLITE_OK)
+    if (status != STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        storage_rollback();
     }
 
-    const byte_t* sql = "select t.ATTACHMENT from ATTACHMENTS t where t.ID = ?";
+    return status;
+}
 
+/**
+ * @brief Copies one batch of todos and their attachments from the storage into the archive. Only the archive is
+ * written, the todos stay in the storage until storage_archive_remove.
+ *
+ * @param cutoff UTC time before which a todo must have been completed.
+ * @param cursor Id after which the batch starts. Receives the last id of the batch.
+ * @param todos Receives the number of copied todos.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_archive_copy(const byte_t* cutoff, long long* cursor, long long* todos, const byte_t** err)
+{
     sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
+    int result = sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_ARCHIVE_SELECT].sql, -1, &statement, NULL);
 
-    if (result != SQLITE_OK)
+    if (result == SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        sqlite3_bind_int64(statement, 1, *cursor);
+        sqlite3_bind_text(statement, 2, cutoff, -1, NULL);
+        sqlite3_bind_int(statement, 3, ARCHIVE_BATCH_TODOS);
+        result = sqlite3_step(statement) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(sqlite_handle);
     }
 
-    result = sqlite3_bind_text(statement, 1, attachment_id, strlen(attachment_id), NULL);
+    sqlite3_finalize(statement);
 
     if (result != SQLITE_OK)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_error(err);
         return STORAGE_ERROR;
     }
 
-    int rc = 0;
-    rc = sqlite3_step(statement);
+    *todos = sqlite3_changes(sqlite_handle);
 
-    if (rc == SQLITE_ROW)
+    if (*todos == 0)
     {
-        const ubyte_t* content = sqlite3_column_text(statement, 0) == NULL ? (ubyte_t*)"" : sqlite3_column_text(statement, 0);
-
-        FILE* f = fopen(save_path, "w");
-
-        if (f == NULL)
-        {
-            if (err)
-            {
-                int e = errno;
-                *err = strerror(e);
-            }
-
-            return STORAGE_ERROR;
-        }
-
-        size_t cl = strlen((byte_t*)content);
-        size_t written = fwrite(content, sizeof(ubyte_t), cl, f);
-
-        if (written != cl)
-        {
-            if (err)
-            {
-                int e = errno;
-                *err = strerror(e);
-            }
-
-            fclose(f);
-
-            return STORAGE_ERROR;
-        }
-
-        fclose(f);
+        return STORAGE_NO_ERROR;
     }
 
-    result = sqlite3_finalize(statement);
+    STORAGE_ERR_CODE status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_BLOBS].sql, err);
 
-    if (result != SQLITE_OK)
+    // storage_archive_recover leaves no todo of the storage in the archive, so the plain inserts cannot collide.
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_COPY].sql, err);
     }
 
-    result = sqlite3_close(sqlite_handle);
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_archive_blob_files(err);
+    }
 
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
+        if (sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_ARCHIVE_CURSOR].sql, -1, &statement, NULL) != SQLITE_OK
+            || sqlite3_step(statement) != SQLITE_ROW)
+        {
+            storage_set_error(err);
+            status = STORAGE_ERROR;
+        }
+        else
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *cursor = sqlite3_column_int64(statement, 0);
         }
 
-        return STORAGE_ERROR;
+        sqlite3_finalize(statement);
     }
 
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
-STORAGE_ERR_CODE storage_get_details(const byte_t* id, byte_t* buffer, size_t buflen, size_t* written, const byte_t** err)
+/**
+ * @brief Removes the todos of the batch that storage_archive_copy copied from the storage. Todos that were changed
+ * in between, or got or lost attachments, are dropped from the archive instead and stay. The removals show up in
+ * the change feed as archive events rather than deletes.
+ *
+ * @param todos Receives the number of moved todos.
+ * @param attachments Receives the number of moved attachments.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+static STORAGE_ERR_CODE storage_archive_remove(long long* todos, long long* attachments, const byte_t** err)
 {
-    assert(buffer != NULL);
+    STORAGE_ERR_CODE status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_UNDO].sql, err);
 
-    if (!id || id[0] == 0)
+    long long seq = 0;
+    sqlite3_stmt* statement;
+
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
+        if (sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_ARCHIVE_FEED_SEQ].sql, -1, &statement, NULL) != SQLITE_OK
+            || sqlite3_step(statement) != SQLITE_ROW)
         {
-            *err = "Please provide an id.";
+            storage_set_error(err);
+            status = STORAGE_ERROR;
         }
-
-        return STORAGE_ERROR;
-    }
-
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
-
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        else
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            seq = sqlite3_column_int64(statement, 0);
         }
 
-        return STORAGE_ERROR;
+        sqlite3_finalize(statement);
     }
 
-    const byte_t* sql = "select t.DETAILS from TODOS t where t.ID = ?";
-
-    sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
-
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_REMOVE].sql, err);
+        *todos = sqlite3_changes(sqlite_handle);
     }
 
-    result = sqlite3_bind_text(statement, 1, id, strlen(id), NULL);
-
-    if (result != SQLITE_OK)
+    // Archived todos leave the sync as well, other storages keep their copy.
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_UNSYNC].sql, err);
     }
 
-    result = sqlite3_step(statement);
-
-    if (result != SQLITE_ROW && result != SQLITE_DONE)
+    // The delete triggers of the feed cannot tell a move from a removal, the events of this transaction are ours.
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
+        int result = sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_ARCHIVE_FEED].sql, -1, &statement, NULL);
+
+        if (result == SQLITE_OK)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            sqlite3_bind_int64(statement, 1, seq);
+            result = sqlite3_step(statement) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(sqlite_handle);
         }
 
-        return STORAGE_ERROR;
-    }
-    else
-    {
-        const ubyte_t* details = sqlite3_column_text(statement, 0);
+        sqlite3_finalize(statement);
 
-        if (details)
+        if (result != SQLITE_OK)
         {
-            for (size_t i = 0; i < buflen - 1; i++)
-            {
-                if (details[i] == 0)
-                {
-                    break;
-                }
-
-                buffer[i] = details[i];
-                *written = i + 1;
-            }
+            storage_set_error(err);
+            status = STORAGE_ERROR;
         }
     }
 
-    result = sqlite3_finalize(statement);
-
-    if (result != SQLITE_OK)
+    if (status == STORAGE_NO_ERROR)
     {
-        if (err)
+        if (sqlite3_prepare_v2(sqlite_handle, SCRIPTS[SCRIPT_ARCHIVE_ATTACHMENTS].sql, -1, &statement, NULL) != SQLITE_OK
+            || sqlite3_step(statement) != SQLITE_ROW)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            storage_set_error(err);
+            status = STORAGE_ERROR;
         }
-
-        return STORAGE_ERROR;
-    }
-
-    result = sqlite3_close(sqlite_handle);
-
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        else
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            *attachments = sqlite3_column_int64(statement, 0);
         }
 
-        return STORAGE_ERROR;
+        sqlite3_finalize(statement);
     }
 
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
-STORAGE_ERR_CODE storage_save_details(const byte_t* id, byte_t* buffer, size_t buflen, const byte_t** err)
+STORAGE_ERR_CODE storage_archive(int days, long long* todos, long long* attachments, const byte_t** err)
 {
-    assert(buffer != NULL);
+    assert(todos != NULL && attachments != NULL);
 
-    if (!id || id[0] == 0)
+    *todos = 0;
+    *attachments = 0;
+
+    if (sqlite_handle == NULL)
     {
         if (err)
         {
-            *err = "Please provide an id.";
+            *err = "Storage is not opened.";
         }
 
         return STORAGE_ERROR;
     }
 
-    int result = sqlite3_open(storage_file_path, &sqlite_handle);
+    bool attached = false;
+    STORAGE_ERR_CODE status = storage_attach_archive(true, &attached, err);
 
-    if (result != SQLITE_OK)
+    if (status != STORAGE_NO_ERROR)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
-        return STORAGE_ERROR;
+        return status;
     }
 
-    const byte_t* sql = "update TODOS set DETAILS = ? where ID = ?";
+    byte_t cutoff_sql[BUFLEN_ARCHIVE_SQL];
+    snprintf(cutoff_sql, BUFLEN_ARCHIVE_SQL, "select strftime('%%Y-%%m-%%d %%H:%%M:%%f', 'now', '-%d days')", days);
 
+    byte_t cutoff[BUFLEN_ARCHIVE_SQL] = { 0 };
     sqlite3_stmt* statement;
-    result = sqlite3_prepare(sqlite_handle, sql, strlen(sql), &statement, NULL);
 
-    if (result != SQLITE_OK)
+    if (sqlite3_prepare_v2(sqlite_handle, cutoff_sql, -1, &statement, NULL) != SQLITE_OK || sqlite3_step(statement) != SQLITE_ROW)
     {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
-
+        storage_set_error(err);
+        sqlite3_finalize(statement);
         return STORAGE_ERROR;
     }
 
-    result = sqlite3_bind_text(statement, 1, buffer, strlen(buffer), NULL);
+    snprintf(cutoff, BUFLEN_ARCHIVE_SQL, "%s", (const byte_t*)sqlite3_column_text(statement, 0));
+    sqlite3_finalize(statement);
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
-        }
+    status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_BATCH_CREATE].sql, err);
 
-        return STORAGE_ERROR;
+    if (status == STORAGE_NO_ERROR)
+    {
+        status = storage_archive_recover(err);
     }
 
-    result = sqlite3_bind_text(statement, 2, id, strlen(id), NULL);
+    long long cursor = 0;
 
-    if (result != SQLITE_OK)
+    // Every batch is copied in one transaction and removed in the next, so an interruption leaves at worst copies of
+    // todos that are still in the storage, which the view hides and the next run drops. Other processes get the lock
+    // in between.
+    while (status == STORAGE_NO_ERROR)
     {
-        if (err)
+        status = storage_begin(err);
+
+        long long copied = 0;
+        long long moved = 0;
+        long long moved_attachments = 0;
+
+        if (status == STORAGE_NO_ERROR)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            status = storage_sync_exec(SCRIPTS[SCRIPT_ARCHIVE_BATCH_CLEAR].sql, err);
         }
 
-        return STORAGE_ERROR;
-    }
-
-    result = sqlite3_step(statement);
+        if (status == STORAGE_NO_ERROR)
+        {
+            status = storage_archive_copy(cutoff, &cursor, &copied, err);
+        }
 
-    if (result != SQLITE_DONE)
-    {
-        if (err)
+        if (status == STORAGE_NO_ERROR)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            status = storage_commit(err);
         }
 
-        return STORAGE_ERROR;
-    }
+        if (status == STORAGE_NO_ERROR && copied > 0)
+        {
+            status = storage_begin(err);
 
-    result = sqlite3_finalize(statement);
+            if (status == STORAGE_NO_ERROR)
+            {
+                status = storage_archive_remove(&moved, &moved_attachments, err);
+            }
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
-        {
-            *err = sqlite3_errmsg(sqlite_handle);
+            if (status == STORAGE_NO_ERROR)
+            {
+                status = storage_commit(err);
+            }
         }
 
-        return STORAGE_ERROR;
-    }
-
-    result = sqlite3_close(sqlite_handle);
+        if (status != STORAGE_NO_ERROR)
+        {
+            storage_rollback();
+            break;
+        }
 
-    if (result != SQLITE_OK)
-    {
-        if (err)
+        if (copied == 0)
         {
-            *err = sqlite3_errmsg(sqlite_handle);
+            break;
         }
 
-        return STORAGE_ERROR;
+        *todos += moved;
+        *attachments += moved_attachments;
+
+        // Files of blobs that only archived todos referred to leave the blob directory of the storage.
+        status = storage_collect_files(err);
     }
 
-    return STORAGE_NO_ERROR;
+    return status;
 }
 
 const byte_t* storage_file()
 {
-    return storage_file_path;
+    return active_backend->location();
+}
+
+const byte_t* storage_backend()
+{
+    return active_backend->name;
 }
\ No newline at end of file
@@ -22,6 +22,8 @@ SOFTWARE. */
 
 #pragma once
 
+#include <stdbool.h>
+
 #include "../symbols/symbols.h"
 #include "../types/types.h"
 
@@ -60,6 +62,48 @@ typedef enum
 
 } STORAGE_DONE_FLAG;
 
+/**
+ * @brief Counts of a backup or restore.
+ *
+ */
+typedef struct
+{
+    long long pages;
+    long long page_size;
+
+    /**
+     * @brief Pages that were written. A backup over an earlier one skips the pages that did not change.
+     *
+     */
+    long long written;
+
+    long long files;
+    long long file_bytes;
+
+} storage_copy_stats_t;
+
+/**
+ * @brief Receives the number of copied pages and the total after every step of a backup or restore.
+ *
+ */
+typedef void (*storage_progress_t)(long long copied, long long total);
+
+/**
+ * @brief Counts of a sync.
+ *
+ */
+typedef struct
+{
+    long long changes;
+    long long bytes;
+    long long added;
+    long long changed;
+    long long removed;
+    long long conflicts;
+    long long kept;
+
+} storage_sync_stats_t;
+
 /**
  * @brief Returns the equivalent print option for the given string.
  *
@@ -77,7 +121,7 @@ STORAGE_PRINT_OPTIONS storage_str_to_option(const wchar_t* option);
 STORAGE_ERR_CODE storage_init(const byte_t** err);
 
 /**
- * @brief Creates a new storage for todo entries.
+ * @brief Creates a new storage for todo entries and keeps it open until storage_shutdown is called.
  *
  * @param err Pointer to error message.
  *
@@ -85,6 +129,159 @@ STORAGE_ERR_CODE storage_init(const byte_t** err);
  */
 STORAGE_ERR_CODE storage_new_storage(const byte_t** err);
 
+/**
+ * @brief Selects the storage profile (safe, fast or bulk) that sets journal mode, synchronous, mmap size,
+ * cache size and temp store. Applied right away if the storage is open, otherwise when it is opened.
+ *
+ * @param name Name of the profile.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_set_profile(const byte_t* name, const byte_t** err);
+
+/**
+ * @brief Returns the name of the active storage profile.
+ *
+ * @return const byte_t* Name of the profile.
+ */
+const byte_t* storage_profile();
+
+/**
+ * @brief Prints the active storage profile and the settings of the open connection.
+ *
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_print_environment(const byte_t** err);
+
+/**
+ * @brief Starts the write-behind worker. From then on storage_new_todo, storage_set_done and storage_remove_todo
+ * only queue their write and return. The worker applies queued writes in shared transactions.
+ *
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_start_writer(const byte_t** err);
+
+/**
+ * @brief Starts the worker without write-behind, so that it only purges removed todos while the caller is idle.
+ * The caller must use storage_flush and storage_resume_purge around every use of the storage.
+ *
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_start_purger(const byte_t** err);
+
+/**
+ * @brief Returns true if the worker is running with write-behind.
+ *
+ * @return bool Write-behind indicator.
+ */
+bool storage_write_behind();
+
+/**
+ * @brief Waits until the write-behind worker applied all queued writes and pauses its background purge. Must be
+ * called before reading from the storage while the worker is running.
+ *
+ * @param err Pointer to error message, set if queued writes failed since the last flush.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_flush(const byte_t** err);
+
+/**
+ * @brief Lets the write-behind worker continue purging removed todos in the background after a flush. To be
+ * called once the caller is done with the storage.
+ */
+void storage_resume_purge();
+
+/**
+ * @brief Flushes and stops the write-behind worker.
+ *
+ * @param err Pointer to error message, set if queued writes failed since the last flush.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_stop_writer(const byte_t** err);
+
+/**
+ * @brief Gives the free pages of the storage file back to the file system. The first call switches the database to
+ * incremental auto_vacuum with one full vacuum, after that free pages are released in steps of a few megabytes.
+ *
+ * @param pages Receives the number of pages afterwards. Can be NULL.
+ * @param free_pages Receives the number of free pages afterwards. Can be NULL.
+ * @param reclaimed Receives the number of bytes the file shrank by. Can be NULL.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_compact(long long* pages, long long* free_pages, long long* reclaimed, const byte_t** err);
+
+/**
+ * @brief Copies the storage to a file while it stays usable. The copy runs in steps of a few megabytes, and other
+ * processes can read and write in between. Attachment files are copied to a directory named like the file plus
+ * ".blobs". If the file holds an earlier backup, only pages and attachment files that changed are written. The
+ * backup is written to a copy of the file that replaces it once it is complete.
+ *
+ * @param path Path of the backup.
+ * @param progress Called after every step. Can be NULL.
+ * @param stats Receives the counts of the backup.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_backup(const byte_t* path, storage_progress_t progress, storage_copy_stats_t* stats, const byte_t** err);
+
+/**
+ * @brief Replaces the storage with a backup. The backup and its attachment files are verified first, a damaged
+ * backup leaves the storage untouched. Backups of older versions are migrated.
+ *
+ * @param path Path of the backup.
+ * @param progress Called after every step. Can be NULL.
+ * @param stats Receives the counts of the restore.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_restore(const byte_t* path, storage_progress_t progress, storage_copy_stats_t* stats, const byte_t** err);
+
+/**
+ * @brief Writes the todos that were added, changed or removed since the last export to a change file. Attachments
+ * are not part of it.
+ *
+ * @param path Path of the change file.
+ * @param stats Receives the number of changes and the size of the file.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_sync_export(const byte_t* path, storage_sync_stats_t* stats, const byte_t** err);
+
+/**
+ * @brief Applies a change file that another storage exported. When both changed the same todo, the later change
+ * wins. Removals always win.
+ *
+ * @param path Path of the change file.
+ * @param stats Receives the counts of the apply.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_sync_apply(const byte_t* path, storage_sync_stats_t* stats, const byte_t** err);
+
+/**
+ * @brief Stops the write-behind worker, finalizes all cached statements and closes the storage.
+ *
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_shutdown(const byte_t** err);
+
 /**
  * @brief Creates a new todo with given data.
  *
@@ -106,7 +303,35 @@ STORAGE_ERR_CODE storage_new_todo(const byte_t* title, const byte_t* details, co
 STORAGE_ERR_CODE storage_print_todos(STORAGE_PRINT_OPTIONS option, const byte_t** err);
 
 /**
- * @brief Erases all entries from the database.
+ * @brief Prints one page of entries in id order. Pages are addressed by the last id of the previous page,
+ * so every page costs the same no matter how deep into the table it is.
+ *
+ * @param option Which entries to print.
+ * @param after Cursor returned for the previous page or 0 for the first page.
+ * @param limit Maximum number of entries on the page or -1 for all remaining entries.
+ * @param next Receives the cursor for the next page or 0 if this was the last page. Can be NULL.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_print_todos_page(STORAGE_PRINT_OPTIONS option, long long after, int limit, long long* next, const byte_t** err);
+
+/**
+ * @brief Prints one page of entries like storage_print_todos_page, including the archived ones.
+ *
+ * @param option Which entries to print.
+ * @param after Cursor returned for the previous page or 0 for the first page.
+ * @param limit Maximum number of entries on the page or -1 for all remaining entries.
+ * @param next Receives the cursor for the next page or 0 if this was the last page. Can be NULL.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_print_all_todos_page(STORAGE_PRINT_OPTIONS option, long long after, int limit, long long* next, const byte_t** err);
+
+/**
+ * @brief Erases all entries from the database and the archive. Only marks the todos as erased and moves the archive
+ * files into the trash directory, the purge deletes both later.
  *
  * @param err Pointer to error message.
  *
@@ -124,45 +349,50 @@ STORAGE_ERR_CODE storage_erase(const byte_t** err);
 STORAGE_ERR_CODE storage_print_search_results(const byte_t* search_str, const byte_t** err);
 
 /**
- * @brief Removes the entry with given id from the database.
+ * @brief Removes the entries with given ids from the database in a single transaction.
  *
- * @param id Id of the entry that should be deleted.
+ * @param ids Ids and ranges of ids, separated by commas or spaces, e.g. "4,7,10-250".
+ * @param affected Receives the number of removed entries. Can be NULL.
  * @param err Pointer to error message.
  *
  * @return STORAGE_ERR_CODE Success indicator.
  */
-STORAGE_ERR_CODE storage_remove_todo(const byte_t* id, const byte_t** err);
+STORAGE_ERR_CODE storage_remove_todo(const byte_t* ids, size_t* affected, const byte_t** err);
 
 /**
- * @brief Prints the details of the entry with given id.
+ * @brief Prints the details of the entries with given ids. Every entry is headed by its id and title
+ * unless a single id is given.
  *
- * @param id The id of the entry.
+ * @param ids Ids and ranges of ids, separated by commas or spaces, e.g. "3 5 9".
  * @param err Pointer to error message.
  *
  * @return STORAGE_ERR_CODE Success indicator.
  */
-STORAGE_ERR_CODE storage_print_details(const byte_t* id, const byte_t** err);
+STORAGE_ERR_CODE storage_print_details(const byte_t* ids, const byte_t** err);
 
 /**
- * @brief Sets the entry with given id to done.
+ * @brief Sets the entries with given ids to done or open in a single transaction.
  *
- * @param id Id of the entry.
+ * @param ids Ids and ranges of ids, separated by commas or spaces, e.g. "4,7,10-250".
  * @param done The done flag.
+ * @param affected Receives the number of changed entries. Can be NULL.
  * @param err Pointer to error message.
  *
  * @return STORAGE_ERR_CODE Success indicator.
  */
-STORAGE_ERR_CODE storage_set_done(const byte_t* id, STORAGE_DONE_FLAG done, const byte_t** err);
+STORAGE_ERR_CODE storage_set_done(const byte_t* ids, STORAGE_DONE_FLAG done, size_t* affected, const byte_t** err);
 
 /**
- * @brief Stores a file in the attachments table for the todo entry with given id.
+ * @brief Stores a file in the attachments table for the todo entry with given id. Pipes and other special files
+ * are read until their end.
  *
  * @param id Id of the todo entry.
  * @param filepath Path of the file that should be attached.
+ * @param size Receives the number of attached bytes. Can be NULL.
  * @param err Pointer to error message.
  * @return STORAGE_ERR_CODE Success indicator.
  */
-STORAGE_ERR_CODE storage_attach_file(const byte_t* id, const byte_t* filepath, const byte_t** err);
+STORAGE_ERR_CODE storage_attach_file(const byte_t* id, const byte_t* filepath, long long* size, const byte_t** err);
 
 /**
  * @brief Removes an attachment from the database.
@@ -174,6 +404,31 @@ STORAGE_ERR_CODE storage_attach_file(const byte_t* id, const byte_t* filepath, c
  */
 STORAGE_ERR_CODE storage_remove_attachment(const byte_t* id, const byte_t** err);
 
+/**
+ * @brief Purges removed todos, then deletes attachments whose todo no longer exists, blobs without attachments and
+ * files in the blob directory that no blob refers to. Databases created before todo removal cascaded to attachments
+ * collected such leftovers.
+ *
+ * @param attachments Receives the number of deleted attachments. Can be NULL.
+ * @param reclaimed Receives the number of bytes that were freed in the database and the blob directory. Can be NULL.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_sweep_orphans(size_t* attachments, long long* reclaimed, const byte_t** err);
+
+/**
+ * @brief Deletes removed and erased todos together with their attachments, in batches of one transaction each, and
+ * then the files of erased archives. The worker does the same in the background whenever it is idle.
+ *
+ * @param budget_ms Time after which no further batch is started, -1 to purge everything.
+ * @param purged Receives the number of deleted todos and archive files. Can be NULL.
+ * @param err Pointer to error message.
+ *
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_purge(long long budget_ms, long long* purged, const byte_t** err);
+
 /**
  * @brief Prints attachments for the given todo.
  *
@@ -228,8 +483,64 @@ STORAGE_ERR_CODE storage_get_details(const byte_t* id, byte_t* buffer, size_t bu
 STORAGE_ERR_CODE storage_save_details(const byte_t* id, byte_t* buffer, size_t buflen, const byte_t** err);
 
 /**
- * @brief Returns the path to the storage file.
+ * @brief Imports todo entries from a JSONL, CSV or todo.txt file in a single transaction. The format is
+ * chosen by the file extension. Nothing is imported if the file contains an error.
+ *
+ * @param filepath Path of the file to import.
+ * @param imported Receives the number of imported todo entries.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_import(const byte_t* filepath, size_t* imported, const byte_t** err);
+
+/**
+ * @brief Streams all todo entries, optionally joined with their attachment metadata, as JSONL or CSV.
+ * The rows are read in one read transaction and written one by one, so memory use does not grow with the table.
+ *
+ * @param filepath Path of the output file or NULL for stdout.
+ * @param format Name of the format (jsonl or csv) or NULL to choose by file extension.
+ * @param attachments True if attachment metadata should be exported.
+ * @param exported Receives the number of exported todo entries.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_export(const byte_t* filepath, const byte_t* format, bool attachments, size_t* exported, const byte_t** err);
+
+/**
+ * @brief Streams the events of the change feed after the given sequence number as JSONL, each with the current
+ * state of its todo or attachment. Fails if events after since were already pruned.
+ *
+ * @param since Sequence number of the last event already seen, 0 for all events.
+ * @param filepath Path of the output file or NULL for stdout.
+ * @param printed Receives the number of printed events.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_print_changes(long long since, const byte_t* filepath, size_t* printed, const byte_t** err);
+
+/**
+ * @brief Moves completed todos that were last changed more than the given number of days ago, together with
+ * their attachments, into the archive database next to the storage. Every batch is copied in one transaction and
+ * removed from the storage in the next, the change feed records the removals as archive events.
+ *
+ * @param days Minimum age in days.
+ * @param todos Receives the number of archived todos.
+ * @param attachments Receives the number of archived attachments.
+ * @param err Pointer to error message.
+ * @return STORAGE_ERR_CODE Success indicator.
+ */
+STORAGE_ERR_CODE storage_archive(int days, long long* todos, long long* attachments, const byte_t** err);
+
+/**
+ * @brief Returns the path to the storage file or :memory: for the memory backend.
  *
  * @return const byte_t* Storage file.
  */
-const byte_t* storage_file();
\ No newline at end of file
+const byte_t* storage_file();
+
+/**
+ * @brief Returns the name of the storage backend (file or memory), chosen through TOODLES_STORAGE_BACKEND.
+ *
+ * @return const byte_t* Name of the backend.
+ */
+const byte_t* storage_backend();
\ No newline at end of file
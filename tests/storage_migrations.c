@@ -0,0 +1,451 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+// The migrations and the schema version are internal to the storage, so it is compiled into this test.
+#include "../src/storage/storage.c"
+
+#include "test.h"
+
+#define TEST_TODOS 1000
+#define TEST_ATTACHMENTS 12
+#define TEST_ATTACHMENT_MAX (256 * 1024)
+
+/**
+ * @brief The schema that toodles 1.0 created. It had no user_version and kept attachment contents in the
+ * attachment table.
+ *
+ */
+static const byte_t* SCHEMA_1_0 = "create table if not exists "
+    "TODOS ("
+    "ID INTEGER"
+    ",TITLE TEXT"
+    ",DETAILS TEXT"
+    ",DONE INTEGER NOT NULL DEFAULT 0 CHECK(DONE = 0 or DONE = 1)"
+    ",CREATED DATE DEFAULT (datetime('now', 'localtime'))"
+    ",primary key(ID autoincrement));"
+    "create table if not exists "
+    "ATTACHMENTS ("
+    "ID INTEGER, "
+    "NAME TEXT NOT NULL, "
+    "TODO_ID INTEGER NOT NULL, "
+    "ATTACHMENT BLOB NOT NULL, "
+    "SIZE INTEGER NOT NULL, "
+    "primary key(ID autoincrement), "
+    "foreign key(TODO_ID) references TODOS(ID));";
+
+/**
+ * @brief Contents of the attachments in the 1.0 database, indexed by attachment id - 1.
+ *
+ */
+static ubyte_t* contents[TEST_ATTACHMENTS];
+
+/**
+ * @brief Sizes of the attachments in the 1.0 database.
+ *
+ */
+static size_t sizes[TEST_ATTACHMENTS];
+
+/**
+ * @brief Writes the title a todo of the 1.0 database gets. Every tenth one mentions the quarterly report.
+ *
+ * @param id Id of the todo.
+ * @param title Receives the title.
+ * @param len Size of title.
+ */
+static void todo_title(int id, byte_t* title, size_t len)
+{
+    if (id % 10 == 0)
+    {
+        snprintf(title, len, "Prepare the quarterly report %d", id);
+        return;
+    }
+
+    snprintf(title, len, "Todo %d: call Jürgen about the offer", id);
+}
+
+/**
+ * @brief Writes the details a todo of the 1.0 database gets. Every fifth todo has none.
+ *
+ * @param id Id of the todo.
+ * @param details Receives the details, empty for none.
+ * @param len Size of details.
+ */
+static void todo_details(int id, byte_t* details, size_t len)
+{
+    if (id % 5 == 0)
+    {
+        details[0] = 0;
+        return;
+    }
+
+    snprintf(details, len, "First line of %d.\nSecond line with a tab\tand ünïcödé ✓.", id);
+}
+
+/**
+ * @brief Fills the attachment contents: binary ones with every byte value including zero, compressible text, the
+ * same content twice and an empty one.
+ *
+ */
+static void make_contents()
+{
+    for (size_t i = 0; i < TEST_ATTACHMENTS; i++)
+    {
+        sizes[i] = i == TEST_ATTACHMENTS - 1 ? 0 : (i * 7919 * 31) % TEST_ATTACHMENT_MAX + 1;
+        contents[i] = malloc(sizes[i] + 1);
+
+        for (size_t j = 0; j < sizes[i]; j++)
+        {
+            contents[i][j] = i % 3 == 0 ? (ubyte_t)("the same line again\n"[j % 20]) : (ubyte_t)((j * 131 + i) % 256);
+        }
+    }
+
+    // Two todos with the same file.
+    free(contents[5]);
+    sizes[5] = sizes[4];
+    contents[5] = malloc(sizes[5] + 1);
+    memcpy(contents[5], contents[4], sizes[5]);
+}
+
+/**
+ * @brief Creates a database as toodles 1.0 left it at the storage path.
+ *
+ * @param extra_sql Further statements run after the data was written, NULL for none.
+ * @return bool Success indicator.
+ */
+static bool create_1_0_storage(const byte_t* extra_sql)
+{
+    sqlite3* db;
+
+    if (sqlite3_open(storage_file_path, &db) != SQLITE_OK || sqlite3_exec(db, SCHEMA_1_0, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        printf("Could not create the 1.0 database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_exec(db, "begin", NULL, NULL, NULL);
+
+    sqlite3_stmt* todo;
+    sqlite3_stmt* attachment;
+
+    sqlite3_prepare_v2(db, "insert into TODOS (TITLE, DETAILS, DONE, CREATED) "
+        "values (?, ?, ?, datetime('2022-03-01 08:00:00', '+' || ? || ' hours'))", -1, &todo, NULL);
+    sqlite3_prepare_v2(db, "insert into ATTACHMENTS (NAME, TODO_ID, ATTACHMENT, SIZE) values (?, ?, ?, ?)", -1, &attachment, NULL);
+
+    bool ok = true;
+
+    for (int id = 1; id <= TEST_TODOS && ok; id++)
+    {
+        byte_t title[128];
+        byte_t details[256];
+
+        todo_title(id, title, sizeof(title));
+        todo_details(id, details, sizeof(details));
+
+        sqlite3_bind_text(todo, 1, title, -1, SQLITE_TRANSIENT);
+
+        if (details[0] != 0)
+        {
+            sqlite3_bind_text(todo, 2, details, -1, SQLITE_TRANSIENT);
+        }
+        else
+        {
+            sqlite3_bind_null(todo, 2);
+        }
+
+        sqlite3_bind_int(todo, 3, id % 3 == 0);
+        sqlite3_bind_int(todo, 4, id);
+
+        ok = sqlite3_step(todo) == SQLITE_DONE;
+        sqlite3_reset(todo);
+    }
+
+    for (size_t i = 0; i < TEST_ATTACHMENTS && ok; i++)
+    {
+        byte_t name[64];
+        snprintf(name, sizeof(name), "file %zu.bin", i + 1);
+
+        sqlite3_bind_text(attachment, 1, name, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(attachment, 2, (int)(i * 37 % TEST_TODOS) + 1);
+        sqlite3_bind_blob(attachment, 3, contents[i], (int)sizes[i], SQLITE_STATIC);
+        sqlite3_bind_int64(attachment, 4, (sqlite3_int64)sizes[i]);
+
+        ok = sqlite3_step(attachment) == SQLITE_DONE;
+        sqlite3_reset(attachment);
+    }
+
+    sqlite3_finalize(todo);
+    sqlite3_finalize(attachment);
+
+    ok = ok && sqlite3_exec(db, "commit", NULL, NULL, NULL) == SQLITE_OK;
+    ok = ok && (extra_sql == NULL || sqlite3_exec(db, extra_sql, NULL, NULL, NULL) == SQLITE_OK);
+
+    if (!ok)
+    {
+        printf("Could not fill the 1.0 database: %s\n", sqlite3_errmsg(db));
+    }
+
+    sqlite3_close(db);
+
+    return ok;
+}
+
+/**
+ * @brief Runs a query that returns one number on the given connection.
+ *
+ * @param db The connection.
+ * @param sql The query.
+ * @return long long The number or -1 if the query failed.
+ */
+static long long query_int(sqlite3* db, const byte_t* sql)
+{
+    sqlite3_stmt* statement;
+    long long value = -1;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &statement, NULL) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW)
+    {
+        value = sqlite3_column_int64(statement, 0);
+    }
+
+    sqlite3_finalize(statement);
+
+    return value;
+}
+
+/**
+ * @brief Runs a query that returns one number on a connection of its own, as another process would.
+ *
+ * @param sql The query.
+ * @return long long The number or -1 if the query failed.
+ */
+static long long query_file_int(const byte_t* sql)
+{
+    sqlite3* db;
+    long long value = -1;
+
+    if (sqlite3_open_v2(storage_file_path, &db, SQLITE_OPEN_READWRITE, NULL) == SQLITE_OK)
+    {
+        value = query_int(db, sql);
+    }
+
+    sqlite3_close(db);
+
+    return value;
+}
+
+/**
+ * @brief Checks that every todo of the 1.0 database is there unchanged.
+ *
+ */
+static void check_todos()
+{
+    TEST_CHECK(query_int(sqlite_handle, "select count(*) from TODOS") == TEST_TODOS);
+
+    sqlite3_stmt* statement;
+    sqlite3_prepare_v2(sqlite_handle, "select ID, TITLE, DETAILS, DONE, CREATED from TODOS order by ID", -1, &statement, NULL);
+
+    int id = 0;
+    int mismatches = 0;
+
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+        id++;
+
+        byte_t title[128];
+        byte_t details[256];
+        byte_t created[32];
+
+        todo_title(id, title, sizeof(title));
+        todo_details(id, details, sizeof(details));
+        snprintf(created, sizeof(created), "2022-03-%02d %02d:00:00", 1 + (8 + id) / 24, (8 + id) % 24);
+
+        const byte_t* stored_details = (const byte_t*)sqlite3_column_text(statement, 2);
+
+        bool same = sqlite3_column_int(statement, 0) == id
+            && strcmp((const byte_t*)sqlite3_column_text(statement, 1), title) == 0
+            && strcmp(stored_details != NULL ? stored_details : "", details) == 0
+            && sqlite3_column_int(statement, 3) == (id % 3 == 0);
+
+        // The days only fit March for the first few hundred hours.
+        if (id <= 500)
+        {
+            same = same && strcmp((const byte_t*)sqlite3_column_text(statement, 4), created) == 0;
+        }
+
+        mismatches += !same;
+    }
+
+    sqlite3_finalize(statement);
+
+    TEST_CHECK(id == TEST_TODOS);
+    TEST_CHECK(mismatches == 0);
+}
+
+/**
+ * @brief Checks that every attachment of the 1.0 database reads back byte for byte.
+ *
+ */
+static void check_attachments()
+{
+    TEST_CHECK(query_int(sqlite_handle, "select count(*) from ATTACHMENTS") == TEST_ATTACHMENTS);
+
+    // The same content is stored once.
+    TEST_CHECK(query_int(sqlite_handle, "select count(*) from BLOBS") == TEST_ATTACHMENTS - 1);
+
+    byte_t path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/attachment.out", test_home);
+
+    for (size_t i = 0; i < TEST_ATTACHMENTS; i++)
+    {
+        byte_t id[32];
+        snprintf(id, sizeof(id), "%zu", i + 1);
+
+        const byte_t* err = NULL;
+
+        if (!TEST_CHECK(storage_save_attachment_to_disk(id, path, &err) == STORAGE_NO_ERROR))
+        {
+            printf("Attachment %s: %s\n", id, err);
+            continue;
+        }
+
+        FILE* file = fopen(path, "rb");
+        ubyte_t* read = malloc(sizes[i] + 1);
+        size_t len = file != NULL ? fread(read, 1, sizes[i] + 1, file) : 0;
+
+        if (!TEST_CHECK(len == sizes[i] && memcmp(read, contents[i], sizes[i]) == 0))
+        {
+            printf("Attachment %s differs after the upgrade.\n", id);
+        }
+
+        free(read);
+
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+
+        unlink(path);
+    }
+}
+
+/**
+ * @brief Upgrades a 1.0 database with data and checks that nothing was lost, that search finds the old todos and
+ * that opening it again changes nothing.
+ *
+ */
+static void test_upgrade_from_1_0()
+{
+    if (!TEST_CHECK(create_1_0_storage(NULL)) || !TEST_CHECK(test_open_storage()))
+    {
+        return;
+    }
+
+    TEST_CHECK(query_int(sqlite_handle, "pragma user_version") == storage_schema_version());
+
+    check_todos();
+    check_attachments();
+
+    TEST_CHECK(query_int(sqlite_handle, "select count(*) from TODOS_FTS where TODOS_FTS match 'quarterly'") == TEST_TODOS / 10);
+    TEST_CHECK(query_int(sqlite_handle, "select count(*) from TODOS_FTS where TODOS_FTS match 'jürgen'") == TEST_TODOS - TEST_TODOS / 10);
+
+    storage_shutdown(NULL);
+
+    // Any DDL would bump the schema cookie.
+    long long cookie = query_file_int("pragma schema_version");
+
+    if (TEST_CHECK(test_open_storage()))
+    {
+        TEST_CHECK(query_int(sqlite_handle, "pragma schema_version") == cookie);
+        TEST_CHECK(query_int(sqlite_handle, "pragma user_version") == storage_schema_version());
+    }
+}
+
+/**
+ * @brief Lets a late migration fail on a 1.0 database and checks that the database is left as it was.
+ *
+ */
+static void test_failed_migration_rolls_back()
+{
+    // The sync migration creates this table, so the migrations before it have run when it fails.
+    if (!TEST_CHECK(create_1_0_storage("create table SYNC_TODOS (UID TEXT)")))
+    {
+        return;
+    }
+
+    long long cookie = query_file_int("pragma schema_version");
+
+    TEST_CHECK(test_init());
+
+    const byte_t* err = NULL;
+
+    TEST_CHECK(storage_new_storage(&err) != STORAGE_NO_ERROR);
+    storage_shutdown(NULL);
+
+    TEST_CHECK(query_file_int("pragma user_version") == 0);
+    TEST_CHECK(query_file_int("pragma schema_version") == cookie);
+    TEST_CHECK(query_file_int("select count(*) from sqlite_master where name in ('BLOBS', 'TODOS_FTS')") == 0);
+    TEST_CHECK(query_file_int("select count(*) from pragma_table_info('ATTACHMENTS') where name = 'ATTACHMENT'") == 1);
+    TEST_CHECK(query_file_int("select count(*) from TODOS") == TEST_TODOS);
+    TEST_CHECK(query_file_int("select sum(SIZE) from ATTACHMENTS") == query_file_int("select sum(length(ATTACHMENT)) from ATTACHMENTS"));
+}
+
+/**
+ * @brief Closes the storage and deletes its files, so that the next case starts without a storage.
+ *
+ */
+static void test_reset()
+{
+    test_empty_home();
+
+    // The storage expects the application directory to exist.
+    mkdir(env_app_dir(), S_IRWXU | S_IRWXG);
+}
+
+/**
+ * @brief Upgrades databases of toodles 1.0 through all migrations.
+ *
+ * @return int EXIT_SUCCESS if all checks passed.
+ */
+int main()
+{
+    if (!TEST_CHECK(test_init()))
+    {
+        return EXIT_FAILURE;
+    }
+
+    make_contents();
+
+    test_upgrade_from_1_0();
+    test_reset();
+
+    test_failed_migration_rolls_back();
+    test_finish();
+
+    for (size_t i = 0; i < TEST_ATTACHMENTS; i++)
+    {
+        free(contents[i]);
+    }
+
+    printf("%d checks failed.\n", test_failures);
+
+    return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
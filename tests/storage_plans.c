@@ -0,0 +1,187 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+// The statement table and the plan check are internal to the storage, so it is compiled into this test. The plan
+// check only exists in debug builds.
+#undef NDEBUG
+#include "../src/storage/storage.c"
+
+#include "test.h"
+
+/**
+ * @brief Prints the query plan of the given statement.
+ *
+ * @param sql The statement.
+ */
+static void print_plan(const byte_t* sql)
+{
+    byte_t explain[strlen("explain query plan ") + strlen(sql) + 1];
+    snprintf(explain, sizeof(explain), "explain query plan %s", sql);
+
+    sqlite3_stmt* statement;
+
+    if (sqlite3_prepare_v2(sqlite_handle, explain, -1, &statement, NULL) != SQLITE_OK)
+    {
+        return;
+    }
+
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+        printf("    %s\n", sqlite3_column_text(statement, 3));
+    }
+
+    sqlite3_finalize(statement);
+}
+
+/**
+ * @brief Checks the query plan of every statement of a script. Statements that create or drop a table are run, so
+ * that the statements after them compile against the temporary tables they use.
+ *
+ * @param i Index of the script.
+ * @return int Number of checked statements.
+ */
+static int check_script(size_t i)
+{
+    const byte_t* tail = SCRIPTS[i].sql;
+    int checked = 0;
+
+    while (tail != NULL && *tail != 0)
+    {
+        sqlite3_stmt* statement = NULL;
+
+        if (sqlite3_prepare_v2(sqlite_handle, tail, -1, &statement, &tail) != SQLITE_OK)
+        {
+            printf("Script %zu does not compile: %s\n  %s\n", i, sqlite3_errmsg(sqlite_handle), SCRIPTS[i].sql);
+            test_failures++;
+            break;
+        }
+
+        if (statement == NULL)
+        {
+            continue;
+        }
+
+        const byte_t* sql = sqlite3_sql(statement);
+
+        if (!SCRIPTS[i].scan && storage_plan_has_scan(sql))
+        {
+            printf("Script %zu scans a table:\n  %s\n", i, sql);
+            print_plan(sql);
+            test_failures++;
+        }
+
+        if (strncmp(sql, "create ", strlen("create ")) == 0 || strncmp(sql, "drop ", strlen("drop ")) == 0)
+        {
+            sqlite3_step(statement);
+        }
+
+        sqlite3_finalize(statement);
+        checked++;
+    }
+
+    return checked;
+}
+
+/**
+ * @brief Opens a new storage at the latest migration with the archive attached and checks the query plan of every
+ * statement and of every statement in a script. A full table scan fails the test unless the statement or script is
+ * marked with scan.
+ *
+ * @return int EXIT_SUCCESS if every plan uses indexes.
+ */
+int main()
+{
+    if (!TEST_CHECK(test_open_storage()))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // The archive statements read the view over both databases, which only exists while the archive is attached.
+    bool attached = false;
+    const byte_t* err = NULL;
+
+    if (!TEST_CHECK(storage_attach_archive(true, &attached, &err) == STORAGE_NO_ERROR && attached))
+    {
+        test_finish();
+        return EXIT_FAILURE;
+    }
+
+    TEST_CHECK(sizeof(STATEMENTS) / sizeof(STATEMENTS[0]) == STMT_COUNT);
+
+    for (size_t i = 0; i < STMT_COUNT; i++)
+    {
+        const byte_t* sql = STATEMENTS[i].sql;
+
+        if (STATEMENTS[i].key != i)
+        {
+            printf("Statement %zu is out of order.\n", i);
+            test_failures++;
+            continue;
+        }
+
+        sqlite3_stmt* statement;
+
+        if (sqlite3_prepare_v2(sqlite_handle, sql, -1, &statement, NULL) != SQLITE_OK)
+        {
+            printf("Statement %zu does not compile: %s\n  %s\n", i, sqlite3_errmsg(sqlite_handle), sql);
+            test_failures++;
+            continue;
+        }
+
+        sqlite3_finalize(statement);
+
+        if (!STATEMENTS[i].scan && storage_plan_has_scan(sql))
+        {
+            printf("Statement %zu scans a table:\n  %s\n", i, sql);
+            print_plan(sql);
+            test_failures++;
+        }
+    }
+
+    printf("Checked %d statements.\n", STMT_COUNT);
+
+    // The sync registers SHA256 for the UIDs it derives, scripts that call it only compile with it.
+    TEST_CHECK(sqlite3_create_function(sqlite_handle, "SHA256", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+        storage_sha256_function, NULL, NULL) == SQLITE_OK);
+
+    TEST_CHECK(sizeof(SCRIPTS) / sizeof(SCRIPTS[0]) == SCRIPT_COUNT);
+
+    int checked = 0;
+
+    for (size_t i = 0; i < SCRIPT_COUNT; i++)
+    {
+        if (SCRIPTS[i].key != i)
+        {
+            printf("Script %zu is out of order.\n", i);
+            test_failures++;
+            continue;
+        }
+
+        checked += check_script(i);
+    }
+
+    printf("Checked %d statements in %d scripts.\n", checked, SCRIPT_COUNT);
+
+    test_finish();
+
+    return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+/* MIT License
+
+Copyright(c) 2022 Lukas Pfeifer
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+#pragma once
+
+// Helpers for the storage tests. Each test compiles storage.c into itself before including this file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "../src/env/env.h"
+
+/**
+ * @brief Checks a condition and counts it as a failure if it does not hold.
+ *
+ */
+#define TEST_CHECK(condition) test_check((condition), #condition, __FILE__, __LINE__)
+
+/**
+ * @brief Number of failed checks.
+ *
+ */
+static int test_failures = 0;
+
+/**
+ * @brief HOME of the test, a new directory below /tmp, so that the storage of the user is never touched.
+ *
+ */
+static byte_t test_home[PATH_MAX] = { 0 };
+
+/**
+ * @brief Prints the failed condition and counts it.
+ *
+ * @param ok Result of the condition.
+ * @param condition The condition as written.
+ * @param file Source file of the check.
+ * @param line Line of the check.
+ * @return bool The result of the condition.
+ */
+static bool test_check(bool ok, const byte_t* condition, const byte_t* file, int line)
+{
+    if (!ok)
+    {
+        printf("%s:%d: check failed: %s\n", file, line, condition);
+        test_failures++;
+    }
+
+    return ok;
+}
+
+/**
+ * @brief Points HOME to a new directory and initializes the environment and the storage paths. Runs once.
+ *
+ * @return bool Success indicator.
+ */
+static bool test_init()
+{
+    if (test_home[0] != 0)
+    {
+        return true;
+    }
+
+    snprintf(test_home, PATH_MAX, "/tmp/toodles-test-XXXXXX");
+
+    if (mkdtemp(test_home) == NULL)
+    {
+        test_home[0] = 0;
+        return false;
+    }
+
+    setenv("HOME", test_home, 1);
+    unsetenv("TOODLES_STORAGE_BACKEND");
+    unsetenv("TOODLES_STORAGE_PROFILE");
+
+    const byte_t* err = NULL;
+
+    if (env_init(&err) != 0 || storage_init(&err) != STORAGE_NO_ERROR)
+    {
+        printf("Could not initialize: %s\n", err);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Opens the storage in the test HOME. Creates it at the latest migration if it does not exist yet.
+ *
+ * @return bool Success indicator.
+ */
+static bool test_open_storage()
+{
+    if (!test_init())
+    {
+        return false;
+    }
+
+    const byte_t* err = NULL;
+
+    if (storage_new_storage(&err) != STORAGE_NO_ERROR)
+    {
+        printf("Could not open the storage: %s\n", err);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Closes the storage and deletes everything in the test HOME.
+ *
+ */
+static void test_empty_home()
+{
+    storage_shutdown(NULL);
+
+    byte_t dir[PATH_MAX + 1];
+    snprintf(dir, sizeof(dir), "%s/", test_home);
+
+    long long budget = LLONG_MAX;
+    storage_remove_tree(dir, &budget, NULL);
+}
+
+/**
+ * @brief Closes the storage and deletes the test HOME.
+ *
+ */
+static void test_finish()
+{
+    test_empty_home();
+    rmdir(test_home);
+}
\ No newline at end of file